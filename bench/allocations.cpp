@@ -0,0 +1,45 @@
+#include "bench.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+//Replaces the global allocation functions so that benchmarks can count allocations.
+namespace
+{
+	std::atomic<size_t> allocationCount(0);
+}
+
+void * operator new(size_t size)
+{
+	++allocationCount;
+	if (void * memory = std::malloc(size ? size : 1))
+	{
+		return memory;
+	}
+
+	throw std::bad_alloc();
+}
+
+void * operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void * memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void * memory) noexcept
+{
+	std::free(memory);
+}
+
+namespace Bench
+{
+	size_t allocations()
+	{
+		return allocationCount.load();
+	}
+}
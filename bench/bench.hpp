@@ -0,0 +1,58 @@
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+#include <chrono>
+#include <string>
+
+/*
+	A minimal benchmark harness. Benchmarks register themselves with BENCHMARK(name),
+	and the benchmark executable runs every registered benchmark, or only those whose
+	name contains one of its arguments.
+*/
+
+#pragma once
+namespace Bench
+{
+	typedef void (*BenchmarkFunction)();
+
+	struct Registrar
+	{
+		Registrar(const char * name, BenchmarkFunction fn);
+	};
+
+	//Calls fn repeatedly until minimumSeconds have elapsed, and returns the mean nanoseconds per call.
+	template<typename F>
+	double measure(F fn, double minimumSeconds = 0.25)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		size_t iterations = 1;
+		while (true)
+		{
+			Clock::time_point start = Clock::now();
+			for (size_t i = 0; i < iterations; ++i)
+			{
+				fn();
+			}
+
+			double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+			if (elapsed >= minimumSeconds || iterations >= (size_t(1) << 30))
+			{
+				return elapsed * 1e9 / iterations;
+			}
+
+			iterations *= 2;
+		}
+	}
+
+	//The number of times the global operator new has been called since the program started.
+	size_t allocations();
+
+	//Prints one row of results.
+	void report(const std::string& label, double value, const char * unit);
+}
+
+#define BENCHMARK(name) 																\
+	static void BOOST_PP_CAT(benchmark_, name)();										\
+	static Bench::Registrar BOOST_PP_CAT(registrar_, name)(BOOST_PP_STRINGIZE(name),	\
+		&BOOST_PP_CAT(benchmark_, name));												\
+	static void BOOST_PP_CAT(benchmark_, name)()
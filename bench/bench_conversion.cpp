@@ -0,0 +1,70 @@
+#include "bench.hpp"
+#include "conversion.hpp"
+#include "eval.hpp"
+
+#include <sstream>
+
+namespace
+{
+	void convertLiteral(const char * digits, size_t base)
+	{
+		double ns = Bench::measure([&]() { Represent::convert(digits, base); }, 0.1);
+
+		std::stringstream label;
+		label << "convert base " << base << " " << digits;
+		Bench::report(label.str(), ns, "ns/literal");
+	}
+
+	void convertInteger(const char * digits, size_t base)
+	{
+		boost::uint64_t result = 0;
+		double ns = Bench::measure([&]() { Represent::convertInteger(digits, base, result); }, 0.1);
+
+		std::stringstream label;
+		label << "convertInteger base " << base << " " << digits;
+		Bench::report(label.str(), ns, "ns/literal");
+	}
+}
+
+BENCHMARK(convert_integers)
+{
+	convertLiteral("7", 10);
+	convertInteger("7", 10);
+	convertLiteral("DEADBEEF", 16);
+	convertInteger("DEADBEEF", 16);
+	convertLiteral("1234567890123456789", 10);
+	convertInteger("1234567890123456789", 10);
+	convertLiteral("123456789012345678901234567890123456789012345678901234567890", 10);
+
+	//simplify() turns small integer literals into TOKEN_RAW_VALUE.
+	double ns = Bench::measure([]() { Represent::EvaluationContext context("0xDEADBEEF + 0x10 * 42"); }, 0.1);
+	Bench::report("load 0xDEADBEEF + 0x10 * 42", ns, "ns/load");
+}
+
+BENCHMARK(convert_fractions)
+{
+	convertLiteral("0.5", 10);
+	convertLiteral("3.14159265358979323846264338327950288", 10);
+	convertLiteral("0.000000000000000000000000000001", 10);
+	convertLiteral("0.1011011101111011111011111101111111", 2);
+	convertLiteral("0.DEADBEEFCAFEBABE", 16);
+	convertLiteral("0.7654321076543210", 8);
+}
+
+BENCHMARK(convert_to_double)
+{
+	const char * literals[] = { "0.1", "3.14159265358979323846264338327950288", "0.DEADBEEFCAFEBABE" };
+	const size_t bases[] = { 10, 10, 16 };
+
+	for (size_t i = 0; i < 3; ++i)
+	{
+		const char * digits = literals[i];
+		size_t base = bases[i];
+
+		double viaValue = Bench::measure([&]() { Represent::convert(digits, base).convert_to<double>(); }, 0.1);
+		double direct = Bench::measure([&]() { Represent::convertAs<double>(digits, base); }, 0.1);
+
+		Bench::report(std::string("through Value ") + digits, viaValue, "ns/literal");
+		Bench::report(std::string("direct ") + digits, direct, "ns/literal");
+	}
+}
@@ -0,0 +1,511 @@
+#include "bench.hpp"
+#include "eval.hpp"
+#include "evalutils.hpp"
+#include "function.hpp"
+#include "kernels.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+namespace
+{
+	Represent::GenericFunction<Represent::Increment> incr;
+
+	const char * EXPRESSION = "(a + 2 * b) / (1.5 + a) - a * 0.25 * b + incr(b) * 4.75";
+
+	template<typename T>
+	void evaluateLoaded(const char * name)
+	{
+		Represent::EvaluationContext ctx(EXPRESSION);
+		ctx.define("a", Represent::Value("1.25"));
+		ctx.define("b", Represent::Value(3));
+		ctx.define("incr", Represent::Function(incr));
+
+		double ns = Bench::measure([&]() { ctx.evaluateWith<T>(); }, 0.2);
+		Bench::report(name, ns / 1000.0, "us/evaluation");
+	}
+}
+
+BENCHMARK(evaluate_loaded)
+{
+	evaluateLoaded<Represent::Value>("Value");
+	evaluateLoaded<double>("double");
+	evaluateLoaded<float>("float");
+}
+
+namespace
+{
+	//Every operand is an identifier or a literal that has to be read from storage.
+	const char * REFERENCES = "a * b + c * d + e * f + 0.5 * a + 1.25 * b + 2.75 * c + 0.125 * d + e / f + a * 0.3 + b * 0.7";
+
+	template<typename T>
+	void evaluateReferences(const char * name)
+	{
+		Represent::EvaluationContext ctx(REFERENCES);
+		const char * names[] = { "a", "b", "c", "d", "e", "f" };
+		for (size_t i = 0; i < 6; ++i)
+		{
+			ctx.define(names[i], Represent::Value(i) / 7);
+		}
+
+		double ns = Bench::measure([&]() { ctx.evaluateWith<T>(); }, 0.2);
+		Bench::report(name, ns / 1000.0, "us/evaluation");
+	}
+}
+
+BENCHMARK(evaluate_references)
+{
+	evaluateReferences<Represent::Value>("Value");
+	evaluateReferences<double>("double");
+	evaluateReferences<float>("float");
+}
+
+namespace
+{
+	//The expressions from tests/test_evaluate.cpp.
+	const char * TEST_EXPRESSIONS[] = 
+	{
+		"1 + 1 + 1 + 1 + 1 + 1 + 1 + 1 + 1 + 1 + 1 + 1", "-increment(-increment(4))", 
+		"42 + -41 / 4 - 3", "[1, 2, 3, 4] + [2, 3, 4, 5]", "[1 + 2, (3 + 3) / 2, 4, 4]", 
+		"(2 + 2 * (2 + 3)) / (1 + 2)"
+	};
+
+	template<typename T>
+	void compareInterpreters(const char * name)
+	{
+		for (size_t i = 0; i < sizeof(TEST_EXPRESSIONS) / sizeof(TEST_EXPRESSIONS[0]); ++i)
+		{
+			Represent::EvaluationContext ctx(TEST_EXPRESSIONS[i]);
+			ctx.define("increment", Represent::Function(incr));
+
+			//Without the conversion of the result back to Value, which both pay alike.
+			double stack = Bench::measure([&]() { ctx.evaluateNativeOnStack<T>(); }, 0.1);
+			double vm = Bench::measure([&]() { ctx.evaluateNative<T>(); }, 0.1);
+
+			Bench::report(std::string(name) + " stack " + TEST_EXPRESSIONS[i], stack / 1000.0, "us/evaluation");
+			Bench::report(std::string(name) + " vm    " + TEST_EXPRESSIONS[i], vm / 1000.0, "us/evaluation");
+		}
+	}
+}
+
+BENCHMARK(evaluate_vm_vs_stack)
+{
+	compareInterpreters<Represent::Value>("Value");
+	compareInterpreters<double>("double");
+}
+
+namespace
+{
+	template<typename T>
+	void evaluateConstant(const char * name, const char * text)
+	{
+		Represent::EvaluationContext ctx(text);
+		ctx.define("x", Represent::Value("1.25"));
+
+		double ns = Bench::measure([&]() { ctx.evaluateWith<T>(); }, 0.2);
+		Bench::report(std::string(name) + " " + text, ns / 1000.0, "us/evaluation");
+	}
+
+	template<typename T>
+	void evaluateConstants(const char * name)
+	{
+		evaluateConstant<T>(name, "[1 + 2, (3 + 3) / 2, 4, 4] * 0.5");
+		evaluateConstant<T>(name, "x * (2 + 3) / (4 - 1.5) + x / (0.1 * 3)");
+	}
+}
+
+BENCHMARK(evaluate_constant)
+{
+	evaluateConstants<Represent::Value>("Value");
+	evaluateConstants<double>("double");
+	evaluateConstants<float>("float");
+}
+
+namespace
+{
+	//The same subexpressions repeated, as generated transforms do.
+	const char * SHARED = "[a * b, a / b, a * b, a / b] * ((a * b + a / b) * (a * b + a / b) + (a * b + a / b) / (a * b - a / b))";
+
+	template<typename T>
+	void evaluateShared(const char * name)
+	{
+		Represent::EvaluationContext ctx(SHARED);
+		ctx.define("a", Represent::Value("1.25"));
+		ctx.define("b", Represent::Value(3));
+
+		double ns = Bench::measure([&]() { ctx.evaluateNative<T>(); }, 0.2);
+		Bench::report(name, ns / 1000.0, "us/evaluation");
+	}
+}
+
+BENCHMARK(evaluate_shared)
+{
+	evaluateShared<Represent::Value>("Value");
+	evaluateShared<double>("double");
+	evaluateShared<float>("float");
+}
+
+namespace
+{
+	const size_t BATCH_ROWS = 100000;
+
+	template<typename T>
+	void evaluateRows(const char * name, const char * text)
+	{
+		std::vector<T> xs, ys, output(BATCH_ROWS);
+		for (size_t i = 0; i < BATCH_ROWS; ++i)
+		{
+			xs.push_back(T(i) / 7);
+			ys.push_back(T(i % 13));
+		}
+
+		Represent::EvaluationContext ctx(text);
+
+		//What a caller had to do for every row before batches.
+		double rows = Bench::measure([&]() 
+		{
+			for (size_t i = 0; i < 1000; ++i)
+			{
+				ctx.define("x", Represent::Value(xs[i]));
+				ctx.define("y", Represent::Value(ys[i]));
+				output[i] = boost::get<Represent::Value>(ctx.evaluateWith<T>()).template convert_to<T>();
+			}
+		}, 0.2) / 1000;
+
+		std::vector<Represent::Column<T> > inputs;
+		Represent::Column<T> x = { "x", &xs[0] };
+		Represent::Column<T> y = { "y", &ys[0] };
+		inputs.push_back(x);
+		inputs.push_back(y);
+
+		double batch = Bench::measure([&]() { ctx.evaluateBatch(inputs, &output[0], BATCH_ROWS); }, 0.2) / BATCH_ROWS;
+
+		Bench::report(std::string(name) + " rows  " + text, 1e3 / rows, "M rows/s");
+		Bench::report(std::string(name) + " batch " + text, 1e3 / batch, "M rows/s");
+	}
+}
+
+BENCHMARK(evaluate_batch)
+{
+	evaluateRows<double>("double", "x * 3 + y");
+	evaluateRows<double>("double", "(x - y) / (x * 2 + 1) + (x * 2 + 1) * 0.25");
+	evaluateRows<float>("float", "x * 3 + y");
+	evaluateRows<Represent::Value>("Value", "x * 3 + y");
+}
+
+namespace
+{
+	template<typename T>
+	void evaluateKernels(const char * name, const char * text)
+	{
+		std::vector<T> xs, ys, output(BATCH_ROWS);
+		for (size_t i = 0; i < BATCH_ROWS; ++i)
+		{
+			xs.push_back(T(i) / 7);
+			ys.push_back(T(i % 13));
+		}
+
+		Represent::EvaluationContext ctx(text);
+
+		std::vector<Represent::Column<T> > inputs;
+		Represent::Column<T> x = { "x", &xs[0] };
+		Represent::Column<T> y = { "y", &ys[0] };
+		inputs.push_back(x);
+		inputs.push_back(y);
+
+		Represent::KernelType supported = Represent::supportedKernels();
+		for (int type = Represent::KERNEL_SCALAR; type <= supported; ++type)
+		{
+			Represent::selectKernels(static_cast<Represent::KernelType>(type));
+			double batch = Bench::measure([&]() { ctx.evaluateBatch(inputs, &output[0], BATCH_ROWS); }, 0.2) / BATCH_ROWS;
+
+			Bench::report(std::string(name) + " " + Represent::toString(static_cast<Represent::KernelType>(type)) + " " + text, 1e3 / batch, "M rows/s");
+		}
+
+		Represent::selectKernels(supported);
+	}
+}
+
+BENCHMARK(evaluate_batch_kernels)
+{
+	evaluateKernels<double>("double", "x * 3 + y");
+	evaluateKernels<double>("double", "(x - y) / (x * 2 + 1) + (x * 2 + 1) * 0.25");
+	evaluateKernels<float>("float", "x * 3 + y");
+	evaluateKernels<float>("float", "(x - y) / (x * 2 + 1) + (x * 2 + 1) * 0.25");
+}
+
+namespace
+{
+	const size_t PARALLEL_ROWS = 10000000;
+
+	template<typename T>
+	void evaluateParallel(const char * name, const char * text)
+	{
+		std::vector<T> xs, ys, output(PARALLEL_ROWS);
+		for (size_t i = 0; i < PARALLEL_ROWS; ++i)
+		{
+			xs.push_back(T(i) / 7);
+			ys.push_back(T(i % 13));
+		}
+
+		Represent::EvaluationContext ctx(text);
+
+		std::vector<Represent::Column<T> > inputs;
+		Represent::Column<T> x = { "x", &xs[0] };
+		Represent::Column<T> y = { "y", &ys[0] };
+		inputs.push_back(x);
+		inputs.push_back(y);
+
+		double serial = Bench::measure([&]() { ctx.evaluateBatch(inputs, &output[0], PARALLEL_ROWS); }, 0.5) / PARALLEL_ROWS;
+		Bench::report(std::string(name) + " serial    " + text, 1e3 / serial, "M rows/s");
+
+		size_t cores = std::max(1u, boost::thread::hardware_concurrency());
+		for (size_t threads = 1; threads <= cores; threads = threads * 2 > cores && threads < cores ? cores : threads * 2)
+		{
+			Represent::ThreadPool pool(threads);
+			double parallel = Bench::measure([&]() { ctx.evaluateBatch(inputs, &output[0], PARALLEL_ROWS, pool); }, 0.5) / PARALLEL_ROWS;
+
+			Bench::report(std::string(name) + " " + boost::lexical_cast<std::string>(threads) + " threads " + text, 1e3 / parallel, "M rows/s");
+		}
+	}
+}
+
+BENCHMARK(evaluate_parallel)
+{
+	evaluateParallel<double>("double", "x * 3 + y");
+	evaluateParallel<double>("double", "(x - y) / (x * 2 + 1) + (x * 2 + 1) * 0.25");
+	evaluateParallel<float>("float", "(x - y) / (x * 2 + 1) + (x * 2 + 1) * 0.25");
+}
+
+BENCHMARK(evaluate_shadow)
+{
+	Represent::EvaluationContext ctx(REFERENCES);
+	const char * names[] = { "a", "b", "c", "d", "e", "f" };
+	for (size_t i = 0; i < 6; ++i)
+	{
+		ctx.define(names[i], Represent::Value(i + 1) / 7);
+	}
+
+	//Three passes, after which only the results can be compared.
+	double separate = Bench::measure([&]() 
+	{ 
+		ctx.evaluateOnStackWith<Represent::Value>();
+		ctx.evaluateOnStackWith<double>();
+		ctx.evaluateOnStackWith<float>();
+	}, 0.2);
+	Bench::report("three passes", separate / 1000.0, "us/evaluation");
+
+	double traversal = Bench::measure([&]() { ctx.evaluateNativeOnStack<Represent::Shadow>(); }, 0.2);
+	Bench::report("shadowed", traversal / 1000.0, "us/evaluation");
+
+	double fused = Bench::measure([&]() { ctx.evaluateShadow(4); }, 0.2);
+	Bench::report("shadowed, every operator checked", fused / 1000.0, "us/evaluation");
+}
+
+BENCHMARK(evaluate_adaptive)
+{
+	Represent::EvaluationContext ctx(REFERENCES);
+	const char * names[] = { "a", "b", "c", "d", "e", "f" };
+	for (size_t i = 0; i < 6; ++i)
+	{
+		ctx.define(names[i], Represent::Value(i + 1) / 7);
+	}
+
+	double full = Bench::measure([&]() { ctx.evaluateOnStackWith<Represent::Value>(); }, 0.2);
+	Bench::report("Value", full / 1000.0, "us/evaluation");
+
+	double native = Bench::measure([&]() { ctx.evaluateOnStackWith<double>(); }, 0.2);
+	Bench::report("double", native / 1000.0, "us/evaluation");
+
+	//Settled by the double intervals.
+	double loose = Bench::measure([&]() { ctx.evaluateAdaptive(Represent::Value("1e-12")); }, 0.2);
+	Bench::report("adaptive, 1e-12", loose / 1000.0, "us/evaluation");
+
+	//Every operator escalates, since a to f are not exact in double.
+	double tight = Bench::measure([&]() { ctx.evaluateAdaptive(Represent::Value("1e-40")); }, 0.2);
+	Bench::report("adaptive, 1e-40", tight / 1000.0, "us/evaluation");
+
+	//Only the final addition escalates.
+	ctx.load("(x * 3 + y) * (x - y) / 4 + 0.1");
+	ctx.define("x", Represent::Value(5));
+	ctx.define("y", Represent::Value(2));
+	double partial = Bench::measure([&]() { ctx.evaluateAdaptive(Represent::Value("1e-40")); }, 0.2);
+	Bench::report("adaptive, exact subexpression reused", partial / 1000.0, "us/evaluation");
+
+	double partialFull = Bench::measure([&]() { ctx.evaluateOnStackWith<Represent::Value>(); }, 0.2);
+	Bench::report("Value, same expression", partialFull / 1000.0, "us/evaluation");
+}
+
+namespace
+{
+	//The expressions from tests/test_evaluate.cpp that are not folded away.
+	const char * VARIABLE_EXPRESSIONS[] = 
+	{
+		"x + 4 * x", "0.1 + 0.2 * x", "[x, x, x, x] - x", "(x * 2 + 1) * (x * 2 + 1) - increment(x * 2 + 1)", 
+		"[x, 1, x, 1] + [x, 1, x, 1] * (x / 3)", REFERENCES
+	};
+
+	template<typename T>
+	void evaluateBackend(const char * name)
+	{
+		for (size_t i = 0; i < sizeof(VARIABLE_EXPRESSIONS) / sizeof(VARIABLE_EXPRESSIONS[0]); ++i)
+		{
+			Represent::EvaluationContext ctx(VARIABLE_EXPRESSIONS[i]);
+			ctx.define("increment", Represent::Function(incr));
+			ctx.define("x", Represent::Value("2.5"));
+
+			const char * names[] = { "a", "b", "c", "d", "e", "f" };
+			for (size_t j = 0; j < 6; ++j)
+			{
+				ctx.define(names[j], Represent::Value(j + 1) / 7);
+			}
+
+			double ns = Bench::measure([&]() { ctx.evaluateNative<T>(); }, 0.1);
+			Bench::report(std::string(name) + " " + VARIABLE_EXPRESSIONS[i], 1e6 / ns, "k evaluations/s");
+		}
+	}
+}
+
+BENCHMARK(evaluate_backends)
+{
+	evaluateBackend<Represent::Value>("Value      ");
+	evaluateBackend<Represent::Value50>("Value50    ");
+	evaluateBackend<Represent::Quad>("Quad       ");
+#ifdef REPRESENT_FLOAT128
+	evaluateBackend<Represent::Float128>("Float128   ");
+#endif
+	evaluateBackend<long double>("long double");
+	evaluateBackend<double>("double     ");
+}
+
+BENCHMARK(evaluate_integer)
+{
+	const char * text = "(x << 3 | y) & ~x s>> 2 >>> 7 | y <<< 13";
+	Represent::EvaluationContext ctx(text);
+	ctx.define("x", Represent::Value(-16));
+	ctx.define("y", Represent::Value(0x5A5A));
+
+	double full = Bench::measure([&]() { ctx.evaluateNative<Represent::Value>(); }, 0.2);
+	Bench::report(std::string("Value   ") + text, full, "ns/evaluation");
+
+	double native = Bench::measure([&]() { ctx.evaluateNative<double>(); }, 0.2);
+	Bench::report(std::string("double  ") + text, native, "ns/evaluation");
+
+	double integer = Bench::measure([&]() { ctx.evaluateNative<Represent::Integer>(); }, 0.2);
+	Bench::report(std::string("Integer ") + text, integer, "ns/evaluation");
+
+	//Including the check for a fallback, and the conversion of the result.
+	double checked = Bench::measure([&]() { ctx.evaluateInteger(); }, 0.2);
+	Bench::report(std::string("checked ") + text, checked, "ns/evaluation");
+}
+
+namespace
+{
+	//Right nested, so that every operand waits on the stack until the innermost is done.
+	std::string nestedExpression(size_t depth)
+	{
+		const char * names[] = { "a", "b", "c", "d", "e", "f" };
+
+		std::string text = "a";
+		for (size_t i = 0; i < depth; ++i)
+		{
+			text = std::string(names[i % 6]) + (i % 2 ? " * (" : " + (") + text + ")";
+		}
+		return text;
+	}
+
+	template<typename T>
+	void evaluateCells(const char * name)
+	{
+		Bench::report(std::string(name) + " sizeof(cell)", sizeof(typename Represent::Storage<T>::type), "bytes");
+
+		const std::string texts[] = { REFERENCES, nestedExpression(32) };
+		const char * labels[] = { " references", " nested    " };
+		for (size_t i = 0; i < 2; ++i)
+		{
+			Represent::EvaluationContext ctx(texts[i]);
+			const char * names[] = { "a", "b", "c", "d", "e", "f" };
+			for (size_t j = 0; j < 6; ++j)
+			{
+				ctx.define(names[j], Represent::Value(j + 1) / 7);
+			}
+
+			//Every operand is pushed, popped and copied on the stack.
+			double stack = Bench::measure([&]() { ctx.evaluateNativeOnStack<T>(); }, 0.2);
+			Bench::report(std::string(name) + labels[i] + " stack", stack / 1000.0, "us/evaluation");
+
+			double vm = Bench::measure([&]() { ctx.evaluateNative<T>(); }, 0.2);
+			Bench::report(std::string(name) + labels[i] + " vm", vm / 1000.0, "us/evaluation");
+		}
+	}
+}
+
+BENCHMARK(evaluate_cells)
+{
+	evaluateCells<Represent::Value>("Value      ");
+	evaluateCells<Represent::Value50>("Value50    ");
+	evaluateCells<Represent::Quad>("Quad       ");
+	evaluateCells<Represent::Interval<Represent::Value> >("Interval   ");
+	evaluateCells<Represent::Shadow>("Shadow     ");
+	evaluateCells<long double>("long double");
+	evaluateCells<double>("double     ");
+	evaluateCells<float>("float      ");
+	evaluateCells<Represent::Integer>("Integer    ");
+}
+
+BENCHMARK(evaluate_dispatch)
+{
+	//Every operator has a vector operand, so none take the scalar fast path.
+	const char * text = "[x, x, x, x] * x + [x, 1, x, 1] - [1, x, 1, x] / x + x * [x, x, 1, 1] - [1, 1, x, x]";
+	Represent::EvaluationContext ctx(text);
+	ctx.define("x", Represent::Value("2.5"));
+
+	double value = Bench::measure([&]() { ctx.evaluateNativeOnStack<Represent::Value>(); }, 0.2);
+	Bench::report("Value  stack", value / 1000.0, "us/evaluation");
+
+	double native = Bench::measure([&]() { ctx.evaluateNativeOnStack<double>(); }, 0.2);
+	Bench::report("double stack", native / 1000.0, "us/evaluation");
+
+	double vm = Bench::measure([&]() { ctx.evaluateNative<double>(); }, 0.2);
+	Bench::report("double vm", vm / 1000.0, "us/evaluation");
+}
+
+BENCHMARK(evaluate_typed)
+{
+	//The same vector expression as evaluate_dispatch, compiled to typed instructions.
+	const char * text = "[x, x, x, x] * x + [x, 1, x, 1] - [1, x, 1, x] / x + x * [x, x, 1, 1] - [1, 1, x, x]";
+	Represent::EvaluationContext ctx(text);
+	ctx.define("x", Represent::Value("2.5"));
+
+	double value = Bench::measure([&]() { ctx.evaluateNative<Represent::Value>(); }, 0.2);
+	Bench::report("Value  vm", value / 1000.0, "us/evaluation");
+
+	double native = Bench::measure([&]() { ctx.evaluateNative<double>(); }, 0.2);
+	Bench::report("double vm", native / 1000.0, "us/evaluation");
+}
+
+BENCHMARK(evaluate_identifiers)
+{
+	//50 names, each read twice, and a call that is recompiled whenever the function is redefined.
+	std::string text = "incr(v0)";
+	for (size_t i = 0; i < 50; ++i)
+	{
+		std::string name = "v" + boost::lexical_cast<std::string>(i);
+		text += " + " + name + " * " + name;
+	}
+
+	Represent::EvaluationContext ctx(text);
+	ctx.define("incr", Represent::Function(incr));
+	for (size_t i = 0; i < 50; ++i)
+	{
+		ctx.define("v" + boost::lexical_cast<std::string>(i), Represent::Value(i) / 7);
+	}
+
+	double vm = Bench::measure([&]() { ctx.evaluateNative<double>(); }, 0.2);
+	Bench::report("double vm", vm / 1000.0, "us/evaluation");
+
+	double stack = Bench::measure([&]() { ctx.evaluateNativeOnStack<double>(); }, 0.2);
+	Bench::report("double stack", stack / 1000.0, "us/evaluation");
+
+	double recompiled = Bench::measure([&]() { ctx.define("incr", Represent::Function(incr)); ctx.evaluateNative<double>(); }, 0.2);
+	Bench::report("recompiled", recompiled / 1000.0, "us/evaluation");
+}
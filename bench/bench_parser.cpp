@@ -0,0 +1,92 @@
+#include "bench.hpp"
+#include "parser.hpp"
+
+#include <sstream>
+
+namespace
+{
+	//(a+(a+(a+ ... b)))
+	std::string nested(size_t depth)
+	{
+		std::string text;
+		for (size_t i = 0; i < depth; ++i)
+		{
+			text += "(a+";
+		}
+
+		text += "b";
+		text += std::string(depth, ')');
+		return text;
+	}
+
+	void parseAtDepth(Represent::ParserType parser, const char * name, size_t depth)
+	{
+		std::string text = nested(depth);
+		double ns = Bench::measure([&]() { Represent::parse(text, parser); }, 0.1);
+
+		std::stringstream label;
+		label << name << " depth " << depth;
+		Bench::report(label.str(), ns / 1000.0, "us/parse");
+	}
+
+	void allocationsFor(Represent::ParserType parser, const char * name, const std::string& text)
+	{
+		size_t before = Bench::allocations();
+		Represent::TokenStream tokens = Represent::parse(text, parser);
+		size_t count = Bench::allocations() - before;
+
+		std::stringstream label;
+		label << name << " " << text.size() << " chars, " << (tokens.end() - tokens.begin()) << " tokens";
+		Bench::report(label.str(), count, "allocations");
+	}
+
+	//f(x, [1, 2, 3, 4]) * {0x10, 0.5} + f(x, ... repeated.
+	std::string flat(size_t terms)
+	{
+		std::string text;
+		for (size_t i = 0; i < terms; ++i)
+		{
+			text += i ? " + " : "";
+			text += "f(x, [1, 2, 3, 4]) * {0x10, 0.5}";
+		}
+
+		return text;
+	}
+}
+
+BENCHMARK(parse_nesting_depth)
+{
+	//The backtracking parser doubles its work with every level, so stop it early.
+	for (size_t depth = 1; depth <= 14; depth += 1)
+	{
+		parseAtDepth(Represent::PARSER_BACKTRACKING, "backtracking", depth);
+	}
+
+	for (size_t depth = 1; depth <= 4096; depth *= 4)
+	{
+		parseAtDepth(Represent::PARSER_PRATT, "pratt", depth);
+	}
+}
+
+BENCHMARK(parse_allocations)
+{
+	for (size_t depth = 1; depth <= 12; depth += 1)
+	{
+		allocationsFor(Represent::PARSER_BACKTRACKING, "backtracking", nested(depth));
+	}
+
+	for (size_t terms = 1; terms <= 64; terms *= 4)
+	{
+		allocationsFor(Represent::PARSER_BACKTRACKING, "backtracking", flat(terms));
+	}
+
+	for (size_t depth = 1; depth <= 4096; depth *= 4)
+	{
+		allocationsFor(Represent::PARSER_PRATT, "pratt", nested(depth));
+	}
+
+	for (size_t terms = 1; terms <= 1024; terms *= 4)
+	{
+		allocationsFor(Represent::PARSER_PRATT, "pratt", flat(terms));
+	}
+}
@@ -0,0 +1,55 @@
+#include "bench.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace Bench
+{
+	namespace
+	{
+		struct Entry
+		{
+			const char * name;
+			BenchmarkFunction fn;
+		};
+
+		std::vector<Entry>& registry()
+		{
+			static std::vector<Entry> entries;
+			return entries;
+		}
+	}
+
+	Registrar::Registrar(const char * name, BenchmarkFunction fn)
+	{
+		Entry entry = { name, fn };
+		registry().push_back(entry);
+	}
+
+	void report(const std::string& label, double value, const char * unit)
+	{
+		std::printf("  %-48s %14.2f %s\n", label.c_str(), value, unit);
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	const std::vector<Bench::Entry>& entries = Bench::registry();
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		bool selected = argc == 1;
+		for (int arg = 1; arg < argc; ++arg)
+		{
+			selected = selected || std::strstr(entries[i].name, argv[arg]) != NULL;
+		}
+
+		if (selected)
+		{
+			std::cout << entries[i].name << "\n";
+			entries[i].fn();
+			std::cout << std::endl;
+		}
+	}
+}
@@ -0,0 +1,149 @@
+#include <boost/pool/singleton_pool.hpp>
+#include <atomic>
+#include <iostream>
+#include <new>
+#include <utility>
+
+#pragma once
+namespace Represent
+{
+	//A T that lives in a pool, so that a storage cell holding one is only as large as a pointer.
+	//Copies share the same T, and it is only copied when a shared one is changed, so pushing
+	//and popping a matrix, array or string costs a reference count instead of a deep copy.
+	template<typename T>
+	class Boxed
+	{
+	public:
+		Boxed()
+			:node(create(T()))
+		{}
+
+		Boxed(const T& t)
+			:node(create(t))
+		{}
+
+		Boxed(T&& t)
+			:node(create(std::move(t)))
+		{}
+
+		Boxed(const Boxed& other)
+			:node(other.node)
+		{
+			node->references.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		//A moved from Boxed holds nothing, and may only be destroyed or assigned to.
+		Boxed(Boxed&& other) noexcept
+			:node(other.node)
+		{
+			other.node = NULL;
+		}
+
+		~Boxed()
+		{
+			release(node);
+		}
+
+		Boxed& operator=(const Boxed& other)
+		{
+			other.node->references.fetch_add(1, std::memory_order_relaxed);
+			release(node);
+			node = other.node;
+			return *this;
+		}
+
+		Boxed& operator=(Boxed&& other) noexcept
+		{
+			std::swap(node, other.node);
+			return *this;
+		}
+
+		const T& operator*() const
+		{
+			return node->value;
+		}
+
+		const T * operator->() const
+		{
+			return &node->value;
+		}
+
+		operator const T&() const
+		{
+			return node->value;
+		}
+
+		//The T to change, which is copied first if another cell shares it.
+		T& mutate()
+		{
+			if (node->references.load(std::memory_order_acquire) != 1)
+			{
+				Node * copy = create(node->value);
+				release(node);
+				node = copy;
+			}
+
+			return node->value;
+		}
+
+		friend bool operator==(const Boxed& a, const Boxed& b)
+		{
+			return a.node == b.node || *a == *b;
+		}
+
+		friend std::ostream& operator<<(std::ostream& o, const Boxed& b)
+		{
+			return o << *b;
+		}
+
+	private:
+		struct Node
+		{
+			template<typename U>
+			Node(U&& value)
+				:value(std::forward<U>(value))
+				,references(1)
+			{}
+
+			T value;
+			std::atomic<size_t> references;
+		};
+
+		//Every Boxed<T> shares one pool, which locks, since cells are shared between threads. It
+		//is only named in the functions, so that T may be incomplete where a Boxed<T> is declared.
+		template<typename U>
+		static Node * create(U&& t)
+		{
+			typedef boost::singleton_pool<Node, sizeof(Node)> Pool;
+
+			void * memory = Pool::malloc();
+			if (!memory)
+			{
+				throw std::bad_alloc();
+			}
+
+			try
+			{
+				return new(memory) Node(std::forward<U>(t));
+			}
+			catch (...)
+			{
+				Pool::free(memory);
+				throw;
+			}
+		}
+
+		static void release(Node * node)
+		{
+			if (node && node->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				typedef boost::singleton_pool<Node, sizeof(Node)> Pool;
+
+				node->~Node();
+				Pool::free(node);
+			}
+		}
+
+		Node * node;
+	};
+}
@@ -1,14 +1,65 @@
+#include <boost/multiprecision/cpp_bin_float.hpp>
 #include <boost/multiprecision/cpp_dec_float.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include "token.hpp"
 
+#ifdef REPRESENT_FLOAT128
+#include <boost/multiprecision/float128.hpp>
+#endif
+
+#pragma once
 namespace Represent
 {
 	typedef boost::multiprecision::cpp_dec_float_100 Value;
 
+	//Other backends an expression can be evaluated in. Each trades digits of Value for speed.
+	//__float128 needs libquadmath, so it is only built with REPRESENT_FLOAT128.
+	typedef boost::multiprecision::cpp_dec_float_50 Value50;
+	typedef boost::multiprecision::cpp_bin_float_quad Quad;
+
+#ifdef REPRESENT_FLOAT128
+	typedef boost::multiprecision::float128 Float128;
+#define FLOAT128_TYPES (Float128)
+#else
+#define FLOAT128_TYPES
+#endif
+
+	//Converts the first TOKEN_NUMBER of a stream into an actual number.
 	Value convert(const TokenStream& stream);
 
-	TokenStream::const_iterator convert(TokenStream::const_iterator begin, TokenStream::const_iterator end, Value& out);
-	TokenStream::const_iterator convertIdentifier(TokenStream::const_iterator begin, TokenStream::const_iterator end, std::string& out);
-	TokenStream::const_iterator convertString(TokenStream::const_iterator begin, TokenStream::const_iterator end, std::string& out);
-}
\ No newline at end of file
+	//Converts the digits of a number, with at most one decimal point, in the given base.
+	Value convert(boost::string_ref digits, size_t base);
+
+	//Converts the digits of an integer without going through Value. Returns false if the
+	//digits have a fractional part or do not fit in 64 bits.
+	bool convertInteger(boost::string_ref digits, size_t base, boost::uint64_t& result);
+
+	//Converts the digits of a number straight to T. float and double are correctly rounded, 
+	//and never go through Value.
+	template<typename T>
+	T convertAs(boost::string_ref digits, size_t base)
+	{
+		return convert(digits, base).template convert_to<T>();
+	}
+
+	template<> Value convertAs<Value>(boost::string_ref digits, size_t base);
+	template<> double convertAs<double>(boost::string_ref digits, size_t base);
+	template<> float convertAs<float>(boost::string_ref digits, size_t base);
+
+	//Narrows a Value to T. The pointer only picks the overload, so that number types that
+	//convert_to does not know can add their own.
+	template<typename T>
+	T convertValue(const Value& v, T *)
+	{
+		return v.template convert_to<T>();
+	}
+
+	//Converts a finite double to Value from its binary mantissa and exponent, which is exact while
+	//its decimal expansion fits in Value, and twice as fast as Value's own conversion.
+	Value exactValue(double d);
+
+	//Removes the escapes from the body of a string literal.
+	std::string convertString(boost::string_ref body);
+}
@@ -0,0 +1,82 @@
+#include <boost/type_traits/decay.hpp>
+#include <boost/type_traits/is_same.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+
+#pragma once
+namespace Represent
+{
+	namespace Detail
+	{
+		//A copy that is meant, such as a load from storage, which the copy count leaves out.
+		template<typename Cell>
+		Cell copy(const Cell& cell)
+		{
+			return cell;
+		}
+	}
+
+#ifdef REPRESENT_COUNT_COPIES
+	//The number of cells copied, other than by Detail::copy. Evaluation moves cells, so tests
+	//can check that it stays the same. Only builds with REPRESENT_COUNT_COPIES count them.
+	extern std::atomic<size_t> cellCopies;
+
+	//A variant that counts its copies, which is the storage cell in a counting build.
+	template<typename Variant>
+	struct CountedCell
+		: public Variant
+	{
+		using Variant::Variant;
+
+		CountedCell()
+		{}
+
+		CountedCell(const CountedCell& other)
+			:Variant(static_cast<const Variant&>(other))
+		{
+			cellCopies.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		//As noexcept as the variant, so that vectors of cells move them when they grow.
+		CountedCell(CountedCell&& other) noexcept(std::is_nothrow_move_constructible<Variant>::value)
+			:Variant(static_cast<Variant&&>(other))
+		{}
+
+		//An uncounted copy.
+		explicit CountedCell(const Variant& other)
+			:Variant(other)
+		{}
+
+		CountedCell& operator=(const CountedCell& other)
+		{
+			cellCopies.fetch_add(1, std::memory_order_relaxed);
+			Variant::operator=(static_cast<const Variant&>(other));
+			return *this;
+		}
+
+		CountedCell& operator=(CountedCell&& other)
+		{
+			Variant::operator=(static_cast<Variant&&>(other));
+			return *this;
+		}
+
+		template<typename U>
+		typename boost::disable_if<boost::is_same<typename boost::decay<U>::type, CountedCell>, CountedCell&>::type operator=(U&& u)
+		{
+			Variant::operator=(std::forward<U>(u));
+			return *this;
+		}
+	};
+
+	namespace Detail
+	{
+		template<typename Variant>
+		CountedCell<Variant> copy(const CountedCell<Variant>& cell)
+		{
+			return CountedCell<Variant>(static_cast<const Variant&>(cell));
+		}
+	}
+#endif
+}
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/seq/for_each.hpp>
+#include <boost/preprocessor/seq/for_each_i.hpp>
 #include <boost/variant.hpp>
 #include <boost/unordered_map.hpp>
 #include <vector>
@@ -7,29 +11,53 @@
 #include "matrix.h"
 #include "conversion.hpp"
 #include "parser.hpp"
+#include "vm.hpp"
+#include "kernels.hpp"
+#include "threadpool.hpp"
+#include "shadow.hpp"
+#include "interval.hpp"
+#include "integer.hpp"
+#include "boxed.hpp"
+#include "counted.hpp"
 
 #pragma once
 namespace Represent
 {	
 	namespace Detail
 	{
+		//Cells are moved off the stack, never copied.
 		template<typename T, typename Cell>
 		T popAs(std::vector<Cell>& stack)
 		{
-			Cell top = stack.back();
+			T top = std::move(boost::get<T>(stack.back()));
 			stack.pop_back();
 
-			return boost::get<T>(top);
+			return top;
 		}
 
 		template<typename Cell>
 		Cell pop(std::vector<Cell>& stack)
 		{
-			Cell top = stack.back();
+			Cell top = std::move(stack.back());
 			stack.pop_back();
 
 			return top;
 		}
+
+		//The top of the stack, to be changed in place.
+		template<typename T, typename Cell>
+		T& topAs(std::vector<Cell>& stack)
+		{
+			return boost::get<T>(stack.back());
+		}
+
+		//An observer of runOnStack that does nothing.
+		struct IgnoreResults
+		{
+			template<typename Cell>
+			void operator()(const Token&, const Cell&) const
+			{}
+		};
 	}
 
 	class EvaluationContext;
@@ -44,6 +72,15 @@ namespace Represent
 	template<typename Value, typename Cell>
 	void evaluateOperator(boost::uint32_t op, std::vector<Cell>& stack, EvaluationContext& ctx);
 
+	template<typename Value, typename Cell>
+	void evaluateBinary(boost::uint32_t op, Cell& a, const Cell& b);
+
+	template<typename Value, typename Cell>
+	void evaluateTypedBinary(boost::uint32_t op, boost::uint32_t types, Cell& a, const Cell& b);
+
+	template<typename Value, typename Cell>
+	void evaluateUnary(boost::uint32_t op, Cell& a);
+
 	struct Function
 	{
 		explicit Function(IFunctionImpl& impl);
@@ -64,23 +101,68 @@ namespace Represent
 		std::string name;
 	};
 
+	//A number literal too large for a TOKEN_RAW_VALUE. It keeps its digits, so that each
+	//precision can convert it directly instead of narrowing a Value.
+	struct Literal
+	{
+		std::string digits;
+		boost::uint32_t base;
+	};
+
 	//A storage cell with the Null type can be changed to any other type.
 	//This is the only type that this is possible on.
 	struct Null
 	{};
 
-	//TODO: Vector4<Value>, Matrix4<Value>, Quaternion<Value>, GUID
+	template<typename T>
+	struct Array;
+
+	//Scalars, vectors and quaternions are held inline. Matrices, arrays and strings are boxed, so
+	//that a cell is never much larger than a vector, however large T is. The alternatives are in
+	//the order of CELL_TYPES.
 	template<typename T>
 	struct Storage
 	{
-		typedef typename boost::make_recursive_variant<
-			T, Math::Vector4<T>, Math::Quaternion<T>, Math::Matrix4<T>, std::vector< boost::recursive_variant_ >, std::string, Function, Identifier, Null
-		>::type type;
+		typedef boost::variant<
+			T, Math::Vector4<T>, Math::Quaternion<T>, Boxed<Math::Matrix4<T> >, Boxed<Array<T> >, Boxed<std::string>, Function, Identifier, Null
+		> Variant;
+
+#ifdef REPRESENT_COUNT_COPIES
+		typedef CountedCell<Variant> type;
+#else
+		typedef Variant type;
+#endif
+	};
+
+	//The cells of an array, which is a type of its own so that a cell can hold one by Boxed.
+	template<typename T>
+	struct Array
+		: public std::vector<typename Storage<T>::type>
+	{
+		using std::vector<typename Storage<T>::type>::vector;
 	};
 
+	//Every number type an expression can be evaluated in. Each has its own typed storage in a 
+	//context, and its own invoke in IFunctionImpl.
+#define NUMBER_TYPES		\
+	(Value)					\
+	(double)				\
+	(float)					\
+	(Shadow)				\
+	(Interval<double>)		\
+	(Interval<Value>)		\
+	(Value50)				\
+	(Quad)					\
+	(long double)			\
+	(Integer)				\
+	FLOAT128_TYPES
+
 	typedef Storage<Value>::type StorageCell;
 	typedef Storage<float>::type StorageCellf;
 	typedef Storage<double>::type StorageCelld;
+	typedef Storage<Shadow>::type StorageCells;
+	typedef Storage<Interval<double> >::type StorageCelldi;
+	typedef Storage<Interval<Value> >::type StorageCellvi;
 
 	template<typename Cell, typename Backing>
 	struct StorageConvert
@@ -94,26 +176,39 @@ namespace Represent
 
 			template<typename U>
 			void operator()(const U& u)
+			{
+				assign(u, boost::integral_constant<bool, boost::multiprecision::is_number<U>::value>());
+			}
+
+			//Conversions between multiprecision numbers are explicit unless they are lossless.
+			template<typename U>
+			void assign(const U& u, boost::true_type)
+			{
+				*result = Backing(u);
+			}
+
+			template<typename U>
+			void assign(const U& u, boost::false_type)
 			{
 				*result = u;
 			}
 
 			template<typename U>
-			void operator()(const std::vector<U>& u)
+			void operator()(const Boxed<Array<U> >& u)
 			{}
 
 			void operator()(const Value& v)
 			{
-				*result = v.template convert_to<Backing>();
+				*result = narrow(v);
 			}
 
 			void operator()(const Math::Vector4<Value>& v)
 			{
 				Math::Vector4<Backing> t;
-				t[0] = v[0].template convert_to<Backing>();
-				t[1] = v[1].template convert_to<Backing>();
-				t[2] = v[2].template convert_to<Backing>();
-				t[3] = v[3].template convert_to<Backing>();
+				t[0] = narrow(v[0]);
+				t[1] = narrow(v[1]);
+				t[2] = narrow(v[2]);
+				t[3] = narrow(v[3]);
 
 				*result = t;
 			}
@@ -122,10 +217,10 @@ namespace Represent
 			void operator()(const Math::Vector4<U>& v)
 			{
 				Math::Vector4<Backing> t;
-				t[0] = v[0];
-				t[1] = v[1];
-				t[2] = v[2];
-				t[3] = v[3];
+				t[0] = Backing(v[0]);
+				t[1] = Backing(v[1]);
+				t[2] = Backing(v[2]);
+				t[3] = Backing(v[3]);
 
 				*result = t;
 			}
@@ -134,10 +229,10 @@ namespace Represent
 			{
 				Math::Quaternion<Backing> t;
 
-				t.w = v.w.template convert_to<Backing>();
-				t.x = v.x.template convert_to<Backing>();
-				t.y = v.y.template convert_to<Backing>();
-				t.z = v.z.template convert_to<Backing>();
+				t.w = narrow(v.w);
+				t.x = narrow(v.x);
+				t.y = narrow(v.y);
+				t.z = narrow(v.z);
 
 				*result = t;
 			}
@@ -147,21 +242,23 @@ namespace Represent
 			{
 				Math::Quaternion<Backing> t;
 
-				t.w = v.w;
-				t.x = v.x;
-				t.y = v.y;
-				t.z = v.z;
+				t.w = Backing(v.w);
+				t.x = Backing(v.x);
+				t.y = Backing(v.y);
+				t.z = Backing(v.z);
 
 				*result = t;
 			}
 
-			void operator()(const Math::Matrix4<Value>& v)
-			{}
-
 			template<typename U>
-			void operator()(const Math::Matrix4<U>& v)
+			void operator()(const Boxed<Math::Matrix4<U> >& v)
 			{}
 
+			static Backing narrow(const Value& v)
+			{
+				return convertValue(v, static_cast<Backing *>(NULL));
+			}
+
 			Cell * result;
 		};
 
@@ -178,16 +275,124 @@ namespace Represent
 	};
 
 	//Implements a function.
+	//A function takes its arity arguments from the top of the stack, and leaves its result in 
+	//their place. The arguments are its own, so it should move them off the stack with 
+	//Detail::pop, or change them in place, rather than copy them.
 	struct IFunctionImpl
 	{
-		virtual void invoke(std::vector<StorageCell>& stack, EvaluationContext& ctx, size_t arity) = 0;
-		virtual void invoke(std::vector<StorageCelld>& stack, EvaluationContext& ctx, size_t arity) = 0;
-		virtual void invoke(std::vector<StorageCellf>& stack, EvaluationContext& ctx, size_t arity) = 0;
+#define INVOKE_DECLARATION(r, data, T) \
+		virtual void invoke(std::vector<Storage<T>::type>& stack, EvaluationContext& ctx, size_t arity) = 0;
+
+		BOOST_PP_SEQ_FOR_EACH(INVOKE_DECLARATION, _, NUMBER_TYPES)
+
+		//A pure function leaves a single result that depends only on its arguments, so calls
+		//with constant arguments can be folded.
+		virtual bool pure() const
+		{
+			return false;
+		}
 	};
 
 
+	//A constant subtree of an expression, folded into an anonymous storage slot. Its RPN is kept
+	//so that each precision can fold it again instead of narrowing the Value.
+	struct Constant
+	{
+		boost::uint32_t slot;
+		TokenStream rpn;
+	};
+
+	//An expression compiled for evaluation: its RPN, with every identifier resolved to the storage
+	//slot that holds its value and constant subtrees folded, the slots the RPN reads, and the 
+	//bytecode compiled from it.
+	struct Program
+	{
+		TokenStream rpn;
+		std::vector<boost::uint32_t> slots;
+		std::vector<Constant> constants;
+		Bytecode bytecode;
+
+		//Nodes of the RPN that are computed by an identical subtree, folded or not.
+		boost::uint32_t deduplicated;
+	};
+
+	//The storage and literals of a context converted to one precision. Slots and literals are
+	//converted once, as they are first needed, and a slot again whenever it is redefined.
+	template<typename T>
+	struct TypedStorage
+	{
+		TypedStorage()
+			:folded(false)
+		{}
+
+		std::vector<typename Storage<T>::type> cells;
+		std::vector<T> literals;
+
+		//The register files, and the stack that function arguments are passed on. All are 
+		//reused by every evaluation in T.
+		std::vector<T> scalars;
+		std::vector<Math::Vector4<T> > vectors;
+		std::vector<typename Storage<T>::type> registers;
+		std::vector<typename Storage<T>::type> arguments;
+
+		//The scalar registers of a batch, each a run of BATCH_BLOCK rows.
+		std::vector<T> block;
+
+		//Whether the constants of the current program have been folded in T.
+		bool folded;
+	};
+
+	//One input of a batch: the values a free identifier takes, one per row.
+	template<typename T>
+	struct Column
+	{
+		std::string name;
+		const T * values;
+	};
+
+	//The number of rows a batch runs each instruction over at once.
+	const size_t BATCH_BLOCK = 256;
+
+	//The number of rows in each task of a parallel batch. Enough to make taking a task cheap, 
+	//and few enough to leave plenty to steal.
+	const size_t BATCH_TASK = 16 * BATCH_BLOCK;
+
+	//An operator or function call whose double or float result strayed from the full precision
+	//result, in units in the last place of that precision. The token's offset locates it in the
+	//source.
+	struct Divergence
+	{
+		Token token;
+		boost::uint64_t doubleUlps;
+		boost::uint64_t floatUlps;
+	};
+
+	//The result of an expression in Value, double and float from a single shadowed evaluation,
+	//with every divergence over the threshold in the order they were computed.
+	struct ShadowReport
+	{
+		StorageCell full;
+		StorageCell dbl;
+		StorageCell flt;
+		std::vector<Divergence> divergences;
+	};
+
+	//The result of an adaptive evaluation, and how much of the expression needed full precision.
+	struct AdaptiveResult
+	{
+		StorageCell value;
+
+		//The furthest the exact result can be from value. Within the tolerance unless even
+		//full precision could not show it, in which case proven is false.
+		Value bound;
+		bool proven;
+
+		//The operators and function calls evaluated again in full precision.
+		size_t escalated;
+	};
+
 	//Some utility functions that evaluation context uses.
-	TokenStream simplify(const TokenStream& stream, std::vector<StorageCell>& storage, boost::unordered_map<std::string, boost::uint32_t>& identifiers);
+	TokenStream simplify(const TokenStream& stream, std::vector<StorageCell>& storage, std::vector<Literal>& literals, boost::unordered_map<std::string, boost::uint32_t>& identifiers);
 	TokenStream shuntingYard(const TokenStream& stream);
 
 	class EvaluationContext
@@ -207,41 +412,609 @@ namespace Represent
 		template<typename T, typename Storage>
 		T evaluateAsWith()
 		{
-			TokenStream rpn = shuntingYard(stream);
-			return boost::get<T>(evaluateWith<Storage>(rpn));
+			return boost::get<T>(execute<Storage>(compiled()));
 		}
 
 		template<typename Storage>
 		StorageCell evaluateWith()
 		{
-			TokenStream rpn = shuntingYard(stream);
-			return evaluateWith<Storage>(rpn);
+			return execute<Storage>(compiled());
+		}
+
+		//Evaluates the RPN on a stack instead of running the bytecode.
+		template<typename Storage>
+		StorageCell evaluateOnStackWith()
+		{
+			return evaluateWith<Storage>(compiled());
+		}
+
+		//Leaves the result in T, without converting it back to Value.
+		template<typename T>
+		typename Storage<T>::type evaluateNative()
+		{
+			return std::move(run<T>(compiled()));
+		}
+
+		template<typename T>
+		typename Storage<T>::type evaluateNativeOnStack()
+		{
+			const Program& program = compiled();
+			prepared<T>(program);
+
+			return runOnStack<T>(program.rpn);
+		}
+
+		//Evaluates the loaded expression once, carrying Value, double and float side by side,
+		//and reports each operator or function call whose double or float result is more than
+		//ulps from the full precision one rounded to that precision. Constants are folded again
+		//on every call, so that the operators inside them are reported too.
+		ShadowReport evaluateShadow(boost::uint64_t ulps);
+
+		//Evaluates the loaded expression within tolerance of its exact result. It is evaluated in
+		//double intervals first, and only the operators whose intervals are wider than tolerance
+		//are evaluated again, in Value intervals, from the intervals of the narrow ones. If that
+		//is still too wide, the whole expression is evaluated in Value intervals.
+		AdaptiveResult evaluateAdaptive(const Value& tolerance);
+
+		//Evaluates the loaded expression in 64 bit integers, with the bit operators on native
+		//integers. If any literal, input or intermediate is not an integer, or does not fit, it
+		//is evaluated in Value instead.
+		StorageCell evaluateInteger();
+
+		//Evaluates the loaded expression once for each of rows rows, with each input identifier 
+		//taking its value from its column, and writes the results to output. Inputs that are
+		//not yet defined are defined as scalars. The expression must evaluate to a scalar.
+		template<typename T>
+		void evaluateBatch(const std::vector<Column<T> >& inputs, T * output, size_t rows)
+		{
+			std::vector<boost::uint32_t> slots = batchSlots(inputs);
+
+			const Program& program = batchProgram();
+			TypedStorage<T>& typed = prepared<T>(program);
+
+			//Rows that are run one at a time write their inputs over the defined values, which 
+			//are put back even if a row throws.
+			auto restore = [&]()
+			{
+				for (size_t i = 0; i < slots.size(); ++i)
+				{
+					refresh<T>(slots[i]);
+				}
+			};
+
+			try
+			{
+				runBatch(program, typed, batchColumns(typed, inputs, slots), inputs, slots, output, 0, rows);
+			}
+			catch (...)
+			{
+				restore();
+				throw;
+			}
+
+			restore();
+		}
+
+		//Evaluates a batch with its blocks of rows spread over the threads of pool. Every worker
+		//shares the compiled program, and runs it with its own copy of the typed storage, so 
+		//functions that are called must not change the context.
+		template<typename T>
+		void evaluateBatch(const std::vector<Column<T> >& inputs, T * output, size_t rows, ThreadPool& pool)
+		{
+			std::vector<boost::uint32_t> slots = batchSlots(inputs);
+
+			const Program& program = batchProgram();
+			const TypedStorage<T>& typed = prepared<T>(program);
+			const std::vector<const T *> columns = batchColumns(typed, inputs, slots);
+
+			std::vector<TypedStorage<T> > scratch(pool.size(), typed);
+			pool.run((rows + BATCH_TASK - 1) / BATCH_TASK, [&](size_t task, size_t worker)
+			{
+				size_t first = task * BATCH_TASK;
+				runBatch(program, scratch[worker], columns, inputs, slots, output, first, std::min(rows, first + BATCH_TASK));
+			});
 		}
 
 		void define(const std::string&, const StorageCell& storage);
 		void dumpState();
 
+		//Compiles the loaded expression. Until the next load() or define(), evaluations in 
+		//different precisions can then run concurrently, since each only touches its own 
+		//typed storage.
+		void prepare();
+
+		//The number of nodes of the loaded expression that repeat another subtree, and are
+		//not computed again.
+		size_t deduplicated();
+
 		//Looks in storage for a value.
 		StorageCell& lookup(StorageCell& storage);
 	private:
 		Function * functionLookup(const std::string& name);
 
-		//Evaluates an expression with T instead of Value to store intermediates.
-		//This allows one to determine accuracy loss between computations.
+		//The program for the loaded expression, compiled on first use after a load() or a
+		//define() that changed the type of a slot or a function.
+		const Program& compiled();
+
+		//The slot holding the value that slot names, through links. Throws if it names nothing.
+		boost::uint32_t resolve(boost::uint32_t slot);
+
+		//Links every slot to the slot of the value it names. Names are only looked up here, 
+		//after a load() or a define() that adds a name or changes an alias.
+		void link();
+
+		//The type of every storage slot, and whether it holds a pure function.
+		std::vector<SlotInfo> slotInfo() const;
+
+		//The slot of a batch input, defining it as a scalar if it is not defined yet.
+		boost::uint32_t batchSlot(const std::string& name);
+
+		//The compiled program, which must leave a scalar, or a function result that may be one.
+		const Program& batchProgram();
+
 		template<typename T>
-		StorageCell evaluateWith(const TokenStream& rpn)
+		std::vector<boost::uint32_t> batchSlots(const std::vector<Column<T> >& inputs)
 		{
-			using namespace Detail;
+			std::vector<boost::uint32_t> slots;
+			for (auto it = inputs.begin(); it != inputs.end(); ++it)
+			{
+				slots.push_back(batchSlot(it->name));
+			}
+
+			return slots;
+		}
+
+		//The column each slot reads in a batch, or NULL if it is the same for every row.
+		template<typename T>
+		std::vector<const T *> batchColumns(const TypedStorage<T>& typed, const std::vector<Column<T> >& inputs, const std::vector<boost::uint32_t>& slots)
+		{
+			std::vector<const T *> columns(typed.cells.size(), static_cast<const T *>(NULL));
+			for (size_t i = 0; i < inputs.size(); ++i)
+			{
+				columns[slots[i]] = inputs[i].values;
+			}
+
+			return columns;
+		}
+
+		//Evaluates the rows of a batch from first to end with typed, which the rows that cannot
+		//be run a block at a time write their inputs to.
+		template<typename T>
+		void runBatch(const Program& program, TypedStorage<T>& typed, const std::vector<const T *>& columns, 
+			const std::vector<Column<T> >& inputs, const std::vector<boost::uint32_t>& slots, T * output, size_t first, size_t end)
+		{
+			if (program.bytecode.scalarOnly)
+			{
+				for (size_t block = first; block < end; block += BATCH_BLOCK)
+				{
+					size_t count = std::min(BATCH_BLOCK, end - block);
+					runBlock<T>(program.bytecode, typed, columns, block, count);
+					std::copy(typed.block.begin(), typed.block.begin() + count, output + block);
+				}
+
+				return;
+			}
+
+			//Cells cannot be run a block at a time, but the rows still share the compiled program.
+			for (size_t row = first; row < end; ++row)
+			{
+				for (size_t i = 0; i < inputs.size(); ++i)
+				{
+					typed.cells[slots[i]] = inputs[i].values[row];
+				}
+
+				output[row] = boost::get<T>(run<T>(program.bytecode, typed));
+			}
+		}
+
+		//A copy of rpn with every largest subtree whose double interval is no wider than tolerance
+		//replaced by a reference to the interval, which is appended to reused. escalated is set to
+		//the operators and function calls that are left.
+		TokenStream escalate(const TokenStream& rpn, const std::vector<StorageCelldi>& intervals, const Value& tolerance, 
+			std::vector<Interval<Value> >& reused, size_t& escalated);
+
+		//Replaces the largest constant subtrees of resolved RPN with references to the slots 
+		//they are folded into, reusing the slots of the previous program's constants. Identical
+		//literals, strings and constant subtrees are given the same reference.
+		TokenStream fold(const TokenStream& rpn, std::vector<Constant>& previous);
+
+#define TYPED_STORAGE_ACCESSOR(r, data, index, T) \
+		TypedStorage<T>& typed(T *) { return BOOST_PP_CAT(precisionStorage, index); }
+
+		BOOST_PP_SEQ_FOR_EACH_I(TYPED_STORAGE_ACCESSOR, _, NUMBER_TYPES)
+
+		//The storage converted to T, with anything loaded since the last call converted.
+		template<typename T>
+		TypedStorage<T>& typedStorage()
+		{
+			typedef typename Storage<T>::type Cell;
+			TypedStorage<T>& result = typed(static_cast<T *>(NULL));
+
+			while (result.cells.size() < storage.size())
+			{
+				result.cells.push_back(StorageConvert<Cell, T>::convert(storage[result.cells.size()]));
+			}
+
+			while (result.literals.size() < literals.size())
+			{
+				const Literal& literal = literals[result.literals.size()];
+				result.literals.push_back(convertAs<T>(literal.digits, literal.base));
+			}
+
+			return result;
+		}
+
+		//The storage converted to T, with the constants of program folded in T.
+		template<typename T>
+		TypedStorage<T>& prepared(const Program& program)
+		{
+			TypedStorage<T>& result = typedStorage<T>();
+			if (!result.folded)
+			{
+				for (auto it = program.constants.begin(); it != program.constants.end(); ++it)
+				{
+					result.cells[it->slot] = runOnStack<T>(it->rpn);
+				}
+
+				result.folded = true;
+			}
+
+			return result;
+		}
+
+		//Reconverts a redefined slot in T, if it has been converted before.
+		template<typename T>
+		void refresh(boost::uint32_t slot)
+		{
+			typedef typename Storage<T>::type Cell;
+			TypedStorage<T>& result = typed(static_cast<T *>(NULL));
+
+			if (slot < result.cells.size())
+			{
+				result.cells[slot] = StorageConvert<Cell, T>::convert(storage[slot]);
+			}
+		}
+
+		//Runs the bytecode of a program with T instead of Value to store intermediates.
+		template<typename T>
+		StorageCell execute(const Program& program)
+		{
+			return StorageConvert<StorageCell, Value>::convert(run<T>(program));
+		}
+
+		template<typename T>
+		typename Storage<T>::type& run(const Program& program)
+		{
+			return run<T>(program.bytecode, prepared<T>(program));
+		}
 
+		//Runs bytecode with the storage and registers of typed, which need not be this 
+		//context's own. The result is left in a register, which the caller may move from.
+		template<typename T>
+		typename Storage<T>::type& run(const Bytecode& bytecode, TypedStorage<T>& typed)
+		{
 			typedef typename Storage<T>::type Cell;
-			std::vector<Cell> typedStorage;
-			typedStorage.reserve(storage.size());
+			assert(bytecode.registers > 0);
+
+			std::vector<T>& scalars = typed.scalars;
+			std::vector<Math::Vector4<T> >& vectors = typed.vectors;
+			std::vector<Cell>& registers = typed.registers;
+			if (registers.size() < bytecode.registers)
+			{
+				scalars.resize(bytecode.registers);
+				vectors.resize(bytecode.registers);
+				registers.resize(bytecode.registers);
+			}
+
+			for (auto it = bytecode.code.begin(); it != bytecode.code.end(); ++it)
+			{
+				switch (it->type)
+				{
+				case INSTRUCTION_LOAD_RAW:
+					scalars[it->target] = T(it->source);
+					break;
+
+				case INSTRUCTION_LOAD_LITERAL:
+					scalars[it->target] = typed.literals[it->source];
+					break;
+
+				case INSTRUCTION_LOAD_SCALAR:
+					scalars[it->target] = boost::get<T>(typed.cells[it->source]);
+					break;
+
+				case INSTRUCTION_LOAD_VECTOR:
+					vectors[it->target] = boost::get<Math::Vector4<T> >(typed.cells[it->source]);
+					break;
+
+				case INSTRUCTION_LOAD_STORAGE:
+					registers[it->target] = Detail::copy(typed.cells[it->source]);
+					break;
+
+				case INSTRUCTION_SCALAR_BINARY:
+					{
+						T& a = scalars[it->target];
+						const T& b = scalars[it->source];
+						switch (it->op)
+						{
+						case OPERATOR_PLUS: a += b; break;
+						case OPERATOR_MINUS: a -= b; break;
+						case OPERATOR_MULTIPLY: a *= b; break;
+						case OPERATOR_DIVIDE: a /= b; break;
+						default: bitwise(it->op, a, b); break;
+						}
+						break;
+					}
+
+				case INSTRUCTION_SCALAR_UNARY:
+					if (it->op == OPERATOR_UNARY_MINUS)
+					{
+						scalars[it->target] = -scalars[it->target];
+					}
+					else if (it->op == OPERATOR_NOT)
+					{
+						complement(scalars[it->target]);
+					}
+					break;
+
+				case INSTRUCTION_VECTOR_BINARY:
+					{
+						Math::Vector4<T>& a = vectors[it->target];
+						if (it->count == SHAPE_SCALAR_VECTOR)
+						{
+							//Only multiplication takes a scalar first, and it commutes.
+							a = vectors[it->source];
+							a *= scalars[it->target];
+						}
+						else if (it->count == SHAPE_VECTOR_SCALAR)
+						{
+							const T& b = scalars[it->source];
+							switch (it->op)
+							{
+							case OPERATOR_PLUS: a += b; break;
+							case OPERATOR_MINUS: a -= b; break;
+							case OPERATOR_MULTIPLY: a *= b; break;
+							case OPERATOR_DIVIDE: a /= b; break;
+							}
+						}
+						else
+						{
+							const Math::Vector4<T>& b = vectors[it->source];
+							switch (it->op)
+							{
+							case OPERATOR_PLUS: a += b; break;
+							case OPERATOR_MINUS: a -= b; break;
+							}
+						}
+						break;
+					}
+
+				case INSTRUCTION_TYPED_BINARY:
+					evaluateTypedBinary<T>(it->op, it->count, registers[it->target], registers[it->source]);
+					break;
+
+				case INSTRUCTION_BINARY:
+					evaluateBinary<T>(it->op, registers[it->target], registers[it->source]);
+					break;
+
+				case INSTRUCTION_UNARY:
+					evaluateUnary<T>(it->op, registers[it->target]);
+					break;
+
+				case INSTRUCTION_BOX:
+					registers[it->target] = scalars[it->target];
+					break;
+
+				case INSTRUCTION_UNBOX:
+					scalars[it->target] = boost::get<T>(registers[it->target]);
+					break;
+
+				case INSTRUCTION_BOX_VECTOR:
+					registers[it->target] = vectors[it->target];
+					break;
+
+				case INSTRUCTION_UNBOX_VECTOR:
+					vectors[it->target] = boost::get<Math::Vector4<T> >(registers[it->target]);
+					break;
+
+				case INSTRUCTION_VECTOR:
+					{
+						const T * r = &scalars[it->target];
+						vectors[it->target] = Math::Vector4<T>(r[0], r[1], r[2], r[3]);
+						break;
+					}
+
+				case INSTRUCTION_QUATERNION:
+					{
+						const T * r = &scalars[it->target];
+
+						Math::Quaternion<T> quat;
+						quat.w = r[0];
+						quat.x = r[1];
+						quat.y = r[2];
+						quat.z = r[3];
+
+						registers[it->target] = quat;
+						break;
+					}
+
+				case INSTRUCTION_MATRIX:
+					{
+						const Math::Vector4<T> * r = &vectors[it->target];
+
+						Math::Matrix4<T> mat;
+						for (size_t row = 0; row < 4; ++row)
+						{
+							const Math::Vector4<T>& v = r[row];
+							mat(row, 0) = v[0]; mat(row, 1) = v[1]; mat(row, 2) = v[2]; mat(row, 3) = v[3];
+						}
+
+						registers[it->target] = mat;
+						break;
+					}
+
+				case INSTRUCTION_ARRAY:
+					{
+						Cell * r = &registers[it->target];
+						int typeValue = r[0].which();
+
+						Array<T> result(std::make_move_iterator(r), std::make_move_iterator(r + it->count));
+						for (size_t i = 0; i < result.size(); ++i)
+						{
+							if (result[i].which() != typeValue)
+							{
+								throw "Types in the vector not the same!";
+							}
+						}
+
+						registers[it->target] = std::move(result);
+						break;
+					}
+
+				case INSTRUCTION_CALL:
+					{
+						Function * function = boost::get<Function>(&storage[it->source]);
+						assert(function);
+
+						std::vector<Cell>& arguments = typed.arguments;
+						arguments.assign(std::make_move_iterator(registers.begin() + it->target), 
+							std::make_move_iterator(registers.begin() + it->target + it->count));
+
+						function->invoke(arguments, *this, it->count);
+						if (arguments.size() != 1)
+						{
+							throw "Functions must leave exactly one result";
+						}
+
+						registers[it->target] = std::move(arguments.back());
+						break;
+					}
+
+				case INSTRUCTION_COPY_SCALAR:
+					scalars[it->target] = scalars[it->source];
+					break;
+
+				case INSTRUCTION_COPY_VECTOR:
+					vectors[it->target] = vectors[it->source];
+					break;
+
+				case INSTRUCTION_COPY:
+					registers[it->target] = Detail::copy(registers[it->source]);
+					break;
+				}
+			}
+
+			if (bytecode.scalarResult)
+			{
+				registers[0] = scalars[0];
+			}
+
+			return registers[0];
+		}
 
-			for (size_t i = 0; i < typedStorage.size(); ++i)
+		//Runs scalar only bytecode over count rows from first, leaving the results at the start 
+		//of the block. Slots with a column read it, all others are the same for every row.
+		template<typename T>
+		void runBlock(const Bytecode& bytecode, TypedStorage<T>& typed, const std::vector<const T *>& columns, size_t first, size_t count)
+		{
+			std::vector<T>& block = typed.block;
+			if (block.size() < bytecode.registers * BATCH_BLOCK)
 			{
-				typedStorage.push_back(StorageConvert<Cell, T>::convert(storage[i]));
+				block.resize(bytecode.registers * BATCH_BLOCK);
 			}
 
+			for (auto it = bytecode.code.begin(); it != bytecode.code.end(); ++it)
+			{
+				T * target = &block[it->target * BATCH_BLOCK];
+
+				switch (it->type)
+				{
+				case INSTRUCTION_LOAD_RAW:
+					std::fill(target, target + count, T(it->source));
+					break;
+
+				case INSTRUCTION_LOAD_LITERAL:
+					std::fill(target, target + count, typed.literals[it->source]);
+					break;
+
+				case INSTRUCTION_LOAD_SCALAR:
+					if (columns[it->source])
+					{
+						std::copy(columns[it->source] + first, columns[it->source] + first + count, target);
+					}
+					else
+					{
+						std::fill(target, target + count, boost::get<T>(typed.cells[it->source]));
+					}
+					break;
+
+				case INSTRUCTION_SCALAR_BINARY:
+					if (bitOperator(it->op))
+					{
+						const T * source = &block[it->source * BATCH_BLOCK];
+						for (size_t r = 0; r < count; ++r)
+						{
+							bitwise(it->op, target[r], source[r]);
+						}
+					}
+					else
+					{
+						binaryKernel(it->op, target, &block[it->source * BATCH_BLOCK], count);
+					}
+					break;
+
+				case INSTRUCTION_SCALAR_UNARY:
+					if (it->op == OPERATOR_UNARY_MINUS)
+					{
+						for (size_t r = 0; r < count; ++r)
+						{
+							target[r] = -target[r];
+						}
+					}
+					else if (it->op == OPERATOR_NOT)
+					{
+						for (size_t r = 0; r < count; ++r)
+						{
+							complement(target[r]);
+						}
+					}
+					break;
+
+				case INSTRUCTION_COPY_SCALAR:
+					{
+						const T * source = &block[it->source * BATCH_BLOCK];
+						std::copy(source, source + count, target);
+						break;
+					}
+				}
+			}
+		}
+
+		//Evaluates an expression with T instead of Value to store intermediates.
+		//This allows one to determine accuracy loss between computations.
+		template<typename T>
+		StorageCell evaluateWith(const Program& program)
+		{
+			prepared<T>(program);
+			return StorageConvert<StorageCell, Value>::convert(runOnStack<T>(program.rpn));
+		}
+
+		template<typename T>
+		typename Storage<T>::type runOnStack(const TokenStream& rpn)
+		{
+			Detail::IgnoreResults ignore;
+			return runOnStack<T>(rpn, ignore);
+		}
+
+		//Runs the RPN on a stack, showing observe each token that computes something along with
+		//the cell it leaves on top of the stack.
+		template<typename T, typename Observer>
+		typename Storage<T>::type runOnStack(const TokenStream& rpn, Observer& observe)
+		{
+			using namespace Detail;
+
+			typedef typename Storage<T>::type Cell;
+			TypedStorage<T>& typed = typedStorage<T>();
+
 			//Setup predefined functions.
 			std::vector<Cell> stack;
 
@@ -252,25 +1025,35 @@ namespace Represent
 				{
 				case TOKEN_RAW_VALUE:
 					{
-						stack.push_back(StorageConvert<Cell, T>::convert(Cell(it->value)));
+						stack.push_back(T(it->value));
 						break;
 					}
 				case TOKEN_STORAGE_REFERENCE:
 					{
-						stack.push_back(StorageConvert<Cell, T>::convert(lookup(storage.at(it->value))));
+						stack.push_back(Detail::copy(typed.cells[it->value]));
+						break;
+					}
+				case TOKEN_LITERAL_REFERENCE:
+					{
+						stack.push_back(typed.literals[it->value]);
 						break;
 					}
 				case TOKEN_OPERATOR:
 					{
 						evaluateOperator<T>(it->value, stack, *this);
+						observe(*it, stack.back());
 						break;
 					}
 				case TOKEN_FUNCTION_IDENTIFIER:
 					{
-						Function * target = boost::get<Function>(&lookup(storage.at(it->value)));
+						Function * target = boost::get<Function>(&storage[it->value]);
 						assert(target);
 
 						target->invoke(stack, *this, it->extra);
+						if (!stack.empty())
+						{
+							observe(*it, stack.back());
+						}
 						break;
 					}
 				case TOKEN_VECTOR:
@@ -314,22 +1097,20 @@ namespace Represent
 				case TOKEN_ARRAY:
 					{
 						boost::uint32_t count = it->value;
-						int typeValue = stack.back().which();
+						auto first = stack.end() - count;
+						int typeValue = count ? first->which() : 0;
 
-						std::vector<Cell> result;
-						for (size_t i = 0; i < count; ++i)
+						for (auto cell = first; cell != stack.end(); ++cell)
 						{
-							result.push_back(stack.back());
-							if (result.back().which() != typeValue)
+							if (cell->which() != typeValue)
 							{
 								throw "Types in the vector not the same!";
 							}
-
-							stack.pop_back();
 						}
 
-						std::reverse(result.begin(), result.end());
-						stack.push_back(result);
+						Array<T> result(std::make_move_iterator(first), std::make_move_iterator(stack.end()));
+						stack.erase(first, stack.end());
+						stack.push_back(Boxed<Array<T> >(std::move(result)));
 						break;
 					}
 				default:
@@ -341,16 +1122,33 @@ namespace Represent
 			}
 
 			assert(stack.size() == 1);
-			return StorageConvert<StorageCell, Value>::convert(stack.back());
+			return std::move(stack.back());
 		}
 
 		std::vector<StorageCell> storage;
+		std::vector<Literal> literals;
 		boost::unordered_map<std::string, boost::uint32_t> identifiers;
 		TokenStream stream;
+
+		//The slot each slot resolves to, following any chain of Identifiers, or UNLINKED if one 
+		//names nothing. Slots past the end hold no Identifier, and resolve to themselves.
+		std::vector<boost::uint32_t> links;
+
+		Program program;
+		bool programDirty;
+
+#define TYPED_STORAGE_MEMBER(r, data, index, T) \
+		TypedStorage<T> BOOST_PP_CAT(precisionStorage, index);
+
+		BOOST_PP_SEQ_FOR_EACH_I(TYPED_STORAGE_MEMBER, _, NUMBER_TYPES)
 	};
 
 	StorageCell evaluate(const std::string& text);
 
+	//Evaluates each expression in its own context, spread over the threads of pool, with the
+	//results in the order of the expressions.
+	std::vector<StorageCell> evaluateAll(const std::vector<std::string>& texts, ThreadPool& pool);
+
 	template<typename T>
 	T evaluateAs(const std::string& text)
 	{
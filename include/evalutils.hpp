@@ -1,4 +1,15 @@
+#include <boost/mpl/at.hpp>
+#include <boost/mpl/begin_end.hpp>
+#include <boost/mpl/distance.hpp>
+#include <boost/mpl/find.hpp>
+#include <boost/mpl/size.hpp>
+#include <boost/preprocessor/repetition/enum.hpp>
+#include <boost/preprocessor/tuple/elem.hpp>
+#include <boost/static_assert.hpp>
+#include <utility>
+
 #include "eval.hpp"
+#include "tables.hpp"
 
 #pragma once
 namespace Represent
@@ -12,17 +23,17 @@ namespace Represent
 		}
 
 		template<typename T>
-		void operator()(const std::vector<T>& t) const
+		void operator()(const Boxed<Array<T> >& t) const
 		{
 			std::cout << "[";
-			for (size_t i = 0; i < t.size(); ++i)
+			for (size_t i = 0; i < t->size(); ++i)
 			{
 				if (i)
 				{
 					std::cout << ", ";
 				}
 
-				boost::apply_visitor(*this, t[i]);
+				boost::apply_visitor(*this, (*t)[i]);
 			}
 		}
 
@@ -33,171 +44,216 @@ namespace Represent
 
 	namespace Detail
 	{
+		template<boost::uint32_t Op>
+		struct OperatorTag
+		{};
+
+		//Every binary operator on cells, with one overload for each operator and pair of types it
+		//takes, which returns the type of its result. The overloads only match exactly: any other
+		//pair picks the deleted template, and so has no entry in the dispatch table.
 		template<typename Value, typename Cell>
-		struct AddVisitor
-			: public boost::static_visitor<Cell> 
+		struct Operations
 		{
+			template<boost::uint32_t Op, typename A, typename B>
+			static Cell apply(OperatorTag<Op>, const A&, const B&) = delete;
 
-			template<typename T, typename U>
-			Cell operator()(const T& t, const U& u) const
-			{
-				std::cout << "Invalid arguments to +: " << typeid(t).name() << " and " << typeid(u).name() << "\n";
-				return Null();
-			}
+			static Value apply(OperatorTag<OPERATOR_PLUS>, const Value& a, const Value& b) { return Value(a + b); }
+			static Math::Vector4<Value> apply(OperatorTag<OPERATOR_PLUS>, const Math::Vector4<Value>& a, const Value& b) { return a + b; }
+			static Math::Vector4<Value> apply(OperatorTag<OPERATOR_PLUS>, const Math::Vector4<Value>& a, const Math::Vector4<Value>& b) { return a + b; }
+			static Boxed<std::string> apply(OperatorTag<OPERATOR_PLUS>, const Boxed<std::string>& a, const Boxed<std::string>& b) { return *a + *b; }
 
-			Cell operator()(const Value& a, const Value& b) const
-			{
-				return Value(a + b);
-			}
+			static Value apply(OperatorTag<OPERATOR_MINUS>, const Value& a, const Value& b) { return Value(a - b); }
+			static Math::Vector4<Value> apply(OperatorTag<OPERATOR_MINUS>, const Math::Vector4<Value>& a, const Value& b) { return a - b; }
+			static Math::Vector4<Value> apply(OperatorTag<OPERATOR_MINUS>, const Math::Vector4<Value>& a, const Math::Vector4<Value>& b) { return a - b; }
 
-			Cell operator()(const Math::Vector4<Value>& a, const Value& b) const
-			{
-				return a + b;
-			}
+			static Value apply(OperatorTag<OPERATOR_MULTIPLY>, const Value& a, const Value& b) { return Value(a * b); }
+			static Math::Vector4<Value> apply(OperatorTag<OPERATOR_MULTIPLY>, const Math::Vector4<Value>& a, const Value& b) { return a * b; }
+			static Math::Vector4<Value> apply(OperatorTag<OPERATOR_MULTIPLY>, const Value& b, const Math::Vector4<Value>& a) { return a * b; }
 
-			Cell operator()(const Math::Vector4<Value>& a, const Math::Vector4<Value>& b) const
-			{
-				return a + b;
-			}
+			static Value apply(OperatorTag<OPERATOR_DIVIDE>, const Value& a, const Value& b) { return Value(a / b); }
+			static Math::Vector4<Value> apply(OperatorTag<OPERATOR_DIVIDE>, const Math::Vector4<Value>& a, const Value& b) { return a / b; }
 
-			Cell operator()(const std::string& a, const std::string& b) const
+			//The bit operators only take scalars.
+			template<boost::uint32_t Op>
+			static typename boost::enable_if_c<Op >= OPERATOR_SHIFT_LEFT && Op <= OPERATOR_OR, Value>::type 
+				apply(OperatorTag<Op>, const Value& a, const Value& b)
 			{
-				return a + b;
+				Value result = a;
+				bitwise(Op, result, b);
+				return result;
 			}
 		};
 
-		template<typename Value, typename Cell>
-		struct SubVisitor
-			: public boost::static_visitor<Cell>
+		//Whether Operations has an overload for Op on an A and a B.
+		template<typename Value, typename Cell, boost::uint32_t Op, typename A, typename B>
+		struct HasOperation
 		{
-			template<typename T, typename U>
-			Cell operator()(const T& t, const U& u) const
-			{
-				std::cout << "Invalid arguments to -: " << typeid(t).name() << " and " << typeid(u).name() << "\n";
-				return Null();
-			}
+			template<typename O>
+			static char test(decltype(O::apply(OperatorTag<Op>(), std::declval<const A&>(), std::declval<const B&>())) *);
 
-			Cell operator()(const Value& a, const Value& b) const
-			{
-				return Value(a - b);
-			}
+			template<typename O>
+			static long test(...);
+
+			static const bool value = sizeof(test<Operations<Value, Cell> >(0)) == 1;
+		};
 
-			Cell operator()(const Math::Vector4<Value>& a, const Value& b) const
+		//a = a op b, for cells whose types are already known to be the Lhs'th and Rhs'th.
+		template<typename Cell>
+		struct BinaryFunction
+		{
+			typedef void (*type)(Cell& a, const Cell& b);
+		};
+
+		template<typename Value, typename Cell, boost::uint32_t Op, int Lhs, int Rhs, 
+			bool = HasOperation<Value, Cell, Op, typename boost::mpl::at_c<typename Cell::types, Lhs>::type, 
+				typename boost::mpl::at_c<typename Cell::types, Rhs>::type>::value>
+		struct BinaryEntry
+		{
+			static constexpr typename BinaryFunction<Cell>::type function()
 			{
-				return a - b;
+				return NULL;
 			}
 
-			Cell operator()(const Math::Vector4<Value>& a, const Math::Vector4<Value>& b) const
+			static constexpr CellType type()
 			{
-				return a - b;
+				return CELL_INVALID;
 			}
 		};
 
-		template<typename Value, typename Cell>
-		struct MulVisitor
-			: public boost::static_visitor<Cell>
+		template<typename Value, typename Cell, boost::uint32_t Op, int Lhs, int Rhs>
+		struct BinaryEntry<Value, Cell, Op, Lhs, Rhs, true>
 		{
-				template<typename T, typename U>
-			Cell operator()(const T& t, const U& u) const
-			{
-				std::cout << "Invalid arguments to *: " << typeid(t).name() << " and " << typeid(u).name() << "\n";
-				return Null();
-			}
+			typedef typename boost::mpl::at_c<typename Cell::types, Lhs>::type A;
+			typedef typename boost::mpl::at_c<typename Cell::types, Rhs>::type B;
+			typedef decltype(Operations<Value, Cell>::apply(OperatorTag<Op>(), std::declval<const A&>(), std::declval<const B&>())) Result;
 
-			Cell operator()(const Value& a, const Value& b) const
+			static void apply(Cell& a, const Cell& b)
 			{
-				return Value(a * b);
+				a = Operations<Value, Cell>::apply(OperatorTag<Op>(), *boost::get<A>(&a), *boost::get<B>(&b));
 			}
 
-			Cell operator()(const Math::Vector4<Value>& a, const Value& b) const
+			static constexpr typename BinaryFunction<Cell>::type function()
 			{
-				return a * b;
+				return &apply;
 			}
 
-			Cell operator()(const Value& b, const Math::Vector4<Value>& a) const
+			static constexpr CellType type()
 			{
-				return a * b;
+				typedef typename Cell::types Types;
+				return static_cast<CellType>(boost::mpl::distance<typename boost::mpl::begin<Types>::type, 
+					typename boost::mpl::find<Types, Result>::type>::value);
 			}
 		};
 
+		//table[op][a.which()][b.which()] is a = a op b, or NULL if op does not take those types,
+		//and types[op][a.which()][b.which()] is the type of the result, or CELL_INVALID.
 		template<typename Value, typename Cell>
-		struct DivVisitor
-			: public boost::static_visitor<Cell>
+		struct BinaryTable
 		{
-			template<typename T, typename U>
-			Cell operator()(const T& t, const U& u) const
-			{
-				std::cout << "Invalid arguments to /: " << typeid(t).name() << " and " << typeid(u).name() << "\n";
-				return Null();
-			}
+			BOOST_STATIC_ASSERT(boost::mpl::size<typename Cell::types>::value == CELL_TYPE_COUNT);
 
-			Cell operator()(const Value& a, const Value& b) const
-			{
-				return Value(a / b);
-			}
+			static const typename BinaryFunction<Cell>::type table[OPERATOR_COUNT][CELL_TYPE_COUNT][CELL_TYPE_COUNT];
+			static const CellType types[OPERATOR_COUNT][CELL_TYPE_COUNT][CELL_TYPE_COUNT];
+		};
 
-			Cell operator()(const Math::Vector4<Value>& a, const Value& b) const
-			{
-				return a / b;
-			}
+#define BINARY_ENTRY(z, rhs, data) \
+		BinaryEntry<Value, Cell, BOOST_PP_TUPLE_ELEM(3, 0, data), BOOST_PP_TUPLE_ELEM(3, 1, data), rhs>::BOOST_PP_TUPLE_ELEM(3, 2, data)()
+
+#define BINARY_ROW(z, lhs, data) \
+		{ BOOST_PP_ENUM(CELL_TYPE_COUNT, BINARY_ENTRY, (BOOST_PP_TUPLE_ELEM(2, 0, data), lhs, BOOST_PP_TUPLE_ELEM(2, 1, data))) }
+
+#define BINARY_OPERATOR(r, member, op) \
+		{ BOOST_PP_ENUM(CELL_TYPE_COUNT, BINARY_ROW, (op, member)) },
+
+		template<typename Value, typename Cell>
+		const typename BinaryFunction<Cell>::type BinaryTable<Value, Cell>::table[OPERATOR_COUNT][CELL_TYPE_COUNT][CELL_TYPE_COUNT] = 
+		{
+			BOOST_PP_SEQ_FOR_EACH(BINARY_OPERATOR, function, OPERATOR_TYPES)
+		};
+
+		template<typename Value, typename Cell>
+		const CellType BinaryTable<Value, Cell>::types[OPERATOR_COUNT][CELL_TYPE_COUNT][CELL_TYPE_COUNT] = 
+		{
+			BOOST_PP_SEQ_FOR_EACH(BINARY_OPERATOR, type, OPERATOR_TYPES)
 		};
+
+		//Rejects a table miss, which is kept out of line so that the dispatch stays small.
+		void invalidArguments(boost::uint32_t op, int a, int b);
 	}
 
+	//a = a op b, in place. Scalars are handled without going through the table.
 	template<typename Value, typename Cell>
-	void evaluateOperator(boost::uint32_t op, std::vector<Cell>& stack, EvaluationContext& ctx)
+	void evaluateBinary(boost::uint32_t op, Cell& a, const Cell& b)
 	{
-		switch(op)
+		Value * x = boost::get<Value>(&a);
+		const Value * y = boost::get<Value>(&b);
+
+		if (x && y)
 		{
-		case OPERATOR_PLUS: 
+			switch(op)
 			{
-				Cell b = Detail::pop(stack);
-				Cell a = Detail::pop(stack);
-
-				Cell result = boost::apply_visitor(Detail::AddVisitor<Value, Cell>(), a, b);
-				stack.push_back(result);
-				break;
+			case OPERATOR_PLUS: *x += *y; return;
+			case OPERATOR_MINUS: *x -= *y; return;
+			case OPERATOR_MULTIPLY: *x *= *y; return;
+			case OPERATOR_DIVIDE: *x /= *y; return;
 			}
 
-		case OPERATOR_MINUS:
+			if (bitOperator(op))
 			{
-				Cell b = Detail::pop(stack);
-				Cell a = Detail::pop(stack);
-
-				Cell result = boost::apply_visitor(Detail::SubVisitor<Value, Cell>(), a, b);
-				stack.push_back(result);
-				break;
+				bitwise(op, *x, *y);
+				return;
 			}
-		case OPERATOR_MULTIPLY:
-			{
-				Cell b = Detail::pop(stack);
-				Cell a = Detail::pop(stack);
+		}
 
-				Cell result = boost::apply_visitor(Detail::MulVisitor<Value, Cell>(), a, b);
-				stack.push_back(result);
-				break;
-			}
+		typename Detail::BinaryFunction<Cell>::type function = Detail::BinaryTable<Value, Cell>::table[op][a.which()][b.which()];
+		if (function)
+		{
+			function(a, b);
+		}
+		else
+		{
+			Detail::invalidArguments(op, a.which(), b.which());
+		}
+	}
 
-		case OPERATOR_DIVIDE:
-			{
-				Cell b = Detail::pop(stack);
-				Cell a = Detail::pop(stack);
+	//a = a op b, in place, for cells the compiler has found to be of the types 
+	//types / CELL_TYPE_COUNT and types % CELL_TYPE_COUNT, which op takes.
+	template<typename Value, typename Cell>
+	void evaluateTypedBinary(boost::uint32_t op, boost::uint32_t types, Cell& a, const Cell& b)
+	{
+		Detail::BinaryTable<Value, Cell>::table[op][types / CELL_TYPE_COUNT][types % CELL_TYPE_COUNT](a, b);
+	}
 
-				Cell result = boost::apply_visitor(Detail::DivVisitor<Value, Cell>(), a, b);
-				stack.push_back(result);
-				break;
-			}
+	//a = op a, in place.
+	template<typename Value, typename Cell>
+	void evaluateUnary(boost::uint32_t op, Cell& a)
+	{
+		Value& x = boost::get<Value>(a);
+		if (op == OPERATOR_UNARY_MINUS)
+		{
+			x = -x;
+		}
+		else if (op == OPERATOR_NOT)
+		{
+			complement(x);
+		}
+	}
 
+	template<typename Value, typename Cell>
+	void evaluateOperator(boost::uint32_t op, std::vector<Cell>& stack, EvaluationContext& ctx)
+	{
+		switch(op)
+		{
 		case OPERATOR_UNARY_PLUS:
-			{
-				Value a = Detail::popAs<Value>(stack);
-				stack.push_back(+a);
-				break;
-			}
-
 		case OPERATOR_UNARY_MINUS:
+		case OPERATOR_NOT:
+			evaluateUnary<Value>(op, stack.back());
+			break;
+
+		default:
 			{
-				Value a = Detail::popAs<Value>(stack);
-				stack.push_back(-a);
+				Cell b = Detail::pop(stack);
+				evaluateBinary<Value>(op, stack.back(), b);
 				break;
 			}
 		}
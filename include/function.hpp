@@ -7,65 +7,97 @@ namespace Represent
 	template<typename Impl>
 	struct GenericFunction : public IFunctionImpl
 	{
-		virtual void invoke(std::vector<StorageCell>& stack, EvaluationContext& ctx, size_t arity)
-		{
-			return Impl::template invoke<Value, StorageCell>(stack, ctx, arity);
+#define GENERIC_INVOKE(r, data, T) \
+		virtual void invoke(std::vector<Storage<T>::type>& stack, EvaluationContext& ctx, size_t arity) \
+		{ \
+			return Impl::template invoke<T, Storage<T>::type>(stack, ctx, arity); \
 		}
 
-		virtual void invoke(std::vector<StorageCelld>& stack, EvaluationContext& ctx, size_t arity)
-		{
-			return Impl::template invoke<double, StorageCelld>(stack, ctx, arity);
-		}
+		BOOST_PP_SEQ_FOR_EACH(GENERIC_INVOKE, _, NUMBER_TYPES)
 
-		virtual void invoke(std::vector<StorageCellf>& stack, EvaluationContext& ctx, size_t arity)
+		virtual bool pure() const
 		{
-			return Impl::template invoke<float, StorageCellf>(stack, ctx, arity);
+			return Impl::pure;
 		}
 	};
 
 	struct Increment
 	{
+		static const bool pure = true;
+
 		template<typename T, typename Cell>
 		static void invoke(std::vector<Cell>& cell, EvaluationContext& ctx, size_t arity)
 		{
-			T scalar = Detail::popAs<T>(cell);
-			cell.push_back(scalar + 1);
+			T& scalar = Detail::topAs<T>(cell);
+			scalar = scalar + 1;
 		}
 	};
 
 	struct Len
 	{
+		static const bool pure = true;
+
 		template<typename T, typename Cell>
 		static void invoke(std::vector<Cell>& cell, EvaluationContext& ctx, size_t arity)
 		{
-			Cell top = Detail::pop(cell);
+			Cell& top = cell.back();
 
-			std::string * a = boost::get<std::string>(&top);
-			std::vector<Cell> * b = boost::get<std::vector<Cell> >(&top);
+			Boxed<std::string> * a = boost::get<Boxed<std::string> >(&top);
+			Boxed<Array<T> > * b = boost::get<Boxed<Array<T> > >(&top);
 
 			if (a)
 			{
-				cell.push_back(T(a->length()));
+				top = T((*a)->length());
 			}
 			else if (b)
 			{
-				cell.push_back(T(b->size()));
+				top = T((*b)->size());
+			}
+			else
+			{
+				cell.pop_back();
+			}
+		}
+	};
+
+	//The number of bits set in a 64 bit integer.
+	struct PopCount
+	{
+		static const bool pure = true;
+
+		template<typename T, typename Cell>
+		static void invoke(std::vector<Cell>& cell, EvaluationContext& ctx, size_t arity)
+		{
+			T& scalar = Detail::topAs<T>(cell);
+
+			boost::int64_t bits;
+			if (toBits(scalar, bits))
+			{
+				scalar = fromBits(__builtin_popcountll(bits), static_cast<T *>(NULL));
+			}
+			else
+			{
+				scalar = T(std::numeric_limits<double>::quiet_NaN());
 			}
 		}
 	};
 
 	struct Duplicate
 	{
+		static const bool pure = false;
+
 		template<typename T, typename Cell>
 		static void invoke(std::vector<Cell>& cell, EvaluationContext& ctx, size_t arity)
 		{
-			Cell top = cell.back();
-			cell.push_back(top);
+			//The one copy a function means to make.
+			cell.push_back(Detail::copy(cell.back()));
 		}
 	};
 
 	struct MakeQuaternion
 	{
+		static const bool pure = true;
+
 		template<typename T, typename Cell>
 		static void invoke(std::vector<Cell>& cell, EvaluationContext& ctx, size_t arity)
 		{
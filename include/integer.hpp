@@ -0,0 +1,298 @@
+#include <boost/cstdint.hpp>
+#include <boost/multiprecision/number.hpp>
+#include <boost/type_traits/is_floating_point.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/type_traits/is_signed.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include "conversion.hpp"
+#include "interval.hpp"
+#include "shadow.hpp"
+
+#pragma once
+namespace Represent
+{
+	/*
+		The bit operators work on 64 bit two's complement integers in every precision. Operands
+		may be any integer from -2^63 to 2^64 - 1, and results are signed.
+
+		OPERATOR_SHIFT_LEFT, OPERATOR_SHIFT_RIGHT	Logical shifts, 0 past 63 bits.
+		OPERATOR_ROTATE_LEFT, OPERATOR_ROTATE_RIGHT	Rotates, by the count modulo 64.
+		OPERATOR_ARITHMETIC_SHIFT_LEFT				a * 2^n, which is not truncated to 64 bits, for n
+													up to SHIFT_LIMIT.
+		OPERATOR_ARITHMETIC_SHIFT_RIGHT				a / 2^n, rounded down.
+		OPERATOR_AND, OPERATOR_OR, OPERATOR_NOT		Bitwise and, or and complement.
+
+		Anything else, such as a fraction or a negative shift, gives a result that is not a
+		number.
+	*/
+
+	//The largest count an arithmetic left shift takes past 64 bits.
+	const boost::int64_t SHIFT_LIMIT = 1 << 16;
+
+	//A 64 bit integer that knows when it is wrong. A result that does not fit, or is not an
+	//integer, is not valid, and nor is anything computed from it, so an evaluation in Integer
+	//only has to look at its result to know whether it must be evaluated in Value instead.
+	struct Integer
+	{
+		Integer()
+			:value(0)
+			,valid(true)
+		{}
+
+		Integer(boost::int64_t value, bool valid)
+			:value(value)
+			,valid(valid)
+		{}
+
+		template<typename N>
+		Integer(N n, typename boost::enable_if_c<boost::is_integral<N>::value && boost::is_signed<N>::value>::type * = 0)
+			:value(static_cast<boost::int64_t>(n))
+			,valid(true)
+		{}
+
+		template<typename N>
+		Integer(N n, typename boost::enable_if_c<boost::is_integral<N>::value && !boost::is_signed<N>::value>::type * = 0)
+			:value(static_cast<boost::int64_t>(n))
+			,valid(n <= static_cast<boost::uint64_t>(std::numeric_limits<boost::int64_t>::max()))
+		{}
+
+		template<typename N>
+		Integer(N n, typename boost::enable_if<boost::is_floating_point<N> >::type * = 0)
+			:value(0)
+			,valid(std::floor(n) == n && n >= -9223372036854775808.0L && n < 9223372036854775808.0L)
+		{
+			if (valid)
+			{
+				value = static_cast<boost::int64_t>(n);
+			}
+		}
+
+		Integer& operator+=(const Integer& other)
+		{
+			valid = !__builtin_add_overflow(value, other.value, &value) && valid && other.valid;
+			return *this;
+		}
+
+		Integer& operator-=(const Integer& other)
+		{
+			valid = !__builtin_sub_overflow(value, other.value, &value) && valid && other.valid;
+			return *this;
+		}
+
+		Integer& operator*=(const Integer& other)
+		{
+			valid = !__builtin_mul_overflow(value, other.value, &value) && valid && other.valid;
+			return *this;
+		}
+
+		//Only exact quotients are integers.
+		Integer& operator/=(const Integer& other)
+		{
+			bool exact = other.value != 0 && !(value == std::numeric_limits<boost::int64_t>::min() && other.value == -1) &&
+				value % other.value == 0;
+
+			value = exact ? value / other.value : 0;
+			valid = exact && valid && other.valid;
+			return *this;
+		}
+
+		Integer operator-() const
+		{
+			return Integer(0) -= *this;
+		}
+
+		Integer operator+() const
+		{
+			return *this;
+		}
+
+		friend Integer operator+(Integer a, const Integer& b) { return a += b; }
+		friend Integer operator-(Integer a, const Integer& b) { return a -= b; }
+		friend Integer operator*(Integer a, const Integer& b) { return a *= b; }
+		friend Integer operator/(Integer a, const Integer& b) { return a /= b; }
+
+		boost::int64_t value;
+		bool valid;
+	};
+
+	std::ostream& operator<<(std::ostream& o, const Integer& i);
+
+	//Integer values that are not integers, or do not fit, are not valid.
+	Integer convertValue(const Value& v, Integer *);
+	template<> Integer convertAs<Integer>(boost::string_ref digits, size_t base);
+
+	//Whether op is one of the binary bit operators.
+	inline bool bitOperator(boost::uint32_t op)
+	{
+		return op >= OPERATOR_SHIFT_LEFT && op <= OPERATOR_OR;
+	}
+
+	//Applies a bit operator to 64 bit integers. Returns false if the result is not a 64 bit
+	//integer, which is only the case for a negative shift, or an arithmetic shift left that
+	//overflows.
+	inline bool bitwise(boost::uint32_t op, boost::int64_t a, boost::int64_t n, boost::int64_t& result)
+	{
+		boost::uint64_t bits = static_cast<boost::uint64_t>(a);
+		boost::uint64_t count = static_cast<boost::uint64_t>(n);
+		bool shift = op != OPERATOR_AND && op != OPERATOR_OR && op != OPERATOR_ROTATE_LEFT && op != OPERATOR_ROTATE_RIGHT;
+		if (shift && n < 0)
+		{
+			return false;
+		}
+
+		switch (op)
+		{
+		case OPERATOR_SHIFT_LEFT: bits = count < 64 ? bits << count : 0; break;
+		case OPERATOR_SHIFT_RIGHT: bits = count < 64 ? bits >> count : 0; break;
+		case OPERATOR_ROTATE_LEFT: count &= 63; bits = count ? (bits << count) | (bits >> (64 - count)) : bits; break;
+		case OPERATOR_ROTATE_RIGHT: count &= 63; bits = count ? (bits >> count) | (bits << (64 - count)) : bits; break;
+		case OPERATOR_ARITHMETIC_SHIFT_RIGHT: result = a >> std::min<boost::uint64_t>(count, 63); return true;
+		case OPERATOR_AND: bits &= static_cast<boost::uint64_t>(n); break;
+		case OPERATOR_OR: bits |= static_cast<boost::uint64_t>(n); break;
+
+		case OPERATOR_ARITHMETIC_SHIFT_LEFT:
+			if (count >= 64 || (static_cast<boost::int64_t>(bits << count) >> count) != a)
+			{
+				return false;
+			}
+			bits <<= count;
+			break;
+		}
+
+		result = static_cast<boost::int64_t>(bits);
+		return true;
+	}
+
+	namespace Detail
+	{
+		//2^63 and 2^64, exactly, which bound what the bit operators accept.
+		const double TWO_63 = 9223372036854775808.0;
+		const double TWO_64 = 18446744073709551616.0;
+	}
+
+	//The bits of t, if it is an integer the bit operators accept.
+	template<typename T>
+	typename boost::enable_if<boost::is_floating_point<T>, bool>::type toBits(T t, boost::int64_t& bits)
+	{
+		if (!(std::floor(t) == t && t >= -Detail::TWO_63 && t < Detail::TWO_64))
+		{
+			return false;
+		}
+
+		bits = t >= Detail::TWO_63 ? static_cast<boost::int64_t>(static_cast<boost::uint64_t>(t - Detail::TWO_63) ^ (boost::uint64_t(1) << 63)) :
+			static_cast<boost::int64_t>(t);
+		return true;
+	}
+
+	template<typename T>
+	typename boost::enable_if_c<boost::multiprecision::is_number<T>::value, bool>::type toBits(const T& t, boost::int64_t& bits)
+	{
+		if (!(floor(t) == t && t >= -Detail::TWO_63 && t < Detail::TWO_64))
+		{
+			return false;
+		}
+
+		if (t >= Detail::TWO_63)
+		{
+			bits = static_cast<boost::int64_t>(T(t - Detail::TWO_63).template convert_to<boost::uint64_t>() ^ (boost::uint64_t(1) << 63));
+		}
+		else
+		{
+			bits = t.template convert_to<boost::int64_t>();
+		}
+
+		return true;
+	}
+
+	inline bool toBits(const Integer& i, boost::int64_t& bits)
+	{
+		bits = i.value;
+		return i.valid;
+	}
+
+	inline bool toBits(const Shadow& s, boost::int64_t& bits)
+	{
+		return toBits(s.full, bits);
+	}
+
+	//Only an interval that is a single integer has bits.
+	template<typename T>
+	bool toBits(const Interval<T>& i, boost::int64_t& bits)
+	{
+		return i.lo == i.hi && toBits(i.lo, bits);
+	}
+
+	//bits as a T, which is rounded if T cannot hold it, and bracketed if T is an interval.
+	template<typename T>
+	T fromBits(boost::int64_t bits, T *)
+	{
+		return T(bits);
+	}
+
+	template<typename T>
+	Interval<T> fromBits(boost::int64_t bits, Interval<T> *)
+	{
+		return convertValue(Value(bits), static_cast<Interval<T> *>(NULL));
+	}
+
+	//a = a op b, for op one of the binary bit operators.
+	template<typename T>
+	void bitwise(boost::uint32_t op, T& a, const T& b)
+	{
+		boost::int64_t x, n, result;
+		if (!toBits(a, x) || !toBits(b, n))
+		{
+			a = T(std::numeric_limits<double>::quiet_NaN());
+		}
+		else if (bitwise(op, x, n, result))
+		{
+			a = fromBits(result, static_cast<T *>(NULL));
+		}
+		else if (op == OPERATOR_ARITHMETIC_SHIFT_LEFT && n >= 0 && n <= SHIFT_LIMIT)
+		{
+			//Past 64 bits, which T may still hold. Scaled in steps that are exact doubles, since
+			//2^n is not one past 2^1023.
+			for (; n > 0; n -= 512)
+			{
+				a *= T(std::ldexp(1.0, static_cast<int>(std::min<boost::int64_t>(n, 512))));
+			}
+		}
+		else
+		{
+			a = T(std::numeric_limits<double>::quiet_NaN());
+		}
+	}
+
+	//Each part of a Shadow sees only its own bit operators.
+	inline void bitwise(boost::uint32_t op, Shadow& a, const Shadow& b)
+	{
+		bitwise(op, a.full, b.full);
+		bitwise(op, a.dbl, b.dbl);
+		bitwise(op, a.flt, b.flt);
+	}
+
+	//a = ~a.
+	template<typename T>
+	void complement(T& a)
+	{
+		boost::int64_t x;
+		a = toBits(a, x) ? fromBits(~x, static_cast<T *>(NULL)) : T(std::numeric_limits<double>::quiet_NaN());
+	}
+
+	inline void complement(Shadow& a)
+	{
+		complement(a.full);
+		complement(a.dbl);
+		complement(a.flt);
+	}
+
+	inline void complement(Integer& a)
+	{
+		a.value = ~a.value;
+	}
+}
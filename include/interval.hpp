@@ -0,0 +1,215 @@
+#include <boost/type_traits/is_arithmetic.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include "conversion.hpp"
+
+#pragma once
+namespace Represent
+{
+	namespace Detail
+	{
+		//Sets down and up to the doubles either side of the exact result of an operation, given
+		//the result rounded to nearest and its error. An error that is not a number means the
+		//rounding is unknown, so both sides move.
+		inline void bracket(double rounded, double error, double& down, double& up)
+		{
+			down = rounded;
+			up = rounded;
+
+			if (error < 0)
+			{
+				down = std::nextafter(rounded, -std::numeric_limits<double>::infinity());
+			}
+			else if (error > 0)
+			{
+				up = std::nextafter(rounded, std::numeric_limits<double>::infinity());
+			}
+			else if (error != error)
+			{
+				down = std::nextafter(rounded, -std::numeric_limits<double>::infinity());
+				up = std::nextafter(rounded, std::numeric_limits<double>::infinity());
+			}
+		}
+
+		//Below this, the low part of a product can be lost to underflow.
+		const double EXACT_PRODUCTS = 1e-290;
+
+		//The error of the rounded product p of a and b, by Dekker's splitting.
+		inline double productError(double a, double b, double p)
+		{
+			if (a == 0 || b == 0)
+			{
+				return 0;
+			}
+
+			if (!(std::fabs(p) >= EXACT_PRODUCTS))
+			{
+				return std::numeric_limits<double>::quiet_NaN();
+			}
+
+			const double split = 134217729.0;
+			double ca = split * a, cb = split * b;
+			double ah = ca - (ca - a), bh = cb - (cb - b);
+			double al = a - ah, bl = b - bh;
+
+			return ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+		}
+	}
+
+	//Bounds on the exact result of one operation: down and up are set to the closest doubles
+	//below and above it, which are the same when it is exact.
+	inline void sum(double a, double b, double& down, double& up)
+	{
+		double s = a + b;
+		double v = s - a;
+		Detail::bracket(s, (a - (s - v)) + (b - v), down, up);
+	}
+
+	inline void product(double a, double b, double& down, double& up)
+	{
+		double p = a * b;
+		Detail::bracket(p, Detail::productError(a, b, p), down, up);
+	}
+
+	inline void quotient(double a, double b, double& down, double& up)
+	{
+		double q = a / b;
+
+		//a = q * b + r exactly, so the exact quotient is q + r / b.
+		double p = q * b;
+		double r = (a - p) - Detail::productError(q, b, p);
+		Detail::bracket(q, b > 0 ? r : -r, down, up);
+	}
+
+	//Value has no directed rounding, so each result is widened by a little more than its
+	//rounding error instead.
+	void sum(const Value& a, const Value& b, Value& down, Value& up);
+	void product(const Value& a, const Value& b, Value& down, Value& up);
+	void quotient(const Value& a, const Value& b, Value& down, Value& up);
+
+	//A closed interval of T that holds an exact result. Arithmetic rounds the bounds outwards,
+	//so intervals computed from intervals that hold their operands hold the exact result too.
+	template<typename T>
+	struct Interval
+	{
+		Interval()
+			:lo(0)
+			,hi(0)
+		{}
+
+		Interval(const T& lo, const T& hi)
+			:lo(lo)
+			,hi(hi)
+		{}
+
+		//Exact for numbers that T holds exactly, such as integers below 2^53 in a double.
+		template<typename N>
+		Interval(N n, typename boost::enable_if<boost::is_arithmetic<N> >::type * = 0)
+			:lo(n)
+			,hi(n)
+		{}
+
+		Interval& operator+=(const Interval& other)
+		{
+			T ignored;
+			sum(lo, other.lo, lo, ignored);
+			sum(hi, other.hi, ignored, hi);
+			return *this;
+		}
+
+		Interval& operator-=(const Interval& other)
+		{
+			T ignored;
+			T otherLo = other.lo;
+			sum(lo, -other.hi, lo, ignored);
+			sum(hi, -otherLo, ignored, hi);
+			return *this;
+		}
+
+		Interval& operator*=(const Interval& other)
+		{
+			//Most operands are exact, and then one product does.
+			if (lo == hi && other.lo == other.hi)
+			{
+				product(lo, other.lo, lo, hi);
+				return *this;
+			}
+
+			T down[4], up[4];
+			product(lo, other.lo, down[0], up[0]);
+			product(lo, other.hi, down[1], up[1]);
+			product(hi, other.lo, down[2], up[2]);
+			product(hi, other.hi, down[3], up[3]);
+
+			lo = std::min(std::min(down[0], down[1]), std::min(down[2], down[3]));
+			hi = std::max(std::max(up[0], up[1]), std::max(up[2], up[3]));
+			return *this;
+		}
+
+		Interval& operator/=(const Interval& other)
+		{
+			if (other.lo <= 0 && other.hi >= 0)
+			{
+				lo = -std::numeric_limits<T>::infinity();
+				hi = std::numeric_limits<T>::infinity();
+				return *this;
+			}
+
+			if (lo == hi && other.lo == other.hi)
+			{
+				quotient(lo, other.lo, lo, hi);
+				return *this;
+			}
+
+			T down[4], up[4];
+			quotient(lo, other.lo, down[0], up[0]);
+			quotient(lo, other.hi, down[1], up[1]);
+			quotient(hi, other.lo, down[2], up[2]);
+			quotient(hi, other.hi, down[3], up[3]);
+
+			lo = std::min(std::min(down[0], down[1]), std::min(down[2], down[3]));
+			hi = std::max(std::max(up[0], up[1]), std::max(up[2], up[3]));
+			return *this;
+		}
+
+		Interval operator-() const
+		{
+			return Interval(-hi, -lo);
+		}
+
+		Interval operator+() const
+		{
+			return *this;
+		}
+
+		friend Interval operator+(Interval a, const Interval& b) { return a += b; }
+		friend Interval operator-(Interval a, const Interval& b) { return a -= b; }
+		friend Interval operator*(Interval a, const Interval& b) { return a *= b; }
+		friend Interval operator/(Interval a, const Interval& b) { return a /= b; }
+
+		T lo;
+		T hi;
+	};
+
+	template<typename T>
+	std::ostream& operator<<(std::ostream& o, const Interval<T>& i)
+	{
+		o << "[" << i.lo << ", " << i.hi << "]";
+		return o;
+	}
+
+	//The closest doubles below and above v.
+	double below(const Value& v);
+	double above(const Value& v);
+
+	//Storage holds exact values, so they are points in Value, and bracketed by doubles.
+	Interval<Value> convertValue(const Value& v, Interval<Value> *);
+	Interval<double> convertValue(const Value& v, Interval<double> *);
+
+	template<> Interval<Value> convertAs<Interval<Value> >(boost::string_ref digits, size_t base);
+	template<> Interval<double> convertAs<Interval<double> >(boost::string_ref digits, size_t base);
+}
@@ -0,0 +1,51 @@
+#include <boost/cstdint.hpp>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#include "enummaker.hpp"
+#include "token.hpp"
+
+#pragma once
+namespace Represent
+{
+	/*
+		Elementwise arithmetic over contiguous buffers, used to run scalar bytecode over a block 
+		of rows. float and double have SSE2 and AVX2 kernels, chosen when first used by what 
+		the CPU supports. Every kernel rounds each element exactly as the scalar one does.
+	*/
+#define KERNEL_TYPES		\
+	(KERNEL_SCALAR)			\
+	(KERNEL_SSE2)			\
+	(KERNEL_AVX2)
+
+	MAKE_FULL_ENUM(KernelType, 0, KERNEL_TYPES);
+
+	//The widest kernels the CPU supports.
+	KernelType supportedKernels();
+
+	//Uses kernels no wider than type from now on, and returns the kernels that will be used. 
+	//Kernels already running on other threads finish with the kernels they started with.
+	KernelType selectKernels(KernelType type);
+	KernelType selectedKernels();
+
+	//target[i] = target[i] op source[i], for count elements.
+	void binaryKernel(boost::uint32_t op, double * target, const double * source, size_t count);
+	void binaryKernel(boost::uint32_t op, float * target, const float * source, size_t count);
+
+	//Other types are computed one element at a time.
+	template<typename T>
+	void binaryKernel(boost::uint32_t op, T * target, const T * source, size_t count)
+	{
+		switch (op)
+		{
+		case OPERATOR_PLUS: for (size_t i = 0; i < count; ++i) target[i] += source[i]; break;
+		case OPERATOR_MINUS: for (size_t i = 0; i < count; ++i) target[i] -= source[i]; break;
+		case OPERATOR_MULTIPLY: for (size_t i = 0; i < count; ++i) target[i] *= source[i]; break;
+		case OPERATOR_DIVIDE: for (size_t i = 0; i < count; ++i) target[i] /= source[i]; break;
+		}
+	}
+
+	std::string toString(KernelType type);
+	std::ostream& operator<<(std::ostream& o, KernelType type);
+}
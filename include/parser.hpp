@@ -6,7 +6,16 @@
 
 namespace Represent
 {
-	TokenStream parse(const std::string& text);
+#define PARSER_TYPES		\
+	(PARSER_PRATT)			\
+	(PARSER_BACKTRACKING)
+
+	MAKE_FULL_ENUM(ParserType, 0, PARSER_TYPES);
+
+	//PARSER_BACKTRACKING is the original parser. It is exponential in the nesting depth of
+	//its input, and is only kept around to test the precedence climbing parser against.
+	//The returned stream refers to text for its offsets, and does not copy it.
+	TokenStream parse(boost::string_ref text, ParserType parser = PARSER_PRATT);
 
 	//Parts.
 	namespace Parse
@@ -21,5 +30,10 @@ namespace Represent
 		size_t quaternion(const char * begin, const char * end, TokenStream& out);
 		size_t matrix(const char * begin, const char * end, TokenStream& out);
 		size_t array(const char * begin, const char * end, TokenStream& out);
+
+		namespace Pratt
+		{
+			size_t expression(const char * begin, const char * end, TokenStream& out);
+		}
 	}
 }
\ No newline at end of file
@@ -5,4 +5,7 @@ namespace Represent
 {
 	int isNumericInBase(char ch, size_t base);
 	size_t begins(const char * begin, const char * end, boost::string_ref value);
+
+	//Returns the first character at or after begin that is not whitespace.
+	const char * skipWhitespace(const char * begin, const char * end);
 }
\ No newline at end of file
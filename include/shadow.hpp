@@ -0,0 +1,68 @@
+#include <boost/cstdint.hpp>
+#include <boost/type_traits/is_arithmetic.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <iostream>
+
+#include "conversion.hpp"
+
+#pragma once
+namespace Represent
+{
+	//A number computed in Value, double and float side by side, so that one evaluation gives
+	//the result in every precision. Each part only ever sees its own precision's arithmetic,
+	//and so carries that precision's accumulated rounding error.
+	struct Shadow
+	{
+		Shadow();
+		Shadow(const Value& full, double dbl, float flt);
+
+		template<typename N>
+		Shadow(N n, typename boost::enable_if<boost::is_arithmetic<N> >::type * = 0)
+			:full(n)
+			,dbl(static_cast<double>(n))
+			,flt(static_cast<float>(n))
+		{}
+
+		Shadow& operator+=(const Shadow& other);
+		Shadow& operator-=(const Shadow& other);
+		Shadow& operator*=(const Shadow& other);
+		Shadow& operator/=(const Shadow& other);
+
+		Shadow operator-() const;
+		Shadow operator+() const;
+
+		friend Shadow operator+(Shadow a, const Shadow& b) { return a += b; }
+		friend Shadow operator-(Shadow a, const Shadow& b) { return a -= b; }
+		friend Shadow operator*(Shadow a, const Shadow& b) { return a *= b; }
+		friend Shadow operator/(Shadow a, const Shadow& b) { return a /= b; }
+
+		Value full;
+		double dbl;
+		float flt;
+	};
+
+	std::ostream& operator<<(std::ostream& o, const Shadow& s);
+
+	//Narrows a Value to each part on its own, so that every part starts correctly rounded.
+	Shadow convertValue(const Value& v, Shadow *);
+
+	template<> Shadow convertAs<Shadow>(boost::string_ref digits, size_t base);
+
+	//The part of a Shadow in one precision.
+	template<typename T> T shadowPart(const Shadow& s);
+
+	template<> inline Value shadowPart<Value>(const Shadow& s) { return s.full; }
+	template<> inline double shadowPart<double>(const Shadow& s) { return s.dbl; }
+	template<> inline float shadowPart<float>(const Shadow& s) { return s.flt; }
+
+	//How far the double and float parts of s are from the full part correctly rounded to their
+	//precision, in units in the last place. Exact but for results halfway between two
+	//representable numbers, and far cheaper than rounding the full part.
+	boost::uint64_t doubleUlps(const Shadow& s);
+	boost::uint64_t floatUlps(const Shadow& s);
+
+	//The number of representable numbers between a and b, counting one of them. 0 if they are
+	//equal, including two NaNs, and the largest distance if only one is NaN.
+	boost::uint64_t ulpDistance(double a, double b);
+	boost::uint64_t ulpDistance(float a, float b);
+}
@@ -12,4 +12,23 @@ namespace Represent
 	};
 
 	const TableEntry * lookup(const TableEntry * begin, const TableEntry * end, const char * b, const char * e, size_t * consumed);
-}
\ No newline at end of file
+
+	//The single source of operator spellings, binding power and associativity.
+	//Both parsers and the shunting yard read from this table.
+	struct OperatorEntry
+	{
+		const char * string;
+		OperatorType op;
+		boost::uint32_t power;
+
+		//0 is left, 1 is right
+		boost::uint32_t assoc;
+		bool unary;
+	};
+
+	//Returns the entry for op, or NULL if op is not in the table.
+	const OperatorEntry * operatorLookup(boost::uint32_t op);
+
+	//Finds the longest unary or binary operator that begins at b.
+	const OperatorEntry * matchOperator(const char * b, const char * e, bool unary, size_t * consumed);
+}
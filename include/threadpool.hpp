@@ -0,0 +1,61 @@
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <exception>
+#include <vector>
+
+#pragma once
+namespace Represent
+{
+	/*
+		A fixed set of worker threads that run the tasks of one call to run() at a time.
+
+		Tasks are indices. Each worker starts on its own contiguous range of them, taking 
+		tasks from the front, and once it runs out, steals the back half of the range of 
+		another worker. Workers only ever hold the lock of one range at a time.
+	*/
+	class ThreadPool
+	{
+	public:
+		//A thread per core if count is 0.
+		explicit ThreadPool(size_t count = 0);
+		~ThreadPool();
+
+		size_t size() const;
+
+		//Called with a task and the index of the worker running it.
+		typedef boost::function<void (size_t, size_t)> Task;
+
+		//Runs body for every task from 0 to count, and returns once they have all finished. 
+		//The first exception a task throws is rethrown here, after the others have finished.
+		void run(size_t count, const Task& body);
+
+	private:
+		ThreadPool(const ThreadPool&);
+		ThreadPool& operator=(const ThreadPool&);
+
+		struct Range
+		{
+			boost::mutex mutex;
+			size_t begin;
+			size_t end;
+		};
+
+		void work(size_t worker);
+		bool pop(size_t worker, size_t& task);
+		bool steal(size_t worker, size_t& task);
+
+		std::vector<Range> ranges;
+		boost::thread_group threads;
+
+		//Guards everything below.
+		boost::mutex mutex;
+		boost::condition_variable wake;
+		boost::condition_variable finished;
+
+		const Task * body;
+		size_t generation;
+		size_t active;
+		bool stopping;
+		std::exception_ptr error;
+	};
+}
@@ -1,6 +1,7 @@
 #include <string>
 #include <iostream>
 #include <boost/cstdint.hpp>
+#include <boost/utility/string_ref.hpp>
 #include <vector>
 
 #include "enummaker.hpp"
@@ -11,25 +12,28 @@ namespace Represent
 	/*
 		TOKEN_QUATERNION modifies a TOKEN_VECTOR.
 		TOKEN_MATRIX modifies the immediately following 4 TOKEN_VECTORs.
+
+		TOKEN_NUMBER, TOKEN_IDENTIFIER_RAW and TOKEN_STRING are spans of the source: 
+		offset is where the lexeme begins, and value is its length in bytes. A TOKEN_NUMBER
+		spans its digits and decimal point, without the base prefix, and stores its base in extra.
+		A TOKEN_STRING spans the text between its backticks, escapes included.
 	*/
 #define TOKEN_SOURCE 		\
-	(TOKEN_BASE_FLAG)       \
 	(TOKEN_NUMBER)	 		\
-	(TOKEN_DECIMAL_POINT)   \
 	(TOKEN_OPERATOR)		\
 	(TOKEN_PAREN)           \
 	(TOKEN_ARG_DELIMIT)		\
 	(TOKEN_FUNCTION_IDENTIFIER) \
 	(TOKEN_IDENTIFIER_RAW)	\
-	(TOKEN_RAW)				\
-	(TOKEN_STRING_START)	\
+	(TOKEN_STRING)			\
 	(TOKEN_VECTOR)			\
 	(TOKEN_QUATERNION)		\
 	(TOKEN_MATRIX)			\
 	(TOKEN_MATRIX_DELIMIT)	\
 	(TOKEN_STORAGE_REFERENCE) \
 	(TOKEN_RAW_VALUE)		\
-	(TOKEN_ARRAY)
+	(TOKEN_ARRAY)			\
+	(TOKEN_LITERAL_REFERENCE)
 
 	MAKE_FULL_ENUM(TokenType, 0, TOKEN_SOURCE);
 
@@ -43,10 +47,20 @@ namespace Represent
 	(OPERATOR_COMPONENT_PLUS)  		\
 	(OPERATOR_COMPONENT_MINUS) 		\
 	(OPERATOR_COMPONENT_MULTIPLY) 	\
-	(OPERATOR_COMPONENT_DIVIDE)
+	(OPERATOR_COMPONENT_DIVIDE)		\
+	(OPERATOR_SHIFT_LEFT)			\
+	(OPERATOR_SHIFT_RIGHT)			\
+	(OPERATOR_ROTATE_LEFT)			\
+	(OPERATOR_ROTATE_RIGHT)			\
+	(OPERATOR_ARITHMETIC_SHIFT_LEFT)	\
+	(OPERATOR_ARITHMETIC_SHIFT_RIGHT)	\
+	(OPERATOR_AND)					\
+	(OPERATOR_OR)					\
+	(OPERATOR_NOT)
 
 
 	MAKE_FULL_ENUM(OperatorType, 0, OPERATOR_TYPES);
+	const size_t OPERATOR_COUNT = BOOST_PP_SEQ_SIZE(OPERATOR_TYPES);
 
 	struct Token
 	{
@@ -57,16 +71,25 @@ namespace Represent
 		bool operator!=(const Token& other) const;
 
 		boost::uint16_t type;
-		boost::uint32_t value;
 
-		//This is not filled in by the parser, the evaluator may fill this with some extra data.
+		//The parser only fills this in for TOKEN_NUMBER, the evaluator may fill this with some extra data.
 		boost::uint16_t extra;
+		boost::uint32_t value;
+
+		//Byte offset of the lexeme in the parsed text. This is not part of a token's identity,
+		//and is not compared by operator==.
+		boost::uint32_t offset;
 	};
 	std::ostream& operator<<(std::ostream& o, const Token& tk);
 
 	class TokenStream
 	{
 	public:
+		TokenStream();
+
+		//source is not copied, and must outlive any use of the token offsets.
+		explicit TokenStream(boost::string_ref source);
+
 		typedef std::vector<Token>::iterator iterator;
 		typedef std::vector<Token>::const_iterator const_iterator;
 
@@ -84,8 +107,26 @@ namespace Represent
 
 		const std::vector<Token> getTokens() const;
 		void clear();
+
+		//The token vector is the arena for a whole parse. A parser marks the stream before
+		//trying a production, and rolls back to the mark if it fails, instead of building
+		//temporary streams.
+		typedef size_t Mark;
+		Mark mark() const;
+		void rollback(Mark mark);
+
+		//Used to patch header tokens once their contents are known.
+		Token& at(size_t index);
+		void reserve(size_t count);
+
+		boost::string_ref getSource() const;
+		boost::uint32_t offsetOf(const char * position) const;
+
+		//The text of a span token.
+		boost::string_ref lexeme(const Token& tk) const;
 	private:
 		std::vector<Token> tokens;
+		boost::string_ref source;
 	};
 
 	std::string toString(TokenType tk);
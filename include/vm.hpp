@@ -0,0 +1,176 @@
+#include <boost/cstdint.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "enummaker.hpp"
+#include "token.hpp"
+
+#pragma once
+namespace Represent
+{
+	/*
+		Three address instructions over three register files, of scalars, vectors and cells. 
+		Register n holds what would be the nth entry of the evaluation stack, so operands of 
+		constructors and calls are always in consecutive registers starting at target, and every
+		result is written to target. 
+		
+		The type of every register is inferred when the code is compiled, from the types of the
+		storage slots, and each operator is lowered to the instruction for its operand types. 
+		Arithmetic on scalars and vectors never touches a cell, and operators on other cells go
+		straight to the function for their types. Only function results have no static type, 
+		and operators on them dispatch on their types when they run. A program that applies an 
+		operator to types it does not take is rejected before it runs.
+
+		Identical subtrees are computed once. The result of a shared subtree is copied into a 
+		register above the evaluation stack, and copied back wherever the subtree occurs again.
+
+		INSTRUCTION_LOAD_RAW		scalar target = source, as a number.
+		INSTRUCTION_LOAD_LITERAL	scalar target = literal source.
+		INSTRUCTION_LOAD_SCALAR		scalar target = storage slot source, which holds a scalar.
+		INSTRUCTION_LOAD_VECTOR		vector target = storage slot source, which holds a vector.
+		INSTRUCTION_LOAD_STORAGE	cell target = storage slot source.
+		INSTRUCTION_SCALAR_BINARY	scalar target = target op source.
+		INSTRUCTION_SCALAR_UNARY	scalar target = op target.
+		INSTRUCTION_VECTOR_BINARY	vector target = target op source, with operands of the VectorShape count.
+		INSTRUCTION_TYPED_BINARY	cell target = target op source, which are of the types count / CELL_TYPE_COUNT 
+									and count % CELL_TYPE_COUNT.
+		INSTRUCTION_BINARY			cell target = target op source, for any types.
+		INSTRUCTION_UNARY			cell target = op target.
+		INSTRUCTION_BOX				cell target = scalar target.
+		INSTRUCTION_UNBOX			scalar target = cell target, which must hold a scalar.
+		INSTRUCTION_BOX_VECTOR		cell target = vector target.
+		INSTRUCTION_UNBOX_VECTOR	vector target = cell target, which must hold a vector.
+		INSTRUCTION_VECTOR			vector target = [target, target + 1, target + 2, target + 3], from scalars.
+		INSTRUCTION_QUATERNION		cell target = q[target, target + 1, target + 2, target + 3], from scalars.
+		INSTRUCTION_MATRIX			cell target = the matrix with rows target to target + 3, from vectors.
+		INSTRUCTION_ARRAY			cell target = { target ... target + count - 1 }.
+		INSTRUCTION_CALL			cell target = the function in storage slot source, applied to count cells.
+		INSTRUCTION_COPY_SCALAR		scalar target = scalar source.
+		INSTRUCTION_COPY_VECTOR		vector target = vector source.
+		INSTRUCTION_COPY			cell target = cell source.
+
+		Only UNBOX, UNBOX_VECTOR, BINARY and UNARY check the types of cells, and they are only
+		emitted for the results of functions.
+	*/
+#define INSTRUCTION_TYPES			\
+	(INSTRUCTION_LOAD_RAW)			\
+	(INSTRUCTION_LOAD_LITERAL)		\
+	(INSTRUCTION_LOAD_SCALAR)		\
+	(INSTRUCTION_LOAD_VECTOR)		\
+	(INSTRUCTION_LOAD_STORAGE)		\
+	(INSTRUCTION_SCALAR_BINARY)		\
+	(INSTRUCTION_SCALAR_UNARY)		\
+	(INSTRUCTION_VECTOR_BINARY)		\
+	(INSTRUCTION_TYPED_BINARY)		\
+	(INSTRUCTION_BINARY)			\
+	(INSTRUCTION_UNARY)				\
+	(INSTRUCTION_BOX)				\
+	(INSTRUCTION_UNBOX)				\
+	(INSTRUCTION_BOX_VECTOR)		\
+	(INSTRUCTION_UNBOX_VECTOR)		\
+	(INSTRUCTION_VECTOR)			\
+	(INSTRUCTION_QUATERNION)		\
+	(INSTRUCTION_MATRIX)			\
+	(INSTRUCTION_ARRAY)				\
+	(INSTRUCTION_CALL)				\
+	(INSTRUCTION_COPY_SCALAR)		\
+	(INSTRUCTION_COPY_VECTOR)		\
+	(INSTRUCTION_COPY)
+
+	MAKE_FULL_ENUM(InstructionType, 0, INSTRUCTION_TYPES);
+
+	//The static types of registers, which are the alternatives of Storage<T>::type in order. A
+	//function may return any of them, so its result is CELL_DYNAMIC until it is run.
+#define CELL_TYPES			\
+	(CELL_SCALAR)			\
+	(CELL_VECTOR)			\
+	(CELL_QUATERNION)		\
+	(CELL_MATRIX)			\
+	(CELL_ARRAY)			\
+	(CELL_STRING)			\
+	(CELL_FUNCTION)			\
+	(CELL_IDENTIFIER)		\
+	(CELL_NULL)
+
+	//The number of alternatives in a Storage<T>::type, which index the operator tables.
+#define CELL_TYPE_COUNT BOOST_PP_SEQ_SIZE(CELL_TYPES)
+
+	MAKE_FULL_ENUM(CellType, 0, CELL_TYPES (CELL_DYNAMIC)(CELL_INVALID));
+
+	//The operands of an INSTRUCTION_VECTOR_BINARY.
+	enum VectorShape
+	{
+		SHAPE_VECTOR_SCALAR,
+		SHAPE_SCALAR_VECTOR,
+		SHAPE_VECTOR_VECTOR
+	};
+
+	struct Instruction
+	{
+		boost::uint16_t type;
+		boost::uint16_t op;
+		boost::uint32_t target;
+		boost::uint32_t source;
+		boost::uint32_t count;
+	};
+
+	struct Bytecode
+	{
+		std::vector<Instruction> code;
+
+		//The size of each register file. The result is left in cell register 0, or in scalar 
+		//register 0 if it is a scalar.
+		boost::uint32_t registers;
+		bool scalarResult;
+
+		//The type of the result, which is CELL_DYNAMIC if it is the result of a function.
+		CellType resultType;
+
+		//Nodes of the RPN that were found to repeat a subtree computed before them.
+		boost::uint32_t deduplicated;
+
+		//Every instruction works on scalars alone, so the code can be run over a block of rows.
+		bool scalarOnly;
+	};
+
+	//What the compiler needs to know about a storage slot.
+	struct SlotInfo
+	{
+		CellType type;
+
+		//Holds a pure function, so identical calls to it can be computed once.
+		bool pure;
+	};
+
+	//Compiles RPN whose references have been resolved to storage slots. Throws if an operator 
+	//is given types it does not take.
+	Bytecode compile(const TokenStream& rpn, const std::vector<SlotInfo>& slots);
+
+	//The type of the result of resolved RPN, without compiling it. Throws as compile does.
+	CellType infer(const TokenStream& rpn, const std::vector<SlotInfo>& slots);
+
+	//The type of a op b, or CELL_INVALID if op does not take them. This is read from the 
+	//operator tables, in evalutils.cpp.
+	CellType binaryType(boost::uint32_t op, CellType a, CellType b);
+
+	//The number of operands tk takes from the evaluation stack.
+	boost::uint32_t operandCount(const Token& tk);
+
+	//The name of a type in messages, such as "number".
+	const char * cellTypeName(CellType type);
+
+	//Thrown when an operator or constructor is given types it does not take, whether that is
+	//found when compiling or when running. The message names the operator and the types.
+	struct InvalidArguments
+		: public std::runtime_error
+	{
+		explicit InvalidArguments(const std::string& message)
+			:std::runtime_error(message)
+		{}
+	};
+
+	std::string toString(InstructionType type);
+	std::ostream& operator<<(std::ostream& o, const Instruction& instruction);
+}
@@ -1,73 +1,394 @@
 #include "conversion.hpp"
+#include "parserutils.hpp"
 
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
 
 namespace Represent
 {
-	//Converts a number TokenStream into an actual number.
 	Value convert(const TokenStream& stream)
 	{
-		Value result;
-		convert(stream.begin(), stream.end(), result);
-		return result;
+		assert(stream.begin() != stream.end() && stream.begin()->type == TOKEN_NUMBER);
+
+		const Token& tk = *stream.begin();
+		return convert(stream.lexeme(tk), tk.extra);
 	}
 
-	TokenStream::const_iterator convert(TokenStream::const_iterator begin, TokenStream::const_iterator end, Value& out)
+	namespace
 	{
-		Token first = *begin;
-		auto it = begin; 
-		it++;
+		//Accumulates integer digits from it into chunk for as long as base^digits still fits in
+		//64 bits, so the chunk can never overflow. scale receives base^digits.
+		const char * accumulate(const char * it, const char * end, size_t base, boost::uint64_t& chunk, boost::uint64_t& scale)
+		{
+			const boost::uint64_t limit = std::numeric_limits<boost::uint64_t>::max() / base;
+
+			chunk = 0;
+			scale = 1;
+			while (it != end && *it != '.' && scale <= limit)
+			{
+				chunk = chunk * base + isNumericInBase(*it, base);
+				scale *= base;
+				++it;
+			}
+
+			return it;
+		}
+	}
 
-		Value base(first.value);
-		Value result(0);
+	bool convertInteger(boost::string_ref digits, size_t base, boost::uint64_t& result)
+	{
+		boost::uint64_t scale = 0;
+		const char * end = digits.data() + digits.size();
+		const char * it = accumulate(digits.data(), end, base, result, scale);
 
-		while (it != end && it->type == TOKEN_NUMBER)
+		//A chunk stops one digit short of 64 bits, so the last digit may still fit.
+		if (it + 1 == end && *it != '.')
 		{
-			result *= base;
-			result += it->value;
-			++it;
+			boost::uint64_t digit = isNumericInBase(*it, base);
+			if (result <= (std::numeric_limits<boost::uint64_t>::max() - digit) / base)
+			{
+				result = result * base + digit;
+				++it;
+			}
 		}
 
-		if (it != end && it->type == TOKEN_DECIMAL_POINT) 
+		//Either a fractional part, or more digits than fit in 64 bits.
+		if (it != end)
 		{
-			//Decimal values.
-			Value base(first.value);
-			Value currentBase(first.value);
+			return false;
+		}
+
+		return true;
+	}
+
+	namespace
+	{
+		//Builds the digits up to the next '.' into result, one native chunk at a time, so that a
+		//long literal costs one multiprecision multiply per chunk rather than per digit.
+		const char * integer(const char * it, const char * end, size_t base, Value& result)
+		{
+			boost::uint64_t chunk = 0;
+			boost::uint64_t scale = 0;
+			it = accumulate(it, end, base, chunk, scale);
+			result = chunk;
 
-			++it;
-			while (it != end && it->type == TOKEN_NUMBER)
+			while (it != end && *it != '.')
 			{
-				Value v(it->value);
-				v /= currentBase;
+				it = accumulate(it, end, base, chunk, scale);
+				result *= scale;
+				result += chunk;
+			}
 
-				result += v;
-				currentBase *= base;
-				++it;
+			return it;
+		}
+
+		static const size_t POWER_TABLE_LENGTH = 128;
+
+		//base^-n for every base a literal can be written in. 2^-n and 10^-n both terminate in
+		//decimal, so the entries are exact for as long as they fit in a Value.
+		class InversePowers
+		{
+		public:
+			InversePowers()
+			{
+				const size_t bases[] = { 2, 8, 10, 16 };
+				for (size_t i = 0; i < 4; ++i)
+				{
+					tables[i].resize(POWER_TABLE_LENGTH);
+					tables[i][0] = 1;
+					for (size_t n = 1; n < POWER_TABLE_LENGTH; ++n)
+					{
+						tables[i][n] = tables[i][n - 1];
+						tables[i][n] /= static_cast<unsigned long long>(bases[i]);
+					}
+				}
 			}
+
+			const Value& operator()(size_t base, size_t n) const
+			{
+				assert(n < POWER_TABLE_LENGTH);
+				switch (base)
+				{
+					case 2: return tables[0][n];
+					case 8: return tables[1][n];
+					case 10: return tables[2][n];
+					default: 
+						assert(base == 16);
+						return tables[3][n];
+				}
+			}
+
+		private:
+			std::vector<Value> tables[4];
+		};
+
+		const InversePowers& inversePowers()
+		{
+			static const InversePowers powers;
+			return powers;
+		}
+	}
+
+	Value convert(boost::string_ref digits, size_t base)
+	{
+		const char * it = digits.data();
+		const char * end = digits.data() + digits.size();
+
+		Value result;
+		it = integer(it, end, base, result);
+
+		if (it != end) 
+		{
+			//The fractional digits are read as one integer mantissa, and scaled by base^-digits once.
+			const char * fraction = ++it;
+			Value mantissa;
+			it = integer(it, end, base, mantissa);
+
+			const InversePowers& powers = inversePowers();
+			size_t places = it - fraction;
+			while (places >= POWER_TABLE_LENGTH)
+			{
+				mantissa *= powers(base, POWER_TABLE_LENGTH - 1);
+				places -= POWER_TABLE_LENGTH - 1;
+			}
+
+			mantissa *= powers(base, places);
+			result += mantissa;
 		}
 
-		out = result;
-		return it;
+		return result;
 	}
 
-	TokenStream::const_iterator convertIdentifier(TokenStream::const_iterator begin, TokenStream::const_iterator end, std::string& out)
+	namespace
 	{
-		++begin;
+		//Rounds mantissa * 2^exponent to the nearest T, ties to even. sticky is set if there were 
+		//nonzero bits below the mantissa.
+		template<typename T>
+		T roundBinary(boost::uint64_t mantissa, int exponent, bool sticky)
+		{
+			if (mantissa == 0)
+			{
+				return T(0);
+			}
+
+			while (!(mantissa >> 63))
+			{
+				mantissa <<= 1;
+				--exponent;
+			}
 
-		out.clear();
-		out.reserve(16);
+			//The lowest bit a T can hold, which is higher for subnormals.
+			const int precision = std::numeric_limits<T>::digits;
+			const int lowest = std::numeric_limits<T>::min_exponent - precision;
+			const int keep = std::max(exponent + 63 - (precision - 1), lowest);
+
+			int drop = keep - exponent;
+			if (drop > 64)
+			{
+				return T(0);
+			}
+
+			//The dropped bits, aligned to the top of rest.
+			boost::uint64_t kept = drop == 64 ? 0 : mantissa >> drop;
+			boost::uint64_t rest = drop == 64 ? mantissa : mantissa << (64 - drop);
+
+			bool half = (rest >> 63) != 0;
+			bool above = (rest << 1) != 0 || sticky;
+			if (half && (above || (kept & 1)))
+			{
+				++kept;
+			}
 
-		while (begin != end && begin->type == TOKEN_RAW)
+			return std::ldexp(static_cast<T>(kept), keep);
+		}
+
+		//Every digit in base 2, 8 or 16 is a whole number of bits, so these are rounded exactly.
+		template<typename T>
+		T convertPowerOfTwo(boost::string_ref digits, size_t base)
+		{
+			const int bitsPerDigit = base == 2 ? 1 : (base == 8 ? 3 : 4);
+
+			boost::uint64_t mantissa = 0;
+			int exponent = 0;
+			bool sticky = false;
+			bool fraction = false;
+
+			for (auto it = digits.begin(); it != digits.end(); ++it)
+			{
+				if (*it == '.')
+				{
+					fraction = true;
+					continue;
+				}
+
+				boost::uint64_t digit = isNumericInBase(*it, base);
+				if (mantissa >> (64 - bitsPerDigit))
+				{
+					//No more room, so the digit only matters for rounding.
+					sticky = sticky || digit != 0;
+					exponent += fraction ? 0 : bitsPerDigit;
+				}
+				else
+				{
+					mantissa = (mantissa << bitsPerDigit) | digit;
+					exponent -= fraction ? bitsPerDigit : 0;
+				}
+			}
+
+			return roundBinary<T>(mantissa, exponent, sticky);
+		}
+
+		//The largest mantissa and power of ten that T holds exactly, and T's own correctly rounded parser.
+		template<typename T>
+		struct FastPath;
+
+		template<>
+		struct FastPath<double>
+		{
+			static const boost::uint64_t maximumMantissa = boost::uint64_t(1) << 53;
+			static const size_t maximumPower = 22;
+
+			static double parse(const char * text)
+			{
+				return std::strtod(text, NULL);
+			}
+		};
+
+		template<>
+		struct FastPath<float>
+		{
+			static const boost::uint64_t maximumMantissa = boost::uint64_t(1) << 24;
+			static const size_t maximumPower = 10;
+
+			static float parse(const char * text)
+			{
+				return std::strtof(text, NULL);
+			}
+		};
+
+		const double POWERS_OF_TEN[] = 
 		{
-			out.push_back(static_cast<char>(begin->value));
-			++begin;
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		//When both the significant digits and the power of ten are exact in T, a single division
+		//is correctly rounded (Clinger's fast path). Anything else is handed to strtod or strtof. 
+		template<typename T>
+		T convertDecimal(boost::string_ref digits)
+		{
+			const char * begin = digits.data();
+			const char * end = digits.data() + digits.size();
+			const char * point = std::find(begin, end, '.');
+
+			//Trailing zeros after the point do not change the value.
+			if (point != end)
+			{
+				while (end != point + 1 && *(end - 1) == '0')
+				{
+					--end;
+				}
+
+				if (end == point + 1)
+				{
+					end = point;
+				}
+			}
+
+			boost::uint64_t mantissa = 0;
+			size_t significant = 0;
+			size_t places = 0;
+			for (const char * it = begin; it != end; ++it)
+			{
+				if (*it == '.')
+				{
+					continue;
+				}
+
+				places += it > point ? 1 : 0;
+				if (significant == 0 && *it == '0')
+				{
+					continue;
+				}
+
+				//19 digits always fit in 64 bits.
+				if (++significant <= 19)
+				{
+					mantissa = mantissa * 10 + (*it - '0');
+				}
+			}
+
+			if (significant <= 19 && mantissa <= FastPath<T>::maximumMantissa && places <= FastPath<T>::maximumPower)
+			{
+				return static_cast<T>(mantissa) / static_cast<T>(POWERS_OF_TEN[places]);
+			}
+
+			//Written without a decimal point, so that the locale does not matter.
+			std::string text;
+			text.reserve(end - begin + 8);
+			for (const char * it = begin; it != end; ++it)
+			{
+				if (*it != '.')
+				{
+					text.push_back(*it);
+				}
+			}
+
+			text += "e-" + boost::lexical_cast<std::string>(places);
+			return FastPath<T>::parse(text.c_str());
 		}
+	}
+
+	template<> 
+	Value convertAs<Value>(boost::string_ref digits, size_t base)
+	{
+		return convert(digits, base);
+	}
+
+	template<> 
+	double convertAs<double>(boost::string_ref digits, size_t base)
+	{
+		return base == 10 ? convertDecimal<double>(digits) : convertPowerOfTwo<double>(digits, base);
+	}
+
+	template<> 
+	float convertAs<float>(boost::string_ref digits, size_t base)
+	{
+		return base == 10 ? convertDecimal<float>(digits) : convertPowerOfTwo<float>(digits, base);
+	}
+
+	Value exactValue(double d)
+	{
+		int exponent = 0;
+		double fraction = std::frexp(d, &exponent);
 
-		return begin;
+		const int digits = std::numeric_limits<double>::digits;
+		boost::int64_t mantissa = static_cast<boost::int64_t>(std::ldexp(fraction, digits));
+		return Value(mantissa) * Value(Value::backend_type::pow2(exponent - digits));
 	}
 
-	TokenStream::const_iterator convertString(TokenStream::const_iterator begin, TokenStream::const_iterator end, std::string& out)
+	std::string convertString(boost::string_ref body)
 	{
-		return convertIdentifier(begin, end, out);
+		std::string out;
+		out.reserve(body.size());
+
+		for (auto it = body.begin(); it != body.end(); ++it)
+		{
+			//The parser has already rejected anything but \` and \\.
+			if (*it == '\\' && it + 1 != body.end())
+			{
+				++it;
+			}
+
+			out.push_back(*it);
+		}
+
+		return out;
 	}
-}
\ No newline at end of file
+}
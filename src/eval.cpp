@@ -1,51 +1,43 @@
 #include "eval.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <vector>
 #include <boost/utility.hpp>
 
 #include "evalutils.hpp"
 #include "function.hpp"
+#include "tables.hpp"
 
 namespace Represent
 {
+#ifdef REPRESENT_COUNT_COPIES
+	std::atomic<size_t> cellCopies(0);
+#endif
+
 	namespace
 	{
-		//Define some operator values.
+		const boost::uint32_t UNLINKED = std::numeric_limits<boost::uint32_t>::max();
+
 		size_t power(boost::uint32_t op)
 		{
-			switch(op)
+			const OperatorEntry * entry = operatorLookup(op);
+			if (!entry)
 			{
-				case OPERATOR_PLUS: 
-				case OPERATOR_MINUS: 
-					return 10;
-
-				case OPERATOR_DIVIDE:
-				case OPERATOR_MULTIPLY:
-					return 20;
-
-				case OPERATOR_UNARY_PLUS:
-				case OPERATOR_UNARY_MINUS: 
-					return 90;
-
-				default:
-					std::cout << "Unrecognized operator: " << op;
-					return 0;
+				std::cout << "Unrecognized operator: " << op;
+				return 0;
 			}
+
+			return entry->power;
 		}
 
 		//0 is left, 1 is right
 		size_t assoc(boost::uint32_t op)
 		{
-			switch(op)
-			{
-				case OPERATOR_UNARY_PLUS:
-				case OPERATOR_UNARY_MINUS:
-					return 1;
-					
-				default: 
-					return 0;
-			}
+			const OperatorEntry * entry = operatorLookup(op);
+			return entry ? entry->assoc : 0;
 		}
 
 		bool typeCheck(const StorageCell& first, const StorageCell& second)
@@ -85,6 +77,7 @@ namespace Represent
 	{}
 
 	EvaluationContext::EvaluationContext(const std::string& value)
+		:programDirty(true)
 	{
 		load(value);
 	}
@@ -94,7 +87,289 @@ namespace Represent
 		TokenStream raw = parse(value);
 
 		//Run a simplification pass on the raw token stream, converting numbers into TOKEN_STACK_REFERENCEs.
-		stream = simplify(raw, storage, identifiers);
+		stream = simplify(raw, storage, literals, identifiers);
+		programDirty = true;
+		link();
+	}
+
+	boost::uint32_t EvaluationContext::resolve(boost::uint32_t slot)
+	{
+		if (slot >= links.size())
+		{
+			return slot;
+		}
+
+		if (links[slot] == UNLINKED)
+		{
+			//ERROR.
+			throw 42;
+		}
+
+		return links[slot];
+	}
+
+	void EvaluationContext::link()
+	{
+		links.resize(storage.size());
+		for (boost::uint32_t i = 0; i < links.size(); ++i)
+		{
+			//A chain longer than the storage is a cycle.
+			boost::uint32_t slot = i;
+			size_t steps = 0;
+
+			const Identifier * ident = boost::get<Identifier>(&storage[slot]);
+			while (ident && slot != UNLINKED)
+			{
+				auto it = identifiers.find(ident->name);
+				slot = it == identifiers.end() || ++steps > storage.size() ? UNLINKED : it->second;
+				ident = slot == UNLINKED ? NULL : boost::get<Identifier>(&storage[slot]);
+			}
+
+			links[i] = slot;
+		}
+	}
+
+	const Program& EvaluationContext::batchProgram()
+	{
+		const Program& result = compiled();
+		if (result.bytecode.resultType != CELL_SCALAR && result.bytecode.resultType != CELL_DYNAMIC)
+		{
+			throw "Batch results must be scalars";
+		}
+
+		return result;
+	}
+
+	boost::uint32_t EvaluationContext::batchSlot(const std::string& name)
+	{
+		auto it = identifiers.find(name);
+		if (it == identifiers.end() || boost::get<Null>(&storage.at(resolve(it->second))))
+		{
+			define(name, Value(0));
+		}
+
+		boost::uint32_t slot = resolve(identifiers[name]);
+		if (!boost::get<Value>(&storage.at(slot)))
+		{
+			throw "Batch inputs must be scalars";
+		}
+
+		return slot;
+	}
+
+	const Program& EvaluationContext::compiled()
+	{
+		if (!programDirty)
+		{
+			return program;
+		}
+
+		program.rpn = shuntingYard(stream);
+		program.slots.clear();
+
+		//Point every reference at the slot holding the value, rather than at an Identifier.
+		for (auto it = program.rpn.begin(); it != program.rpn.end(); ++it)
+		{
+			if (it->type == TOKEN_STORAGE_REFERENCE || it->type == TOKEN_FUNCTION_IDENTIFIER)
+			{
+				it->value = resolve(it->value);
+			}
+		}
+
+		//Folding evaluates the constants, so ill typed ones are rejected before they are folded.
+		infer(program.rpn, slotInfo());
+
+		std::vector<Constant> previous;
+		previous.swap(program.constants);
+		program.rpn = fold(program.rpn, previous);
+
+		for (auto it = program.rpn.begin(); it != program.rpn.end(); ++it)
+		{
+			if (it->type == TOKEN_STORAGE_REFERENCE || it->type == TOKEN_FUNCTION_IDENTIFIER)
+			{
+				program.slots.push_back(it->value);
+			}
+		}
+
+		std::sort(program.slots.begin(), program.slots.end());
+		program.slots.erase(std::unique(program.slots.begin(), program.slots.end()), program.slots.end());
+
+		//Slot types cannot change without recompiling, so the bytecode can rely on them.
+		program.bytecode = compile(program.rpn, slotInfo());
+		program.deduplicated += program.bytecode.deduplicated;
+
+		programDirty = false;
+		return program;
+	}
+
+	std::vector<SlotInfo> EvaluationContext::slotInfo() const
+	{
+		std::vector<SlotInfo> slots(storage.size());
+		for (size_t i = 0; i < storage.size(); ++i)
+		{
+			const Function * function = boost::get<Function>(&storage[i]);
+
+			slots[i].type = static_cast<CellType>(storage[i].which());
+			slots[i].pure = function && function->backing->pure();
+		}
+
+		return slots;
+	}
+
+#define UNFOLD(r, data, T) \
+		typed(static_cast<T *>(NULL)).folded = false;
+
+	TokenStream EvaluationContext::fold(const TokenStream& rpn, std::vector<Constant>& previous)
+	{
+		//Slots that define() can change. Every other slot holds a constant.
+		std::vector<bool> named(storage.size());
+		for (auto it = identifiers.begin(); it != identifiers.end(); ++it)
+		{
+			named[it->second] = true;
+		}
+
+		//The tokens of each operand on the evaluation stack begin at start.
+		struct Node
+		{
+			size_t start;
+			bool constant;
+		};
+
+		std::vector<Token> tokens;
+		std::vector<Node> nodes;
+
+		boost::unordered_map<std::pair<std::string, boost::uint32_t>, boost::uint32_t> literalIds;
+		boost::unordered_map<std::string, boost::uint32_t> stringIds;
+		boost::unordered_map<std::vector<boost::uint32_t>, boost::uint32_t> constantIds;
+		program.deduplicated = 0;
+
+		//Folds the tokens of the constant nodes from first on, last first so that the earlier 
+		//nodes still begin where they did.
+		auto foldNodes = [&](size_t first)
+		{
+			for (size_t i = nodes.size(); i-- > first;)
+			{
+				size_t begin = nodes[i].start;
+				size_t end = i + 1 < nodes.size() ? nodes[i + 1].start : tokens.size();
+
+				//A lone load has nothing to fold.
+				if (!nodes[i].constant || end - begin == 1)
+				{
+					continue;
+				}
+
+				std::vector<boost::uint32_t> key;
+				for (size_t t = begin; t < end; ++t)
+				{
+					key.push_back(tokens[t].type);
+					key.push_back(tokens[t].value);
+					key.push_back(tokens[t].extra);
+				}
+
+				auto found = constantIds.find(key);
+				if (found != constantIds.end())
+				{
+					//All but the reference, which the bytecode shares in turn.
+					program.deduplicated += end - begin - 1;
+
+					tokens.erase(tokens.begin() + begin + 1, tokens.begin() + end);
+					tokens[begin] = Token(TOKEN_STORAGE_REFERENCE, found->second);
+					continue;
+				}
+
+				Constant constant;
+				for (size_t t = begin; t < end; ++t)
+				{
+					constant.rpn.push(tokens[t]);
+				}
+
+				if (previous.empty())
+				{
+					constant.slot = storage.size();
+					storage.push_back(Null());
+				}
+				else
+				{
+					constant.slot = previous.back().slot;
+					previous.pop_back();
+				}
+
+				//The Value is folded now, since its type decides how the constant is compiled.
+				storage[constant.slot] = StorageConvert<StorageCell, Value>::convert(runOnStack<Value>(constant.rpn));
+				refresh<Value>(constant.slot);
+				program.constants.push_back(constant);
+				constantIds[key] = constant.slot;
+
+				tokens.erase(tokens.begin() + begin + 1, tokens.begin() + end);
+				tokens[begin] = Token(TOKEN_STORAGE_REFERENCE, constant.slot);
+			}
+		};
+
+		for (auto it = rpn.begin(); it != rpn.end(); ++it)
+		{
+			Token tk = *it;
+			size_t count = operandCount(tk);
+			bool constant = true;
+
+			//Identical literals and strings are the same leaf.
+			if (tk.type == TOKEN_LITERAL_REFERENCE)
+			{
+				const Literal& literal = literals[tk.value];
+				tk.value = literalIds.insert(std::make_pair(std::make_pair(literal.digits, literal.base), tk.value)).first->second;
+			}
+			else if (tk.type == TOKEN_STORAGE_REFERENCE)
+			{
+				constant = !named[tk.value];
+
+				Boxed<std::string> * str = boost::get<Boxed<std::string> >(&storage[tk.value]);
+				if (constant && str)
+				{
+					tk.value = stringIds.insert(std::make_pair(**str, tk.value)).first->second;
+				}
+			}
+			else if (tk.type == TOKEN_FUNCTION_IDENTIFIER)
+			{
+				Function * function = boost::get<Function>(&storage[tk.value]);
+				constant = function && function->backing->pure();
+			}
+
+			if (nodes.size() < count)
+			{
+				throw "Not enough operands";
+			}
+
+			size_t first = nodes.size() - count;
+			for (size_t i = first; i < nodes.size(); ++i)
+			{
+				constant = constant && nodes[i].constant;
+			}
+
+			//Only the largest constant subtrees are folded, once they meet something that is not.
+			if (!constant)
+			{
+				foldNodes(first);
+			}
+
+			Node node = { count ? nodes[first].start : tokens.size(), constant };
+			nodes.resize(first);
+			nodes.push_back(node);
+			tokens.push_back(tk);
+		}
+
+		foldNodes(0);
+
+		//Constants are folded in other precisions as they are first evaluated in them.
+		BOOST_PP_SEQ_FOR_EACH(UNFOLD, _, NUMBER_TYPES)
+		typed(static_cast<Value *>(NULL)).folded = true;
+
+		TokenStream result;
+		result.reserve(tokens.size());
+		for (auto it = tokens.begin(); it != tokens.end(); ++it)
+		{
+			result.push(*it);
+		}
+
+		return result;
 	}
 
 	void EvaluationContext::dumpState()
@@ -107,6 +382,12 @@ namespace Represent
 			std::cout << "\n";
 		}
 
+		std::cout << "Literals ===================\n";
+		for (size_t i = 0; i < literals.size(); ++i)
+		{
+			std::cout << i << "\t" << literals[i].digits << " (base " << literals[i].base << ")\n";
+		}
+
 		std::cout << "Identifiers ================\n";
 		for (auto it = identifiers.begin(); it != identifiers.end(); ++it)
 		{
@@ -121,16 +402,38 @@ namespace Represent
 
 		try
 		{
-			TokenStream rpn = shuntingYard(stream);
+			const TokenStream& rpn = compiled().rpn;
 			std::cout << "RPN ========================\n";
 			for (auto it = rpn.begin(); it != rpn.end(); ++it)
 			{
 				std::cout << *it << "\n";
 			}
+
+			const std::vector<Constant>& constants = compiled().constants;
+			std::cout << "Constants ==================\n";
+			for (auto it = constants.begin(); it != constants.end(); ++it)
+			{
+				std::cout << it->slot << "\t";
+				for (auto tk = it->rpn.begin(); tk != it->rpn.end(); ++tk)
+				{
+					std::cout << *tk << " ";
+				}
+				std::cout << "\n";
+			}
+
+			const Bytecode& bytecode = compiled().bytecode;
+			std::cout << "Bytecode (" << bytecode.registers << " registers, " << compiled().deduplicated << " nodes deduplicated) ==\n";
+			for (auto it = bytecode.code.begin(); it != bytecode.code.end(); ++it)
+			{
+				std::cout << *it << "\n";
+			}
 		} catch (...)
 		{}
 	}
 
+#define REFRESH(r, slot, T) \
+		refresh<T>(slot);
+
 	void EvaluationContext::define(const std::string& name, const StorageCell& cell)
 	{
 		auto it = identifiers.find(name);
@@ -147,9 +450,18 @@ namespace Represent
 			}
 
 			identifiers[name] = index;
+
+			//An alias may name what was undefined until now.
+			link();
 		} else {
 			if (typeCheck(storage.at(it->second), cell))
 			{
+				bool alias = boost::get<Identifier>(&storage.at(it->second)) || boost::get<Identifier>(&cell);
+
+				//Programs resolve identifiers by type, and fold calls to pure functions, so they must 
+				//be recompiled if either changes, or if a reference is linked to another slot.
+				programDirty = programDirty || storage.at(it->second).which() != cell.which() || 
+					boost::get<Function>(&cell) || alias;
 				storage.at(it->second) = cell;
 
 				//Hack to set the function name.
@@ -158,6 +470,13 @@ namespace Represent
 				{
 					maybe->name = name;
 				}
+
+				BOOST_PP_SEQ_FOR_EACH(REFRESH, it->second, NUMBER_TYPES)
+
+				if (alias)
+				{
+					link();
+				}
 			} 
 			else
 			{
@@ -167,8 +486,491 @@ namespace Represent
 		}
 	}
 
+	void EvaluationContext::prepare()
+	{
+		//Integer falls back to Value, whose storage is then only read.
+		prepared<Value>(compiled());
+	}
+
+	size_t EvaluationContext::deduplicated()
+	{
+		return compiled().deduplicated;
+	}
+
+	namespace
+	{
+		//The part of a shadowed cell in one precision.
+		template<typename T>
+		struct ShadowProjection
+			: public boost::static_visitor<typename Storage<T>::type>
+		{
+			typedef typename Storage<T>::type Cell;
+
+			Cell operator()(const Shadow& s) const
+			{
+				return shadowPart<T>(s);
+			}
+
+			Cell operator()(const Math::Vector4<Shadow>& v) const
+			{
+				return Math::Vector4<T>(shadowPart<T>(v[0]), shadowPart<T>(v[1]), shadowPart<T>(v[2]), shadowPart<T>(v[3]));
+			}
+
+			Cell operator()(const Math::Quaternion<Shadow>& q) const
+			{
+				Math::Quaternion<T> result;
+				result.w = shadowPart<T>(q.w);
+				result.x = shadowPart<T>(q.x);
+				result.y = shadowPart<T>(q.y);
+				result.z = shadowPart<T>(q.z);
+				return result;
+			}
+
+			Cell operator()(const Boxed<Math::Matrix4<Shadow> >& m) const
+			{
+				Math::Matrix4<T> result;
+				for (size_t i = 0; i < 16; ++i)
+				{
+					result(i / 4, i % 4) = shadowPart<T>((*m)(i / 4, i % 4));
+				}
+				return result;
+			}
+
+			Cell operator()(const Boxed<Array<Shadow> >& a) const
+			{
+				Array<T> result;
+				for (auto it = a->begin(); it != a->end(); ++it)
+				{
+					result.push_back(boost::apply_visitor(*this, *it));
+				}
+				return result;
+			}
+
+			template<typename U>
+			Cell operator()(const U& u) const
+			{
+				return u;
+			}
+		};
+
+		template<typename T>
+		StorageCell project(const StorageCells& cell)
+		{
+			return StorageConvert<StorageCell, Value>::convert(boost::apply_visitor(ShadowProjection<T>(), cell));
+		}
+
+		//Records the operators whose double or float part strays too far from the Value part. A
+		//cell of several numbers strays as far as its furthest.
+		struct ShadowObserver
+			: public boost::static_visitor<>
+		{
+			ShadowObserver(boost::uint64_t ulps, std::vector<Divergence>& divergences)
+				:ulps(ulps)
+				,divergences(&divergences)
+			{}
+
+			void operator()(const Token& tk, const StorageCells& cell)
+			{
+				doubleUlps = 0;
+				floatUlps = 0;
+				boost::apply_visitor(*this, cell);
+
+				if (doubleUlps > ulps || floatUlps > ulps)
+				{
+					Divergence divergence = { tk, doubleUlps, floatUlps };
+					divergences->push_back(divergence);
+				}
+			}
+
+			void operator()(const Shadow& s)
+			{
+				doubleUlps = std::max(doubleUlps, Represent::doubleUlps(s));
+				floatUlps = std::max(floatUlps, Represent::floatUlps(s));
+			}
+
+			void operator()(const Math::Vector4<Shadow>& v)
+			{
+				(*this)(v[0]); (*this)(v[1]); (*this)(v[2]); (*this)(v[3]);
+			}
+
+			void operator()(const Math::Quaternion<Shadow>& q)
+			{
+				(*this)(q.w); (*this)(q.x); (*this)(q.y); (*this)(q.z);
+			}
+
+			void operator()(const Boxed<Math::Matrix4<Shadow> >& m)
+			{
+				for (size_t i = 0; i < 16; ++i)
+				{
+					(*this)((*m)(i / 4, i % 4));
+				}
+			}
+
+			void operator()(const Boxed<Array<Shadow> >& a)
+			{
+				for (auto it = a->begin(); it != a->end(); ++it)
+				{
+					boost::apply_visitor(*this, *it);
+				}
+			}
+
+			template<typename U>
+			void operator()(const U&)
+			{}
+
+			boost::uint64_t ulps;
+			std::vector<Divergence> * divergences;
+
+			boost::uint64_t doubleUlps;
+			boost::uint64_t floatUlps;
+		};
+	}
+
+	ShadowReport EvaluationContext::evaluateShadow(boost::uint64_t ulps)
+	{
+		const Program& program = compiled();
+
+		ShadowReport report;
+		ShadowObserver observer(ulps, report.divergences);
+
+		TypedStorage<Shadow>& typed = typedStorage<Shadow>();
+		for (auto it = program.constants.begin(); it != program.constants.end(); ++it)
+		{
+			typed.cells[it->slot] = runOnStack<Shadow>(it->rpn, observer);
+		}
+		typed.folded = true;
+
+		StorageCells result = runOnStack<Shadow>(program.rpn, observer);
+		report.full = project<Value>(result);
+		report.dbl = project<double>(result);
+		report.flt = project<float>(result);
+
+		return report;
+	}
+
+	namespace
+	{
+		Value toValue(double d)
+		{
+			return std::isfinite(d) ? exactValue(d) : Value(d);
+		}
+
+		const Value& toValue(const Value& v)
+		{
+			return v;
+		}
+
+		//The midpoint of each interval in a cell, keeping the furthest an exact result can be
+		//from its midpoint in bound.
+		template<typename T>
+		struct Midpoint
+			: public boost::static_visitor<StorageCell>
+		{
+			explicit Midpoint(Value& bound)
+				:bound(&bound)
+			{}
+
+			Value midpoint(const Interval<T>& i) const
+			{
+				Value lo = toValue(i.lo);
+				Value hi = toValue(i.hi);
+				Value result = (lo + hi) / 2;
+
+				//Anything that is not a number stays, since no tolerance can accept it.
+				Value distance = std::max(hi - result, result - lo);
+				if (!(distance <= *bound) && *bound == *bound)
+				{
+					*bound = distance;
+				}
+
+				return result;
+			}
+
+			StorageCell operator()(const Interval<T>& i) const
+			{
+				return midpoint(i);
+			}
+
+			StorageCell operator()(const Math::Vector4<Interval<T> >& v) const
+			{
+				return Math::Vector4<Value>(midpoint(v[0]), midpoint(v[1]), midpoint(v[2]), midpoint(v[3]));
+			}
+
+			StorageCell operator()(const Math::Quaternion<Interval<T> >& q) const
+			{
+				Math::Quaternion<Value> result;
+				result.w = midpoint(q.w);
+				result.x = midpoint(q.x);
+				result.y = midpoint(q.y);
+				result.z = midpoint(q.z);
+				return result;
+			}
+
+			StorageCell operator()(const Boxed<Math::Matrix4<Interval<T> > >& m) const
+			{
+				Math::Matrix4<Value> result;
+				for (size_t i = 0; i < 16; ++i)
+				{
+					result(i / 4, i % 4) = midpoint((*m)(i / 4, i % 4));
+				}
+				return result;
+			}
+
+			StorageCell operator()(const Boxed<Array<Interval<T> > >& a) const
+			{
+				Array<Value> result;
+				for (auto it = a->begin(); it != a->end(); ++it)
+				{
+					result.push_back(boost::apply_visitor(*this, *it));
+				}
+				return result;
+			}
+
+			template<typename U>
+			StorageCell operator()(const U& u) const
+			{
+				return u;
+			}
+
+			Value * bound;
+		};
+
+		//Whether the midpoints of cell are within tolerance of the exact result.
+		template<typename T>
+		bool settle(const typename Storage<Interval<T> >::type& cell, const Value& tolerance, AdaptiveResult& result)
+		{
+			result.bound = 0;
+			result.value = boost::apply_visitor(Midpoint<T>(result.bound), cell);
+			result.proven = result.bound <= tolerance;
+
+			return result.proven;
+		}
+
+		//Keeps the interval each operator and function call leaves, by its index in the RPN.
+		struct IntervalRecorder
+		{
+			IntervalRecorder(const TokenStream& rpn, std::vector<StorageCelldi>& intervals)
+				:first(&*rpn.begin())
+				,intervals(&intervals)
+			{}
+
+			void operator()(const Token& tk, const StorageCelldi& cell)
+			{
+				(*intervals)[&tk - first] = cell;
+			}
+
+			const Token * first;
+			std::vector<StorageCelldi> * intervals;
+		};
+
+		bool narrow(const Interval<double>& i, const Value& tolerance)
+		{
+			return std::isfinite(i.lo) && std::isfinite(i.hi) && exactValue(i.hi) - exactValue(i.lo) <= tolerance;
+		}
+	}
+
+	AdaptiveResult EvaluationContext::evaluateAdaptive(const Value& tolerance)
+	{
+		const Program& program = compiled();
+
+		AdaptiveResult result;
+		result.escalated = 0;
+
+		prepared<Interval<double> >(program);
+		if (settle<double>(runOnStack<Interval<double> >(program.rpn), tolerance, result))
+		{
+			return result;
+		}
+
+		//Again, keeping the interval of every operator, to find the ones that are too wide.
+		std::vector<StorageCelldi> intervals(program.rpn.end() - program.rpn.begin(), Null());
+		IntervalRecorder recorder(program.rpn, intervals);
+		runOnStack<Interval<double> >(program.rpn, recorder);
+
+		TypedStorage<Interval<Value> >& typed = prepared<Interval<Value> >(program);
+		std::vector<Interval<Value> > reused;
+		TokenStream rpn = escalate(program.rpn, intervals, tolerance, reused, result.escalated);
+
+		//The reused intervals are literals only for this evaluation.
+		typed.literals.insert(typed.literals.end(), reused.begin(), reused.end());
+
+		StorageCellvi escalated;
+		try
+		{
+			escalated = runOnStack<Interval<Value> >(rpn);
+		}
+		catch (...)
+		{
+			typed.literals.resize(literals.size());
+			throw;
+		}
+
+		typed.literals.resize(literals.size());
+		if (settle<Value>(escalated, tolerance, result) || reused.empty())
+		{
+			return result;
+		}
+
+		//The reused intervals were too wide for this expression after all. With a negative
+		//tolerance nothing is reused.
+		escalate(program.rpn, intervals, Value(-1), reused, result.escalated);
+		settle<Value>(runOnStack<Interval<Value> >(program.rpn), tolerance, result);
+
+		return result;
+	}
+
+	namespace
+	{
+		//The Value of each Integer in a cell, clearing valid if any is not valid.
+		struct IntegerResult
+			: public boost::static_visitor<StorageCell>
+		{
+			explicit IntegerResult(bool& valid)
+				:valid(&valid)
+			{}
+
+			Value value(const Integer& i) const
+			{
+				*valid = *valid && i.valid;
+				return Value(i.value);
+			}
+
+			StorageCell operator()(const Integer& i) const
+			{
+				return value(i);
+			}
+
+			StorageCell operator()(const Math::Vector4<Integer>& v) const
+			{
+				return Math::Vector4<Value>(value(v[0]), value(v[1]), value(v[2]), value(v[3]));
+			}
+
+			StorageCell operator()(const Math::Quaternion<Integer>& q) const
+			{
+				Math::Quaternion<Value> result;
+				result.w = value(q.w);
+				result.x = value(q.x);
+				result.y = value(q.y);
+				result.z = value(q.z);
+				return result;
+			}
+
+			StorageCell operator()(const Boxed<Math::Matrix4<Integer> >& m) const
+			{
+				Math::Matrix4<Value> result;
+				for (size_t i = 0; i < 16; ++i)
+				{
+					result(i / 4, i % 4) = value((*m)(i / 4, i % 4));
+				}
+				return result;
+			}
+
+			StorageCell operator()(const Boxed<Array<Integer> >& a) const
+			{
+				Array<Value> result;
+				for (auto it = a->begin(); it != a->end(); ++it)
+				{
+					result.push_back(boost::apply_visitor(*this, *it));
+				}
+				return result;
+			}
+
+			template<typename U>
+			StorageCell operator()(const U& u) const
+			{
+				return u;
+			}
+
+			bool * valid;
+		};
+	}
+
+	StorageCell EvaluationContext::evaluateInteger()
+	{
+		const Program& program = compiled();
+
+		bool valid = true;
+		StorageCell result = boost::apply_visitor(IntegerResult(valid), run<Integer>(program));
+		if (valid)
+		{
+			return result;
+		}
+
+		//An evaluation in Value may be running on another thread, so the fallback only reads 
+		//the Value storage, and has registers of its own.
+		const TypedStorage<Value>& typed = prepared<Value>(program);
+		TypedStorage<Value> scratch;
+		scratch.cells = typed.cells;
+		scratch.literals = typed.literals;
+		scratch.folded = true;
+
+		return StorageConvert<StorageCell, Value>::convert(run<Value>(program.bytecode, scratch));
+	}
+
+	TokenStream EvaluationContext::escalate(const TokenStream& rpn, const std::vector<StorageCelldi>& intervals, const Value& tolerance,
+		std::vector<Interval<Value> >& reused, size_t& escalated)
+	{
+		std::vector<Token> tokens(rpn.begin(), rpn.end());
+		const size_t NONE = tokens.size();
+
+		//Where the largest subtree that can be reused, of those beginning at each token, ends.
+		std::vector<size_t> ends(tokens.size(), NONE);
+
+		//The first token of each operand on the evaluation stack.
+		std::vector<size_t> starts;
+		for (size_t i = 0; i < tokens.size(); ++i)
+		{
+			size_t count = operandCount(tokens[i]);
+			size_t start = count ? starts[starts.size() - count] : i;
+
+			starts.resize(starts.size() - count);
+			starts.push_back(start);
+
+			//Later subtrees beginning at the same token hold the earlier ones.
+			const Interval<double> * interval = boost::get<Interval<double> >(&intervals[i]);
+			if (interval && narrow(*interval, tolerance))
+			{
+				ends[start] = i;
+			}
+		}
+
+		TokenStream result(rpn.getSource());
+		escalated = 0;
+
+		for (size_t i = 0; i < tokens.size(); ++i)
+		{
+			if (ends[i] != NONE)
+			{
+				const Interval<double>& interval = boost::get<Interval<double> >(intervals[ends[i]]);
+
+				Token tk(TOKEN_LITERAL_REFERENCE, static_cast<boost::uint32_t>(literals.size() + reused.size()));
+				tk.offset = tokens[ends[i]].offset;
+				result.push(tk);
+
+				reused.push_back(Interval<Value>(exactValue(interval.lo), exactValue(interval.hi)));
+				i = ends[i];
+				continue;
+			}
+
+			if (tokens[i].type == TOKEN_OPERATOR || tokens[i].type == TOKEN_FUNCTION_IDENTIFIER)
+			{
+				++escalated;
+			}
+
+			result.push(tokens[i]);
+		}
+
+		return result;
+	}
+
 	StorageCell& EvaluationContext::lookup(StorageCell& cell)
 	{
+		//A slot of this context is already linked.
+		if (!storage.empty() && &cell >= &storage.front() && &cell <= &storage.back())
+		{
+			return storage.at(resolve(static_cast<boost::uint32_t>(&cell - &storage.front())));
+		}
+
 		Identifier * tryIdent = boost::get<Identifier>(&cell);
 		if (tryIdent)
 		{
@@ -201,9 +1003,7 @@ namespace Represent
 
 	StorageCell EvaluationContext::evaluate()
 	{
-		//Convert to an RPN representation.
-		TokenStream rpn = shuntingYard(stream);
-		return evaluateWith<Value>(rpn);
+		return execute<Value>(compiled());
 	}
 
 	StorageCell evaluate(const std::string& val)
@@ -212,6 +1012,17 @@ namespace Represent
 		return context.evaluate();
 	}
 
+	std::vector<StorageCell> evaluateAll(const std::vector<std::string>& texts, ThreadPool& pool)
+	{
+		std::vector<StorageCell> results(texts.size());
+		pool.run(texts.size(), [&](size_t task, size_t)
+		{
+			results[task] = evaluate(texts[task]);
+		});
+
+		return results;
+	}
+
 	TokenStream shuntingYard(const TokenStream& stream)
 	{
 		TokenStream rpn;
@@ -225,6 +1036,7 @@ namespace Represent
 			{
 				case TOKEN_RAW_VALUE:
 				case TOKEN_STORAGE_REFERENCE:
+				case TOKEN_LITERAL_REFERENCE:
 				{
 					rpn.push(*it);
 					break;
@@ -368,7 +1180,7 @@ namespace Represent
 	//This takes in a stream of raw tokens, and then converts things like
 	//numbers, identifiers and functions into single tokens so its easier to convert
 	//to RPN later on.
-	TokenStream simplify(const TokenStream& stream, std::vector<StorageCell>& storage, boost::unordered_map<std::string, boost::uint32_t>& identifiers)
+	TokenStream simplify(const TokenStream& stream, std::vector<StorageCell>& storage, std::vector<Literal>& literals, boost::unordered_map<std::string, boost::uint32_t>& identifiers)
 	{
 		TokenStream result;
 
@@ -379,31 +1191,30 @@ namespace Represent
 		{
 			switch (it->type)
 			{
-				//If its a TOKEN_BASE_FLAG, then what follows is a series of numbers
-				//which represents a number. Convert it, and push a TOKEN_STORAGE_REFERENCE instead.
-				case TOKEN_BASE_FLAG: 
+				//A TOKEN_NUMBER spans the digits of a number. Small integers become a TOKEN_RAW_VALUE, 
+				//anything else is kept as a Literal and pushed as a TOKEN_LITERAL_REFERENCE.
+				case TOKEN_NUMBER: 
 				{
-					boost::uint32_t index = storage.size();
-
-					Value value; 
-					it = convert(it, stream.end(), value);
+					boost::string_ref digits = stream.lexeme(*it);
+					size_t base = it->extra;
+					++it;
 
 					//This is ok, since all values are positive here.
 					//All negative numbers are some positive number with operator- applied to it.
-					double trySimpleStorage = value.convert_to<double>();
-					if (floor(trySimpleStorage) == trySimpleStorage &&
-						trySimpleStorage < std::numeric_limits<boost::uint32_t>::max() &&
-						trySimpleStorage > 0)
-					{
-						boost::uint32_t value = static_cast<boost::uint32_t>(trySimpleStorage);;
-						result.push(Token(TOKEN_RAW_VALUE, value));
-					} 
-					else 
+					boost::uint64_t integer = 0;
+					if (convertInteger(digits, base, integer) && 
+						integer > 0 && integer < std::numeric_limits<boost::uint32_t>::max())
 					{
-						storage.push_back(value);
-						result.push(Token(TOKEN_STORAGE_REFERENCE, index));
+						result.push(Token(TOKEN_RAW_VALUE, static_cast<boost::uint32_t>(integer)));
+						break;
 					}
 
+					Literal literal;
+					literal.digits = digits.to_string();
+					literal.base = base;
+
+					result.push(Token(TOKEN_LITERAL_REFERENCE, literals.size()));
+					literals.push_back(literal);
 					break;
 				}
 
@@ -411,8 +1222,12 @@ namespace Represent
 				{
 					size_t arity = it->value;
 
+					//The function name follows as a TOKEN_IDENTIFIER_RAW.
+					++it;
+
 					Identifier ident;
-					it = convertIdentifier(boost::next(it, 1), stream.end(), ident.name);
+					ident.name = stream.lexeme(*it).to_string();
+					++it;
 
 					auto lookup = identifiers.find(ident.name);
 					if (lookup == identifiers.end())
@@ -441,12 +1256,13 @@ namespace Represent
 					break;
 				}
 
-				//Similarly, for a TOKEN_IDENTIFIER_RAW, what follows is a series of characters.
+				//Similarly, a TOKEN_IDENTIFIER_RAW spans the characters of a name.
 				//Convert to a string, and push it as a TOKEN_STORAGE_REFERENCE 
 				case TOKEN_IDENTIFIER_RAW:
 				{
 					Identifier ident;
-					it = convertIdentifier(it, stream.end(), ident.name);
+					ident.name = stream.lexeme(*it).to_string();
+					++it;
 
 					auto lookup = identifiers.find(ident.name);
 					if (lookup == identifiers.end())
@@ -475,11 +1291,11 @@ namespace Represent
 					break;
 				}
 
-				case TOKEN_STRING_START:
+				case TOKEN_STRING:
 				{
-					//Convert the iterator length into a string.
-					std::string str;
-					it = convertString(it, stream.end(), str);
+					//Convert the span into a string, removing escapes.
+					std::string str = convertString(stream.lexeme(*it));
+					++it;
 
 					boost::uint32_t index = storage.size();
 					storage.push_back(str);
@@ -1,6 +1,8 @@
 #include "evalutils.hpp"
 #include "token.hpp"
 
+#include <sstream>
+
 namespace Represent
 {
 	void OutputCell::operator() (const Null& n) const
@@ -17,4 +19,23 @@ namespace Represent
 	{
 		std::cout << "Function[" << f.name << "]";
 	}
-}
\ No newline at end of file
+
+	namespace Detail
+	{
+		void invalidArguments(boost::uint32_t op, int a, int b)
+		{
+			const OperatorEntry * entry = operatorLookup(op);
+
+			std::ostringstream message;
+			message << "Invalid arguments to " << (entry ? entry->string : "operator") << ": " << 
+				cellTypeName(static_cast<CellType>(a)) << " and " << cellTypeName(static_cast<CellType>(b));
+
+			throw InvalidArguments(message.str());
+		}
+	}
+
+	CellType binaryType(boost::uint32_t op, CellType a, CellType b)
+	{
+		return Detail::BinaryTable<Value, StorageCell>::types[op][a][b];
+	}
+}
@@ -0,0 +1,41 @@
+#include "integer.hpp"
+
+namespace Represent
+{
+	std::ostream& operator<<(std::ostream& o, const Integer& i)
+	{
+		if (i.valid)
+		{
+			o << i.value;
+		}
+		else
+		{
+			o << "invalid";
+		}
+
+		return o;
+	}
+
+	Integer convertValue(const Value& v, Integer *)
+	{
+		if (!(floor(v) == v && v >= std::numeric_limits<boost::int64_t>::min() && v <= std::numeric_limits<boost::int64_t>::max()))
+		{
+			return Integer(0, false);
+		}
+
+		return Integer(v.convert_to<boost::int64_t>(), true);
+	}
+
+	template<>
+	Integer convertAs<Integer>(boost::string_ref digits, size_t base)
+	{
+		boost::uint64_t result;
+		if (convertInteger(digits, base, result))
+		{
+			return Integer(result);
+		}
+
+		//Too many digits, or a fraction that may still be whole, as in 2.0.
+		return convertValue(convert(digits, base), static_cast<Integer *>(NULL));
+	}
+}
@@ -0,0 +1,105 @@
+#include "interval.hpp"
+
+#include <boost/multiprecision/cpp_dec_float.hpp>
+
+namespace Represent
+{
+	namespace
+	{
+		//Twice the relative rounding error of a Value operation.
+		const Value& slack()
+		{
+			static const Value result = std::numeric_limits<Value>::epsilon() * 2;
+			return result;
+		}
+
+		void widen(const Value& rounded, Value& down, Value& up)
+		{
+			Value margin = abs(rounded) * slack();
+			down = rounded - margin;
+			up = rounded + margin;
+		}
+	}
+
+	void sum(const Value& a, const Value& b, Value& down, Value& up)
+	{
+		widen(a + b, down, up);
+	}
+
+	void product(const Value& a, const Value& b, Value& down, Value& up)
+	{
+		widen(a * b, down, up);
+	}
+
+	void quotient(const Value& a, const Value& b, Value& down, Value& up)
+	{
+		widen(a / b, down, up);
+	}
+
+	double below(const Value& v)
+	{
+		double d = v.convert_to<double>();
+		if (!v.backend().isfinite())
+		{
+			return d;
+		}
+
+		//convert_to is not correctly rounded, so walk to the right double.
+		d = std::max(std::min(d, std::numeric_limits<double>::max()), -std::numeric_limits<double>::max());
+		while (d > -std::numeric_limits<double>::max() && exactValue(d) > v)
+		{
+			d = std::nextafter(d, -std::numeric_limits<double>::infinity());
+		}
+
+		if (exactValue(d) > v)
+		{
+			return -std::numeric_limits<double>::infinity();
+		}
+
+		while (d < std::numeric_limits<double>::max() && exactValue(std::nextafter(d, std::numeric_limits<double>::infinity())) <= v)
+		{
+			d = std::nextafter(d, std::numeric_limits<double>::infinity());
+		}
+
+		return d;
+	}
+
+	double above(const Value& v)
+	{
+		return -below(-v);
+	}
+
+	Interval<Value> convertValue(const Value& v, Interval<Value> *)
+	{
+		return Interval<Value>(v, v);
+	}
+
+	Interval<double> convertValue(const Value& v, Interval<double> *)
+	{
+		return Interval<double>(below(v), above(v));
+	}
+
+	template<>
+	Interval<Value> convertAs<Interval<Value> >(boost::string_ref digits, size_t base)
+	{
+		Value v = convertAs<Value>(digits, base);
+
+		//Every base is 10 or a power of two, so a literal is exact unless it has more digits
+		//than Value keeps.
+		if (digits.size() * 4 < static_cast<size_t>(std::numeric_limits<Value>::digits10))
+		{
+			return Interval<Value>(v, v);
+		}
+
+		Interval<Value> result;
+		widen(v, result.lo, result.hi);
+		return result;
+	}
+
+	template<>
+	Interval<double> convertAs<Interval<double> >(boost::string_ref digits, size_t base)
+	{
+		Interval<Value> exact = convertAs<Interval<Value> >(digits, base);
+		return Interval<double>(below(exact.lo), above(exact.hi));
+	}
+}
@@ -0,0 +1,265 @@
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define REPRESENT_X86_KERNELS
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace Represent
+{
+	namespace
+	{
+		template<typename T>
+		struct Kernels
+		{
+			typedef void (*Kernel)(T * target, const T * source, size_t count);
+
+			//Indexed by operator, OPERATOR_PLUS to OPERATOR_DIVIDE.
+			Kernel binary[4];
+		};
+
+		//The scalar loops are compiled for the baseline instruction set, and may still be 
+		//vectorized by the compiler.
+		struct Add { template<typename T> static T apply(T a, T b) { return a + b; } };
+		struct Sub { template<typename T> static T apply(T a, T b) { return a - b; } };
+		struct Mul { template<typename T> static T apply(T a, T b) { return a * b; } };
+		struct Div { template<typename T> static T apply(T a, T b) { return a / b; } };
+
+		template<typename Op, typename T>
+		void scalarKernel(T * target, const T * source, size_t count)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				target[i] = Op::apply(target[i], source[i]);
+			}
+		}
+
+#ifdef REPRESENT_X86_KERNELS
+		//Loads, stores and arithmetic on the registers of one instruction set.
+		template<typename T>
+		struct Sse2;
+
+		template<>
+		struct Sse2<double>
+		{
+			typedef __m128d type;
+			static const size_t width = 2;
+
+			static type load(const double * p) { return _mm_loadu_pd(p); }
+			static void store(double * p, type v) { _mm_storeu_pd(p, v); }
+
+			static type apply(Add, type a, type b) { return _mm_add_pd(a, b); }
+			static type apply(Sub, type a, type b) { return _mm_sub_pd(a, b); }
+			static type apply(Mul, type a, type b) { return _mm_mul_pd(a, b); }
+			static type apply(Div, type a, type b) { return _mm_div_pd(a, b); }
+		};
+
+		template<>
+		struct Sse2<float>
+		{
+			typedef __m128 type;
+			static const size_t width = 4;
+
+			static type load(const float * p) { return _mm_loadu_ps(p); }
+			static void store(float * p, type v) { _mm_storeu_ps(p, v); }
+
+			static type apply(Add, type a, type b) { return _mm_add_ps(a, b); }
+			static type apply(Sub, type a, type b) { return _mm_sub_ps(a, b); }
+			static type apply(Mul, type a, type b) { return _mm_mul_ps(a, b); }
+			static type apply(Div, type a, type b) { return _mm_div_ps(a, b); }
+		};
+
+		template<typename T>
+		struct Avx2;
+
+		template<>
+		struct Avx2<double>
+		{
+			typedef __m256d type;
+			static const size_t width = 4;
+
+			AVX2_TARGET static type load(const double * p) { return _mm256_loadu_pd(p); }
+			AVX2_TARGET static void store(double * p, type v) { _mm256_storeu_pd(p, v); }
+
+			AVX2_TARGET static type apply(Add, type a, type b) { return _mm256_add_pd(a, b); }
+			AVX2_TARGET static type apply(Sub, type a, type b) { return _mm256_sub_pd(a, b); }
+			AVX2_TARGET static type apply(Mul, type a, type b) { return _mm256_mul_pd(a, b); }
+			AVX2_TARGET static type apply(Div, type a, type b) { return _mm256_div_pd(a, b); }
+		};
+
+		template<>
+		struct Avx2<float>
+		{
+			typedef __m256 type;
+			static const size_t width = 8;
+
+			AVX2_TARGET static type load(const float * p) { return _mm256_loadu_ps(p); }
+			AVX2_TARGET static void store(float * p, type v) { _mm256_storeu_ps(p, v); }
+
+			AVX2_TARGET static type apply(Add, type a, type b) { return _mm256_add_ps(a, b); }
+			AVX2_TARGET static type apply(Sub, type a, type b) { return _mm256_sub_ps(a, b); }
+			AVX2_TARGET static type apply(Mul, type a, type b) { return _mm256_mul_ps(a, b); }
+			AVX2_TARGET static type apply(Div, type a, type b) { return _mm256_div_ps(a, b); }
+		};
+
+		template<typename Op, typename T>
+		void sse2Kernel(T * target, const T * source, size_t count)
+		{
+			typedef Sse2<T> V;
+
+			size_t i = 0;
+			for (; i + V::width <= count; i += V::width)
+			{
+				V::store(target + i, V::apply(Op(), V::load(target + i), V::load(source + i)));
+			}
+
+			scalarKernel<Op>(target + i, source + i, count - i);
+		}
+
+		template<typename Op, typename T>
+		AVX2_TARGET void avx2Kernel(T * target, const T * source, size_t count)
+		{
+			typedef Avx2<T> V;
+
+			//Two registers at a time, to hide the latency of each operation.
+			size_t i = 0;
+			for (; i + 2 * V::width <= count; i += 2 * V::width)
+			{
+				typename V::type a = V::apply(Op(), V::load(target + i), V::load(source + i));
+				typename V::type b = V::apply(Op(), V::load(target + i + V::width), V::load(source + i + V::width));
+				V::store(target + i, a);
+				V::store(target + i + V::width, b);
+			}
+
+			for (; i + V::width <= count; i += V::width)
+			{
+				V::store(target + i, V::apply(Op(), V::load(target + i), V::load(source + i)));
+			}
+
+			scalarKernel<Op>(target + i, source + i, count - i);
+		}
+#endif
+
+		template<typename T>
+		Kernels<T> kernelsFor(KernelType type)
+		{
+			Kernels<T> result = { { &scalarKernel<Add, T>, &scalarKernel<Sub, T>, &scalarKernel<Mul, T>, &scalarKernel<Div, T> } };
+
+#ifdef REPRESENT_X86_KERNELS
+			if (type == KERNEL_SSE2)
+			{
+				Kernels<T> sse2 = { { &sse2Kernel<Add, T>, &sse2Kernel<Sub, T>, &sse2Kernel<Mul, T>, &sse2Kernel<Div, T> } };
+				result = sse2;
+			}
+			else if (type == KERNEL_AVX2)
+			{
+				Kernels<T> avx2 = { { &avx2Kernel<Add, T>, &avx2Kernel<Sub, T>, &avx2Kernel<Mul, T>, &avx2Kernel<Div, T> } };
+				result = avx2;
+			}
+#endif
+
+			return result;
+		}
+
+		//The kernels of one type, which are never changed once built, so that selecting other 
+		//kernels only swaps a pointer while other threads may be running these.
+		struct Selection
+		{
+			KernelType type;
+			Kernels<double> doubles;
+			Kernels<float> floats;
+		};
+
+		const Selection& selectionFor(KernelType type)
+		{
+			static const Selection selections[] =
+			{
+				{ KERNEL_SCALAR, kernelsFor<double>(KERNEL_SCALAR), kernelsFor<float>(KERNEL_SCALAR) },
+				{ KERNEL_SSE2, kernelsFor<double>(KERNEL_SSE2), kernelsFor<float>(KERNEL_SSE2) },
+				{ KERNEL_AVX2, kernelsFor<double>(KERNEL_AVX2), kernelsFor<float>(KERNEL_AVX2) }
+			};
+
+			return selections[type];
+		}
+
+		std::atomic<const Selection *> selected(NULL);
+
+		const Selection& selection()
+		{
+			const Selection * current = selected.load(std::memory_order_acquire);
+			if (!current)
+			{
+				//The widest supported kernels, unless another thread has selected some first.
+				const Selection * supported = &selectionFor(supportedKernels());
+				return selected.compare_exchange_strong(current, supported, std::memory_order_acq_rel) ? *supported : *current;
+			}
+
+			return *current;
+		}
+
+		template<typename T>
+		void runKernel(const Kernels<T>& kernels, boost::uint32_t op, T * target, const T * source, size_t count)
+		{
+			if (op > OPERATOR_DIVIDE)
+			{
+				return;
+			}
+
+			kernels.binary[op](target, source, count);
+		}
+	}
+
+	KernelType supportedKernels()
+	{
+#ifdef REPRESENT_X86_KERNELS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+		{
+			return KERNEL_AVX2;
+		}
+
+		if (__builtin_cpu_supports("sse2"))
+		{
+			return KERNEL_SSE2;
+		}
+#endif
+
+		return KERNEL_SCALAR;
+	}
+
+	KernelType selectKernels(KernelType type)
+	{
+		selected.store(&selectionFor(std::min(type, supportedKernels())), std::memory_order_release);
+		return selectedKernels();
+	}
+
+	KernelType selectedKernels()
+	{
+		return selection().type;
+	}
+
+	void binaryKernel(boost::uint32_t op, double * target, const double * source, size_t count)
+	{
+		runKernel(selection().doubles, op, target, source, count);
+	}
+
+	void binaryKernel(boost::uint32_t op, float * target, const float * source, size_t count)
+	{
+		runKernel(selection().floats, op, target, source, count);
+	}
+
+	std::string toString(KernelType type)
+	{
+		CONVERT_TO_NARROW_STRING(Represent, type, KERNEL_TYPES);
+	}
+
+	std::ostream& operator<<(std::ostream& o, KernelType type)
+	{
+		o << toString(type);
+		return o;
+	}
+}
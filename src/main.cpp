@@ -1,46 +1,253 @@
 #include "eval.hpp"
 #include "evalutils.hpp"
 #include "function.hpp"
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <exception>
 #include <sstream>
 
 #ifndef TESTING
 template<typename F>
 void deffun(Represent::EvaluationContext& ctx, const std::string& name, F f)
 {
-	Represent::GenericFunction<F> func;
+	//The context keeps a pointer to the implementation.
+	static Represent::GenericFunction<F> func;
 	ctx.define(name, Represent::Function(func));
 }
 
+namespace
+{
+	template<typename T>
+	Represent::StorageCell evaluateIn(Represent::EvaluationContext& ctx)
+	{
+		return ctx.evaluateWith<T>();
+	}
+
+	//Native integers, unless the expression needs Value.
+	Represent::StorageCell evaluateInteger(Represent::EvaluationContext& ctx)
+	{
+		return ctx.evaluateInteger();
+	}
+
+	//The precisions an expression is evaluated in, in the order they are printed.
+	struct Precision
+	{
+		const char * name;
+		const char * label;
+		Represent::StorageCell (*evaluate)(Represent::EvaluationContext&);
+
+		//Whether it is evaluated when no precisions are chosen.
+		bool standard;
+	};
+
+	const Precision PRECISIONS[] = 
+	{
+		{ "full", "Full Precision:   ", &evaluateIn<Represent::Value>, true },
+		{ "double", "Double Precision: ", &evaluateIn<double>, true },
+		{ "single", "Single Precision: ", &evaluateIn<float>, true },
+		{ "dec50", "50 Digits:        ", &evaluateIn<Represent::Value50>, false },
+		{ "quad", "Quad Precision:   ", &evaluateIn<Represent::Quad>, false },
+		{ "long", "Long Double:      ", &evaluateIn<long double>, false },
+		{ "integer", "Integer:          ", &evaluateInteger, false },
+#ifdef REPRESENT_FLOAT128
+		{ "float128", "__float128:       ", &evaluateIn<Represent::Float128>, false },
+#endif
+	};
+
+	const size_t PRECISION_COUNT = sizeof(PRECISIONS) / sizeof(PRECISIONS[0]);
+
+	//The precisions that --shadow evaluates together, which come first.
+	const size_t SHADOWED = 3;
+
+	//Enables the precisions in a comma separated list of names.
+	bool selectPrecisions(const std::string& list, std::vector<bool>& enabled)
+	{
+		std::vector<std::string> names;
+		boost::split(names, list, boost::is_any_of(","));
+
+		for (auto it = names.begin(); it != names.end(); ++it)
+		{
+			size_t i = 0;
+			while (i < PRECISION_COUNT && *it != PRECISIONS[i].name)
+			{
+				++i;
+			}
+
+			if (i == PRECISION_COUNT)
+			{
+				std::cout << "Unknown precision: " << *it << ", expected one of";
+				for (size_t j = 0; j < PRECISION_COUNT; ++j)
+				{
+					std::cout << " " << PRECISIONS[j].name;
+				}
+				std::cout << ".\n";
+				return false;
+			}
+
+			enabled[i] = true;
+		}
+
+		return true;
+	}
+
+	//Points out each divergence under the expression.
+	void printDivergences(const std::string& text, const std::vector<Represent::Divergence>& divergences)
+	{
+		std::cout << "Divergences:\n";
+		for (auto it = divergences.begin(); it != divergences.end(); ++it)
+		{
+			std::cout << text << "\n" << std::string(it->token.offset, ' ') << "^ double " << it->doubleUlps 
+				<< " ULPs, single " << it->floatUlps << " ULPs\n";
+		}
+	}
+}
+
 int main(int argc, char * argv[])
 {
+	//The standard precisions, unless some are chosen with --precision.
+	std::vector<bool> enabled(PRECISION_COUNT);
+	bool chosen = false;
+
+	//With --shadow, every precision comes from one traversal, which also reports the operators
+	//that stray more than the given ULPs from full precision.
+	bool shadow = false;
+	boost::uint64_t ulps = 0;
+
+	//With --tolerance, the result is also evaluated adaptively to within the tolerance.
+	std::string tolerance;
+
 	std::stringstream s;
-	for (size_t i = 1; i < argc; ++i)
+	for (int i = 1; i < argc; ++i)
 	{
-		s << ' ' << argv[i]; 
+		std::string arg = argv[i];
+		if (arg == "--precision" && i + 1 < argc)
+		{
+			chosen = true;
+			if (!selectPrecisions(argv[++i], enabled))
+			{
+				return 1;
+			}
+		}
+		else if (boost::starts_with(arg, "--precision="))
+		{
+			chosen = true;
+			if (!selectPrecisions(arg.substr(12), enabled))
+			{
+				return 1;
+			}
+		}
+		else if (arg == "--shadow")
+		{
+			shadow = true;
+		}
+		else if (boost::starts_with(arg, "--shadow="))
+		{
+			shadow = true;
+			ulps = boost::lexical_cast<boost::uint64_t>(arg.substr(9));
+		}
+		else if (boost::starts_with(arg, "--tolerance="))
+		{
+			tolerance = arg.substr(12);
+		}
+		else
+		{
+			s << ' ' << arg; 
+		}
+	}
+
+	for (size_t i = 0; i < PRECISION_COUNT && !chosen; ++i)
+	{
+		enabled[i] = PRECISIONS[i].standard;
 	}
 
 	Represent::EvaluationContext ctx(s.str());
 
 	deffun(ctx, "incr", Represent::Increment());
 	deffun(ctx, "len", Represent::Len());
+	deffun(ctx, "popcount", Represent::PopCount());
 
 	ctx.dumpState();
 
-	Represent::StorageCell full = ctx.evaluateWith<Represent::Value>();
-	Represent::StorageCell doub = ctx.evaluateWith<double>();
-	Represent::StorageCell sing = ctx.evaluateWith<float>();
+	//An expression that applies an operator to types it does not take is rejected here.
+	try
+	{
+		ctx.prepare();
+	} catch (const char * message)
+	{
+		std::cout << message << "\n";
+		return 1;
+	} catch (const Represent::InvalidArguments& e)
+	{
+		std::cout << e.what() << "\n";
+		return 1;
+	}
+
+	std::vector<Represent::StorageCell> results(PRECISION_COUNT);
+	std::vector<std::exception_ptr> errors(PRECISION_COUNT);
+
+	Represent::ShadowReport report;
+	if (shadow)
+	{
+		report = ctx.evaluateShadow(ulps);
+		results[0] = report.full;
+		results[1] = report.dbl;
+		results[2] = report.flt;
+	}
+
+	//Each precision runs on its own thread, from the one compiled program.
+	boost::thread_group threads;
+	for (size_t i = 0; i < PRECISION_COUNT; ++i)
+	{
+		if (!enabled[i] || (shadow && i < SHADOWED))
+		{
+			continue;
+		}
+
+		threads.create_thread([&, i]()
+		{
+			try
+			{
+				results[i] = PRECISIONS[i].evaluate(ctx);
+			} catch (...)
+			{
+				errors[i] = std::current_exception();
+			}
+		});
+	}
+
+	threads.join_all();
 
-	std::cout << "Full Precision:   ";
 	std::cout << std::setprecision(100);
-	boost::apply_visitor(Represent::OutputCell(), full);
-	std::cout << "\n";
+	for (size_t i = 0; i < PRECISION_COUNT; ++i)
+	{
+		if (!enabled[i])
+		{
+			continue;
+		}
 
-	std::cout << "Double Precision: ";
-	boost::apply_visitor(Represent::OutputCell(), doub);
-	std::cout << "\n";
+		if (errors[i])
+		{
+			std::rethrow_exception(errors[i]);
+		}
 
-	std::cout << "Single Precision: ";
-	boost::apply_visitor(Represent::OutputCell(), sing);
-	std::cout << "\n";
+		std::cout << PRECISIONS[i].label;
+		boost::apply_visitor(Represent::OutputCell(), results[i]);
+		std::cout << "\n";
+	}
+
+	if (!tolerance.empty())
+	{
+		Represent::AdaptiveResult adaptive = ctx.evaluateAdaptive(Represent::Value(tolerance));
+		std::cout << "Adaptive: ";
+		boost::apply_visitor(Represent::OutputCell(), adaptive.value);
+		std::cout << "\n  within " << adaptive.bound << (adaptive.proven ? "" : ", not proven")
+			<< ", " << adaptive.escalated << " escalated\n";
+	}
+
+	if (shadow && !report.divergences.empty())
+	{
+		printDivergences(s.str(), report.divergences);
+	}
 }
-#endif
\ No newline at end of file
+#endif
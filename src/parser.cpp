@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 
 namespace Represent
 {
@@ -36,7 +37,7 @@ namespace Represent
 	#define MAYBE(target, flags, expr) \
 		do { if (flags & PARSE_FLAGS_FAILURE) { break; } size_t result = expr; target += result; } while (false)
 
-	#define RESTART(target, start, flags, stream) target = start; flags = 0; stream.clear()
+	#define RESTART(target, start, flags, out, mark) target = start; flags = 0; out.rollback(mark)
 
 
 		bool success(size_t flags)
@@ -44,39 +45,42 @@ namespace Represent
 			return !(flags & PARSE_FLAGS_FAILURE);
 		}
 
-		size_t parseNumberInBase(const char * begin, const char * end, size_t base, TokenStream& out)
+		//Pushes tk, recording where in the source it was lexed.
+		void emit(TokenStream& out, const char * position, Token tk)
+		{
+			tk.offset = out.offsetOf(position);
+			out.push(tk);
+		}
+
+		//Returns the length of the digits, including at most one decimal point, at begin.
+		size_t parseNumberInBase(const char * begin, const char * end, size_t base)
 		{
 			assert(base == 2 || base == 8 || base == 10 || base == 16);
 			const char * start = begin;
 			bool foundDecimal = false;
 
-			if (*begin == DECIMAL_SEPERATOR) 
+			if (begin != end && *begin == DECIMAL_SEPERATOR) 
 			{
-				out.push(Token(TOKEN_DECIMAL_POINT, 0)); 
 				foundDecimal = true;
 			}
 
-			int val = isNumericInBase(*begin, base);
-			while(val >= 0 && begin != end)
+			int val = begin != end ? isNumericInBase(*begin, base) : -1;
+			while(val >= 0)
 			{
-				out.push(Token(TOKEN_NUMBER, val));
 				++begin;
 
-				if (*begin == DECIMAL_SEPERATOR)
+				if (begin != end && *begin == DECIMAL_SEPERATOR)
 				{
 					if (foundDecimal)
 					{
 						break;
 					}
-					else
-					{
-						out.push(Token(TOKEN_DECIMAL_POINT, 0));
-						foundDecimal = true;
-					}
+
+					foundDecimal = true;
 					++begin;
 				}
 
-				val = isNumericInBase(*begin, base);
+				val = begin != end ? isNumericInBase(*begin, base) : -1;
 			}
 
 			return begin - start;
@@ -88,48 +92,51 @@ namespace Represent
 			return it != legal.end();
 		}
 
+		//A number is a single TOKEN_NUMBER spanning its digits, with the base in extra.
 		size_t parseNumber(const char * begin, const char * end, TokenStream& out)
 		{
-			size_t consumed = 0;
-			TokenStream result;
+			const char * at = skipWhitespace(begin, end);
+			size_t prefix = 0;
+			size_t base = 10;
 
-			//Look for some identifying data to determine the data.
-			if (begins(begin, end, "0b")) 
+			//Look for some identifying data to determine the base.
+			if (begins(at, end, "0b")) 
 			{
-				result.push(Token(TOKEN_BASE_FLAG, 2));
-				consumed = parseNumberInBase(begin + 2, end, 2, result) + 2;
+				prefix = 2;
+				base = 2;
 			}
-			else if (begins(begin, end, "0x"))
+			else if (begins(at, end, "0x"))
 			{
-				result.push(Token(TOKEN_BASE_FLAG, 16)); 
-				consumed = parseNumberInBase(begin + 2, end, 16, result) + 2;
+				prefix = 2;
+				base = 16;
 			}
-			else if (begins(begin, end, "0."))
+			else if (begins(at, end, "0."))
 			{
-				result.push(Token(TOKEN_BASE_FLAG, 10)); 
-				consumed = parseNumberInBase(begin, end, 10, result);
+				base = 10;
 			}
-			else if (begins(begin, end, "0"))
+			else if (begins(at, end, "0"))
 			{
-				result.push(Token(TOKEN_BASE_FLAG, 8));
-				consumed = parseNumberInBase(begin + 1, end, 8, result) + 1;
+				prefix = 1;
+				base = 8;
 			}
-			else 
+
+			size_t length = parseNumberInBase(at + prefix, end, base);
+			if (prefix + length == 0)
 			{
-				result.push(Token(TOKEN_BASE_FLAG, 10));
-				consumed = parseNumberInBase(begin, end, 10, result);
+				return 0;
 			}
 
-			out.push(result);
-			return consumed;
+			emit(out, at + prefix, Token(TOKEN_NUMBER, length, base));
+			return (at - begin) + prefix + length;
 		}
 
 		size_t parseChar(const char * begin, const char * end, char ch, TokenType type, boost::uint32_t val, TokenStream& out)
 		{
-			if (*begin == ch)
+			const char * at = skipWhitespace(begin, end);
+			if (at != end && *at == ch)
 			{
-				out.push(Token(type, val));
-				return 1;
+				emit(out, at, Token(type, val));
+				return at - begin + 1;
 			}
 
 			return 0;
@@ -137,63 +144,53 @@ namespace Represent
 
 		size_t binaryOperator(const char * begin, const char * end, TokenStream& out)
 		{
-			TableEntry entries[] = {
-				{ "+" , TOKEN_OPERATOR, OPERATOR_PLUS }, 
-				{ "-" , TOKEN_OPERATOR, OPERATOR_MINUS }, 
-				{ "*" , TOKEN_OPERATOR, OPERATOR_MULTIPLY }, 
-				{ "/" , TOKEN_OPERATOR, OPERATOR_DIVIDE },
-				{ ".+", TOKEN_OPERATOR, OPERATOR_COMPONENT_PLUS }, 
-				{ ".-", TOKEN_OPERATOR, OPERATOR_COMPONENT_MINUS }, 
-				{ ".*", TOKEN_OPERATOR, OPERATOR_COMPONENT_MULTIPLY }, 
-				{ "./", TOKEN_OPERATOR, OPERATOR_COMPONENT_DIVIDE },
-			}; 
-
-			size_t size = sizeof(entries) / sizeof(entries[0]);
+			const char * at = skipWhitespace(begin, end);
 			size_t consumed = 0;
 			
-			const TableEntry * entry = lookup(entries, entries + size, begin, end, &consumed);
+			const OperatorEntry * entry = matchOperator(at, end, false, &consumed);
 			if (entry)
 			{
-				out.push(Token(entry->type, entry->value));
+				emit(out, at, Token(TOKEN_OPERATOR, entry->op));
+				return at - begin + consumed;
 			}
 
-			return consumed;
+			return 0;
 		}
 
 		size_t unaryOperator(const char * begin, const char * end, TokenStream& out)
 		{
-			TableEntry entries[] = {
-				{ "+", TOKEN_OPERATOR, OPERATOR_UNARY_PLUS }, 
-				{ "-", TOKEN_OPERATOR, OPERATOR_UNARY_MINUS },
-			};
-
-			size_t size = sizeof(entries) / sizeof(entries[0]);
+			const char * at = skipWhitespace(begin, end);
 			size_t consumed = 0;
 
-			const TableEntry * entry = lookup(entries, entries + size, begin, end, &consumed);
+			const OperatorEntry * entry = matchOperator(at, end, true, &consumed);
 			if (entry)
 			{
-				out.push(Token(entry->type, entry->value));
+				emit(out, at, Token(TOKEN_OPERATOR, entry->op));
+				return at - begin + consumed;
 			}
 
-			return consumed;
+			return 0;
 		}
 
 		size_t function(const char * begin, const char * end, TokenStream& out)
 		{
 			const char * start = begin;
+			const char * name = skipWhitespace(begin, end);
 			boost::uint32_t parsingFlags = 0;
-			TokenStream stream;
+			TokenStream::Mark mark = out.mark();
 
 			size_t args = 1;
-			RESTART(begin, start, parsingFlags, stream);
-			EXPECT(begin, parsingFlags, identifier(begin, end, stream));
-			EXPECT(begin, parsingFlags, parseChar(begin, end, '(', TOKEN_PAREN, 0, stream));
-			EXPECT(begin, parsingFlags, expression(begin, end, stream));
-			while(!parseChar(begin, end, ')', TOKEN_PAREN, 1, stream) && success(parsingFlags))
-			{
-				EXPECT(begin, parsingFlags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, stream));
-				EXPECT(begin, parsingFlags, expression(begin, end, stream));
+			size_t closing = 0;
+			//The header is patched with the argument count once the call is parsed.
+			RESTART(begin, start, parsingFlags, out, mark);
+			emit(out, name, Token(TOKEN_FUNCTION_IDENTIFIER, 0));
+			EXPECT(begin, parsingFlags, identifier(begin, end, out));
+			EXPECT(begin, parsingFlags, parseChar(begin, end, '(', TOKEN_PAREN, 0, out));
+			EXPECT(begin, parsingFlags, expression(begin, end, out));
+			while(success(parsingFlags) && !(closing = parseChar(begin, end, ')', TOKEN_PAREN, 1, out)))
+			{
+				EXPECT(begin, parsingFlags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, out));
+				EXPECT(begin, parsingFlags, expression(begin, end, out));
 				++args;
 			}
 
@@ -201,129 +198,119 @@ namespace Represent
 			if (success(parsingFlags))
 			{
 				//Consume the ')'.
-				begin++;
-				out.push(Token(TOKEN_FUNCTION_IDENTIFIER, args));
-				out.push(stream);
+				begin += closing;
+				out.at(mark).value = args;
 				return begin - start;
 			}
 
+			out.rollback(mark);
 			return 0;
 		}
 
-		size_t identifier(const char * begin, const char * end, TokenStream& out)
+		size_t identifierLength(const char * begin, const char * end)
 		{
 			const char * start = begin;
 
-			if (charIn(*begin, LEGAL_IDENTIFIER_START))
+			if (begin == end || !charIn(*begin, LEGAL_IDENTIFIER_START))
 			{
-				TokenStream result;
-				result.push(Token(TOKEN_IDENTIFIER_RAW, 0));
-				result.push(Token(TOKEN_RAW, *begin));
+				return 0;
+			}
 
+			++begin;
+			while(begin != end && charIn(*begin, LEGAL_IDENTIFIER_REST))
+			{
 				++begin;
-				while(charIn(*begin, LEGAL_IDENTIFIER_REST) && begin != end)
-				{
-					result.push(Token(TOKEN_RAW, *begin));
-					++begin;
-				}
+			}
 
-				//Identifiers cannot end with '-'.
-				if (*(begin - 1) == '-')
-				{
-					result.pop();
-					begin--;
-				}
+			//Identifiers cannot end with '-'.
+			if (*(begin - 1) == '-')
+			{
+				begin--;
+			}
 
-				out.push(result);
-				return begin - start;
+			return begin - start;
+		}
+
+		size_t identifier(const char * begin, const char * end, TokenStream& out)
+		{
+			const char * at = skipWhitespace(begin, end);
+			size_t length = identifierLength(at, end);
+
+			if (length)
+			{
+				emit(out, at, Token(TOKEN_IDENTIFIER_RAW, length));
+				return at - begin + length;
 			}
 
 			return 0;
 		}
 
+		//A string is a single TOKEN_STRING spanning the text between its backticks, escapes included.
 		size_t string(const char * begin, const char * end, TokenStream& out)
 		{
-			const char * start = begin;
-			boost::uint32_t flags = 0;
-			TokenStream stream;
-
-			RESTART(begin, start, flags, stream);
-			EXPECT(begin, flags, parseChar(begin, end, '`', TOKEN_STRING_START, 0, stream));
-			if (!success(flags))
+			const char * at = skipWhitespace(begin, end);
+			if (at == end || *at != '`')
 			{
 				return 0;
 			}
 
+			const char * body = ++at;
 			bool escapeSequence = false;
-			while (begin != end)
+			while (at != end)
 			{
 				if (escapeSequence)
 				{
-					if (*begin != '`' && *begin != '\\')
+					if (*at != '`' && *at != '\\')
 					{
 						//Invalid escape.
-						std::cout << "invalid escape sequence: \\" << *begin << "\n";
+						std::cout << "invalid escape sequence: \\" << *at << "\n";
 						return 0;
 					}
 
 					escapeSequence = false;
 				} 
-				else
+				else if (*at == '\\')
 				{
-					//Try beginning an escape sequence.
-					if (*begin == '\\')
-					{
-						escapeSequence = true;
-						++begin;
-						continue;
-					}
-
-					//End of the string?
-					if (*begin == '`')
-					{
-						//Consume the final ` without emitting a token.
-						++begin;
-						break;
-					}
+					escapeSequence = true;
+				}
+				else if (*at == '`')
+				{
+					//Consume the final ` without including it in the token.
+					emit(out, body, Token(TOKEN_STRING, at - body));
+					return at + 1 - begin;
 				}
 
-				//Push the token as a member of the string.
-				stream.push(Token(TOKEN_RAW, *begin));
-				++begin;
-			}
-
-			if (success(flags))
-			{
-				out.push(stream);
-				return begin - start;
+				++at;
 			}
 
-			return 0;
+			//Unterminated strings run to the end of the input.
+			emit(out, body, Token(TOKEN_STRING, at - body));
+			return at - begin;
 		}
 
 		size_t vector(const char * begin, const char * end, TokenStream& out)
 		{
 			const char * start = begin;
 			boost::uint32_t flags = 0;
-			TokenStream stream;
-
-			RESTART(begin, start, flags, stream);
-			stream.push(Token(TOKEN_VECTOR, 0));
-			EXPECT(begin, flags, parseChar(begin, end, '[', TOKEN_PAREN, 0, stream));
-			EXPECT(begin, flags, expression(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, stream));
-			EXPECT(begin, flags, expression(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, stream));
-			EXPECT(begin, flags, expression(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, stream));
-			EXPECT(begin, flags, expression(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ']', TOKEN_PAREN, 1, stream));
+			TokenStream::Mark mark = out.mark();
+
+			RESTART(begin, start, flags, out, mark);
+			emit(out, skipWhitespace(begin, end), Token(TOKEN_VECTOR, 0));
+			EXPECT(begin, flags, parseChar(begin, end, '[', TOKEN_PAREN, 0, out));
+			EXPECT(begin, flags, expression(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, out));
+			EXPECT(begin, flags, expression(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, out));
+			EXPECT(begin, flags, expression(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, out));
+			EXPECT(begin, flags, expression(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ']', TOKEN_PAREN, 1, out));
 			if (success(flags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
+			out.rollback(mark);
 			return 0;
 		}
 
@@ -331,25 +318,25 @@ namespace Represent
 		{
 			const char * start = begin;
 			boost::uint32_t flags = 0;
-			TokenStream stream;
-
-			RESTART(begin, start, flags, stream);
-			EXPECT(begin, flags, parseChar(begin, end, 'q', TOKEN_QUATERNION, 0, stream));
-			EXPECT(begin, flags, parseChar(begin, end, '[', TOKEN_PAREN, 0, stream));
-			EXPECT(begin, flags, expression(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, stream));
-			EXPECT(begin, flags, expression(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, stream));
-			EXPECT(begin, flags, expression(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, stream));
-			EXPECT(begin, flags, expression(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ']', TOKEN_PAREN, 1, stream));
+			TokenStream::Mark mark = out.mark();
+
+			RESTART(begin, start, flags, out, mark);
+			EXPECT(begin, flags, parseChar(begin, end, 'q', TOKEN_QUATERNION, 0, out));
+			EXPECT(begin, flags, parseChar(begin, end, '[', TOKEN_PAREN, 0, out));
+			EXPECT(begin, flags, expression(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, out));
+			EXPECT(begin, flags, expression(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, out));
+			EXPECT(begin, flags, expression(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, out));
+			EXPECT(begin, flags, expression(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ']', TOKEN_PAREN, 1, out));
 			if (success(flags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
+			out.rollback(mark);
 			return 0;
 		}
 
@@ -357,25 +344,25 @@ namespace Represent
 		{
 			const char * start = begin;
 			boost::uint32_t flags = 0;
-			TokenStream stream;
-
-			RESTART(begin, start, flags, stream);
-			stream.push(Token(TOKEN_MATRIX, 0));
-			EXPECT(begin, flags, parseChar(begin, end, '[', TOKEN_PAREN, 0, stream));
-			EXPECT(begin, flags, vector(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ';', TOKEN_ARG_DELIMIT, 0, stream));
-			EXPECT(begin, flags, vector(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ';', TOKEN_ARG_DELIMIT, 0, stream));
-			EXPECT(begin, flags, vector(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ';', TOKEN_ARG_DELIMIT, 0, stream));
-			EXPECT(begin, flags, vector(begin, end, stream));
-			EXPECT(begin, flags, parseChar(begin, end, ']', TOKEN_PAREN, 1, stream));
+			TokenStream::Mark mark = out.mark();
+
+			RESTART(begin, start, flags, out, mark);
+			emit(out, skipWhitespace(begin, end), Token(TOKEN_MATRIX, 0));
+			EXPECT(begin, flags, parseChar(begin, end, '[', TOKEN_PAREN, 0, out));
+			EXPECT(begin, flags, vector(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ';', TOKEN_ARG_DELIMIT, 0, out));
+			EXPECT(begin, flags, vector(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ';', TOKEN_ARG_DELIMIT, 0, out));
+			EXPECT(begin, flags, vector(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ';', TOKEN_ARG_DELIMIT, 0, out));
+			EXPECT(begin, flags, vector(begin, end, out));
+			EXPECT(begin, flags, parseChar(begin, end, ']', TOKEN_PAREN, 1, out));
 			if (success(flags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
+			out.rollback(mark);
 			return 0;
 		}
 
@@ -383,28 +370,31 @@ namespace Represent
 		{
 			const char * start = begin;
 			boost::uint32_t flags = 0;
+			const char * brace = skipWhitespace(begin, end);
 			boost::uint32_t count = 1;
-			TokenStream stream;
+			size_t closing = 0;
+			TokenStream::Mark mark = out.mark();
 
-			RESTART(begin, start, flags, stream);
-			EXPECT(begin, flags, parseChar(begin, end, '{', TOKEN_PAREN, 0, stream));
-			EXPECT(begin, flags, expression(begin, end, stream)); 
-			while(!parseChar(begin, end, '}', TOKEN_PAREN, 1, stream) && success(flags))
+			RESTART(begin, start, flags, out, mark);
+			emit(out, brace, Token(TOKEN_ARRAY, 0));
+			EXPECT(begin, flags, parseChar(begin, end, '{', TOKEN_PAREN, 0, out));
+			EXPECT(begin, flags, expression(begin, end, out)); 
+			while(success(flags) && !(closing = parseChar(begin, end, '}', TOKEN_PAREN, 1, out)))
 			{
-				EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, stream));
-				EXPECT(begin, flags, expression(begin, end, stream));
+				EXPECT(begin, flags, parseChar(begin, end, ',', TOKEN_ARG_DELIMIT, 0, out));
+				EXPECT(begin, flags, expression(begin, end, out));
 				count++;
 			}
 
 			if (success(flags))
 			{
 				//Consume the '}'.
-				begin++;
-				out.push(Token(TOKEN_ARRAY, count));
-				out.push(stream);
+				begin += closing;
+				out.at(mark).value = count;
 				return begin - start;
 			}
 
+			out.rollback(mark);
 			return 0;
 		}
 
@@ -412,80 +402,73 @@ namespace Represent
 		{
 			const char * start = begin;
 			boost::uint32_t flags = 0;
-			TokenStream stream;
+			TokenStream::Mark mark = out.mark();
 
-			RESTART(begin, start, flags, stream); 
-			EXPECT(begin, flags, unaryOperator(begin, end, stream));
-			EXPECT(begin, flags, value(begin, end, stream));
+			RESTART(begin, start, flags, out, mark); 
+			EXPECT(begin, flags, unaryOperator(begin, end, out));
+			EXPECT(begin, flags, value(begin, end, out));
 			if (success(flags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//Number?
-			RESTART(begin, start, flags, stream);
-			EXPECT(begin, flags, parseNumber(begin, end, stream));
+			RESTART(begin, start, flags, out, mark);
+			EXPECT(begin, flags, parseNumber(begin, end, out));
 			if (success(flags)) 
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//Function call?
-			RESTART(begin, start, flags, stream);
-			EXPECT(begin, flags, function(begin, end, stream));
+			RESTART(begin, start, flags, out, mark);
+			EXPECT(begin, flags, function(begin, end, out));
 			if (success(flags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//String?
-			RESTART(begin, start, flags, stream);
-			EXPECT(begin, flags, string(begin, end, stream));
+			RESTART(begin, start, flags, out, mark);
+			EXPECT(begin, flags, string(begin, end, out));
 			if (success(flags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//Vector?
-			RESTART(begin, start, flags, stream);
-			EXPECT(begin, flags, vector(begin, end, stream));
+			RESTART(begin, start, flags, out, mark);
+			EXPECT(begin, flags, vector(begin, end, out));
 			if (success(flags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//Quat?
-			RESTART(begin, start, flags, stream);
-			EXPECT(begin, flags, quaternion(begin, end, stream));
+			RESTART(begin, start, flags, out, mark);
+			EXPECT(begin, flags, quaternion(begin, end, out));
 			if (success(flags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//Matrix?
-			RESTART(begin, start, flags, stream);
-			EXPECT(begin, flags, matrix(begin, end, stream));
+			RESTART(begin, start, flags, out, mark);
+			EXPECT(begin, flags, matrix(begin, end, out));
 			if (success(flags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//Identifier?
-			RESTART(begin, start, flags, stream);
-			EXPECT(begin, flags, identifier(begin, end, stream));
+			RESTART(begin, start, flags, out, mark);
+			EXPECT(begin, flags, identifier(begin, end, out));
 			if (success(flags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
+			out.rollback(mark);
 			return 0;
 		}
 
@@ -493,120 +476,365 @@ namespace Represent
 		{
 			const char * start = begin;
 			boost::uint32_t parsingFlags = 0;
-			TokenStream stream;
+			TokenStream::Mark mark = out.mark();
 
 			//Parenthesized followed by op followed by expression.
-			RESTART(begin, start, parsingFlags, stream);
-			EXPECT(begin, parsingFlags, parseChar(begin, end, '(', TOKEN_PAREN, 0, stream));
-			EXPECT(begin, parsingFlags, expression(begin, end, stream));
-			EXPECT(begin, parsingFlags, parseChar(begin, end, ')', TOKEN_PAREN, 1, stream));
-			EXPECT(begin, parsingFlags, binaryOperator(begin, end, stream));
-			EXPECT(begin, parsingFlags, expression(begin, end, stream));
+			RESTART(begin, start, parsingFlags, out, mark);
+			EXPECT(begin, parsingFlags, parseChar(begin, end, '(', TOKEN_PAREN, 0, out));
+			EXPECT(begin, parsingFlags, expression(begin, end, out));
+			EXPECT(begin, parsingFlags, parseChar(begin, end, ')', TOKEN_PAREN, 1, out));
+			EXPECT(begin, parsingFlags, binaryOperator(begin, end, out));
+			EXPECT(begin, parsingFlags, expression(begin, end, out));
 			if (success(parsingFlags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//Array >> op >> expression
-			RESTART(begin, start, parsingFlags, stream);
-			EXPECT(begin, parsingFlags, array(begin, end, stream));
-			EXPECT(begin, parsingFlags, binaryOperator(begin, end, stream));
-			EXPECT(begin, parsingFlags, expression(begin, end, stream));
+			RESTART(begin, start, parsingFlags, out, mark);
+			EXPECT(begin, parsingFlags, array(begin, end, out));
+			EXPECT(begin, parsingFlags, binaryOperator(begin, end, out));
+			EXPECT(begin, parsingFlags, expression(begin, end, out));
 			if (success(parsingFlags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//number >> op >> expression
-			RESTART(begin, start, parsingFlags, stream);
-			EXPECT(begin, parsingFlags, value(begin, end, stream));
-			EXPECT(begin, parsingFlags, binaryOperator(begin, end, stream));
-			EXPECT(begin, parsingFlags, expression(begin, end, stream));
+			RESTART(begin, start, parsingFlags, out, mark);
+			EXPECT(begin, parsingFlags, value(begin, end, out));
+			EXPECT(begin, parsingFlags, binaryOperator(begin, end, out));
+			EXPECT(begin, parsingFlags, expression(begin, end, out));
 			if (success(parsingFlags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//Parenthesized expression.
-			RESTART(begin, start, parsingFlags, stream);
-			EXPECT(begin, parsingFlags, parseChar(begin, end, '(', TOKEN_PAREN, 0, stream));
-			EXPECT(begin, parsingFlags, expression(begin, end, stream));
-			EXPECT(begin, parsingFlags, parseChar(begin, end, ')', TOKEN_PAREN, 1, stream));
+			RESTART(begin, start, parsingFlags, out, mark);
+			EXPECT(begin, parsingFlags, parseChar(begin, end, '(', TOKEN_PAREN, 0, out));
+			EXPECT(begin, parsingFlags, expression(begin, end, out));
+			EXPECT(begin, parsingFlags, parseChar(begin, end, ')', TOKEN_PAREN, 1, out));
 			if (success(parsingFlags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//Single array.
-			RESTART(begin, start, parsingFlags, stream);
-			EXPECT(begin, parsingFlags, array(begin, end, stream));
+			RESTART(begin, start, parsingFlags, out, mark);
+			EXPECT(begin, parsingFlags, array(begin, end, out));
 			if (success(parsingFlags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
 			//Try a single value.
-			RESTART(begin, start, parsingFlags, stream);
-			EXPECT(begin, parsingFlags, value(begin, end, stream));
+			RESTART(begin, start, parsingFlags, out, mark);
+			EXPECT(begin, parsingFlags, value(begin, end, out));
 			if (success(parsingFlags))
 			{
-				out.push(stream);
 				return begin - start;
 			}
 
+			out.rollback(mark);
 			return 0;
 		}
-	}
 
-	TokenStream parse(const std::string& data)
-	{
-		std::vector<char> buffer; 
-		std::copy(data.begin(), data.end(), std::back_inserter(buffer));
-		
-		bool inString = false;
-		for (size_t i = 0; i < buffer.size(); ++i)
+		//A single pass precedence climbing parser. It accepts the same language as the backtracking
+		//parser above and emits the same tokens, but picks every production from the next character
+		//so that no part of the input is ever parsed twice.
+		namespace Pratt
 		{
-			if (buffer[i] == '`')
+			bool climb(const char *& begin, const char * end, boost::uint32_t minimumPower, TokenStream& out);
+			bool bracket(const char *& begin, const char * end, TokenStream& out, bool * matrix);
+
+			//The next character that is not whitespace, or 0 at the end of the input.
+			char peek(const char * begin, const char * end)
+			{
+				begin = skipWhitespace(begin, end);
+				return begin != end ? *begin : 0;
+			}
+
+			bool consume(const char *& begin, size_t consumed)
+			{
+				begin += consumed;
+				return consumed != 0;
+			}
+
+			bool character(const char *& begin, const char * end, char ch, TokenType type, boost::uint32_t val, TokenStream& out)
+			{
+				return consume(begin, parseChar(begin, end, ch, type, val, out));
+			}
+
+			//Consumes binary operators and their right hand sides for as long as they bind at least
+			//as tightly as minimumPower.
+			bool tail(const char *& begin, const char * end, boost::uint32_t minimumPower, TokenStream& out)
+			{
+				size_t consumed = 0;
+				const char * at = skipWhitespace(begin, end);
+				const OperatorEntry * op = matchOperator(at, end, false, &consumed);
+
+				while (op && op->power >= minimumPower)
+				{
+					emit(out, at, Token(TOKEN_OPERATOR, op->op));
+					begin = at + consumed;
+
+					if (!climb(begin, end, op->assoc ? op->power : op->power + 1, out))
+					{
+						return false;
+					}
+
+					at = skipWhitespace(begin, end);
+					op = matchOperator(at, end, false, &consumed);
+				}
+
+				return true;
+			}
+
+			//count more expressions, each preceded by a ','.
+			bool list(const char *& begin, const char * end, size_t count, TokenStream& out)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					if (!character(begin, end, ',', TOKEN_ARG_DELIMIT, 0, out) || !climb(begin, end, 0, out))
+					{
+						return false;
+					}
+				}
+
+				return true;
+			}
+
+			//Either a vector, [e, e, e, e], or a matrix of four vectors, [[...]; [...]; [...]; [...]].
+			//Both begin with '[', and a matrix is only known once its first row is followed by a ';'.
+			bool bracket(const char *& begin, const char * end, TokenStream& out, bool * matrix)
+			{
+				TokenStream::Mark header = out.mark();
+				emit(out, skipWhitespace(begin, end), Token(TOKEN_VECTOR, 0));
+
+				*matrix = false;
+				if (!character(begin, end, '[', TOKEN_PAREN, 0, out))
+				{
+					return false;
+				}
+
+				if (peek(begin, end) == '[')
+				{
+					bool nested = false;
+					if (!bracket(begin, end, out, &nested))
+					{
+						return false;
+					}
+
+					if (!nested && peek(begin, end) == ';')
+					{
+						*matrix = true;
+						out.at(header).type = TOKEN_MATRIX;
+
+						for (size_t i = 0; i < 3; ++i)
+						{
+							if (!character(begin, end, ';', TOKEN_ARG_DELIMIT, 0, out) ||
+								!bracket(begin, end, out, &nested) || nested)
+							{
+								return false;
+							}
+						}
+
+						return character(begin, end, ']', TOKEN_PAREN, 1, out);
+					}
+
+					//The first element was a vector, but it may continue as an expression.
+					if (!tail(begin, end, 0, out))
+					{
+						return false;
+					}
+				}
+				else if (!climb(begin, end, 0, out))
+				{
+					return false;
+				}
+
+				return list(begin, end, 3, out) && character(begin, end, ']', TOKEN_PAREN, 1, out);
+			}
+
+			bool quaternion(const char *& begin, const char * end, TokenStream& out)
 			{
-				//Escaped backtick.
-				if (i > 0 && inString && buffer[i - 1] == '\\')
+				return character(begin, end, 'q', TOKEN_QUATERNION, 0, out) &&
+					character(begin, end, '[', TOKEN_PAREN, 0, out) &&
+					climb(begin, end, 0, out) &&
+					list(begin, end, 3, out) &&
+					character(begin, end, ']', TOKEN_PAREN, 1, out);
+			}
+
+			//Headers such as TOKEN_FUNCTION_IDENTIFIER or TOKEN_ARRAY are emitted before their
+			//contents are known, and are patched once they are.
+			bool call(const char *& begin, const char * end, TokenStream& out)
+			{
+				TokenStream::Mark header = out.mark();
+				emit(out, skipWhitespace(begin, end), Token(TOKEN_FUNCTION_IDENTIFIER, 0));
+
+				if (!consume(begin, identifier(begin, end, out)) ||
+					!character(begin, end, '(', TOKEN_PAREN, 0, out) ||
+					!climb(begin, end, 0, out))
 				{
-					continue;
+					return false;
 				}
 
-				inString = !inString;
-				continue;
+				boost::uint32_t args = 1;
+				while (!character(begin, end, ')', TOKEN_PAREN, 1, out))
+				{
+					if (!character(begin, end, ',', TOKEN_ARG_DELIMIT, 0, out) || !climb(begin, end, 0, out))
+					{
+						return false;
+					}
+
+					++args;
+				}
+
+				out.at(header).value = args;
+				return true;
 			}
 
-			if (isspace(buffer[i]) && !inString)
+			bool array(const char *& begin, const char * end, TokenStream& out)
 			{
-				buffer[i] = 0;
+				TokenStream::Mark header = out.mark();
+				emit(out, skipWhitespace(begin, end), Token(TOKEN_ARRAY, 0));
+
+				if (!character(begin, end, '{', TOKEN_PAREN, 0, out) || !climb(begin, end, 0, out))
+				{
+					return false;
+				}
+
+				boost::uint32_t count = 1;
+				while (!character(begin, end, '}', TOKEN_PAREN, 1, out))
+				{
+					if (!character(begin, end, ',', TOKEN_ARG_DELIMIT, 0, out) || !climb(begin, end, 0, out))
+					{
+						return false;
+					}
+
+					++count;
+				}
+
+				out.at(header).value = count;
+				return true;
+			}
+
+			//Any number of prefix operators followed by a number, call, string, vector, quaternion, matrix or identifier.
+			bool value(const char *& begin, const char * end, TokenStream& out)
+			{
+				while (consume(begin, unaryOperator(begin, end, out)))
+				{}
+
+				const char * at = skipWhitespace(begin, end);
+				if (at == end)
+				{
+					return false;
+				}
+
+				char ch = *at;
+				if (isdigit(ch) || ch == DECIMAL_SEPERATOR)
+				{
+					return consume(begin, parseNumber(begin, end, out));
+				}
+
+				if (ch == '`')
+				{
+					return consume(begin, string(begin, end, out));
+				}
+
+				if (ch == '[')
+				{
+					bool matrix = false;
+					return bracket(begin, end, out, &matrix);
+				}
+
+				if (ch == 'q' && peek(at + 1, end) == '[')
+				{
+					return quaternion(begin, end, out);
+				}
+
+				size_t length = identifierLength(at, end);
+				if (length && peek(at + length, end) == '(')
+				{
+					return call(begin, end, out);
+				}
+
+				return consume(begin, identifier(begin, end, out));
+			}
+
+			//Prefix operators only apply to values, parenthesized expressions and arrays may only
+			//appear as operands of binary operators.
+			bool operand(const char *& begin, const char * end, TokenStream& out)
+			{
+				char ch = peek(begin, end);
+				if (ch == '(')
+				{
+					return character(begin, end, '(', TOKEN_PAREN, 0, out) &&
+						climb(begin, end, 0, out) &&
+						character(begin, end, ')', TOKEN_PAREN, 1, out);
+				}
+
+				if (ch == '{')
+				{
+					return array(begin, end, out);
+				}
+
+				return value(begin, end, out);
+			}
+
+			bool climb(const char *& begin, const char * end, boost::uint32_t minimumPower, TokenStream& out)
+			{
+				return operand(begin, end, out) && tail(begin, end, minimumPower, out);
+			}
+
+			size_t expression(const char * begin, const char * end, TokenStream& out)
+			{
+				const char * start = begin;
+				TokenStream::Mark mark = out.mark();
+
+				if (climb(begin, end, 0, out))
+				{
+					return begin - start;
+				}
+
+				out.rollback(mark);
+				return 0;
 			}
 		}
+	}
+
+	TokenStream parse(boost::string_ref data, ParserType parser)
+	{
+		TokenStream result(data);
 
-		buffer.erase(std::remove(buffer.begin(), buffer.end(), 0), buffer.end());
+		//Every production emits at most two tokens per character it consumes, and most emit far
+		//fewer, so reserving one token per character means the arena grows at most once.
+		result.reserve(data.size() + 1);
 
-		TokenStream result;
-		if (buffer.size() == 0)
+		const char * begin = data.data();
+		const char * end = data.data() + data.size();
+		if (skipWhitespace(begin, end) == end)
 		{
 			return result;
 		}
 
-		const char * begin = &buffer[0];
-		const char * end = &buffer[0] + buffer.size();
+		size_t consumed = 0;
+		if (parser == PARSER_BACKTRACKING)
+		{
+			consumed = Parse::expression(begin, end, result);
+		}
+		else
+		{
+			consumed = Parse::Pratt::expression(begin, end, result);
+		}
 
-		size_t consumed = Parse::expression(begin, end, result);
-		if (begin + consumed != end)
+		if (skipWhitespace(begin + consumed, end) != end)
 		{
 			std::cout << "INPUT: " << data << "\n";
 			std::cout << "Failed to parse entire output array, ended: " << consumed << " chars at " << std::string(begin + consumed, end) << "\n";
 			
-			return TokenStream();
+			return TokenStream(data);
 		}
 
 		return result;
@@ -1,19 +1,27 @@
 #include "parserutils.hpp"
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 
 namespace Represent
 {
 	int isNumericInBase(char ch, size_t base)
 	{
-		const char * numbers = "0123456789ABCDEF";
-		
-		size_t ind = std::find(numbers, numbers + 16, ch) - numbers;
-		if (ind >= base)
+		int value = -1;
+		if (ch >= '0' && ch <= '9')
+		{
+			value = ch - '0';
+		}
+		else if (ch >= 'A' && ch <= 'F')
+		{
+			value = ch - 'A' + 10;
+		}
+
+		if (value < 0 || static_cast<size_t>(value) >= base)
 		{
 			return -1;
 		}
-		return static_cast<int>(ind);
+		return value;
 	}
 
 	size_t begins(const char * begin, const char * end, boost::string_ref value)
@@ -34,4 +42,14 @@ namespace Represent
 
 		return value.size();
 	}
+
+	const char * skipWhitespace(const char * begin, const char * end)
+	{
+		while (begin != end && isspace(static_cast<unsigned char>(*begin)))
+		{
+			++begin;
+		}
+
+		return begin;
+	}
 }
\ No newline at end of file
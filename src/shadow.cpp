@@ -0,0 +1,242 @@
+#include "shadow.hpp"
+
+#include <boost/math/special_functions/fpclassify.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace Represent
+{
+	Shadow::Shadow()
+		:full(0)
+		,dbl(0)
+		,flt(0)
+	{}
+
+	Shadow::Shadow(const Value& full, double dbl, float flt)
+		:full(full)
+		,dbl(dbl)
+		,flt(flt)
+	{}
+
+	Shadow& Shadow::operator+=(const Shadow& other)
+	{
+		full += other.full;
+		dbl += other.dbl;
+		flt += other.flt;
+		return *this;
+	}
+
+	Shadow& Shadow::operator-=(const Shadow& other)
+	{
+		full -= other.full;
+		dbl -= other.dbl;
+		flt -= other.flt;
+		return *this;
+	}
+
+	Shadow& Shadow::operator*=(const Shadow& other)
+	{
+		full *= other.full;
+		dbl *= other.dbl;
+		flt *= other.flt;
+		return *this;
+	}
+
+	Shadow& Shadow::operator/=(const Shadow& other)
+	{
+		full /= other.full;
+		dbl /= other.dbl;
+		flt /= other.flt;
+		return *this;
+	}
+
+	Shadow Shadow::operator-() const
+	{
+		return Shadow(-full, -dbl, -flt);
+	}
+
+	Shadow Shadow::operator+() const
+	{
+		return *this;
+	}
+
+	std::ostream& operator<<(std::ostream& o, const Shadow& s)
+	{
+		o << s.full;
+		return o;
+	}
+
+	namespace
+	{
+		bool evenBits(double d)
+		{
+			boost::uint64_t bits;
+			std::memcpy(&bits, &d, sizeof(d));
+			return (bits & 1) == 0;
+		}
+
+		bool evenBits(float f)
+		{
+			boost::uint32_t bits;
+			std::memcpy(&bits, &f, sizeof(f));
+			return (bits & 1) == 0;
+		}
+
+		//v rounded to the nearest F, ties to even. convert_to is not correctly rounded, so this
+		//walks from its result to the Fs on either side of v.
+		template<typename F>
+		F nearest(const Value& v)
+		{
+			F f = v.convert_to<F>();
+			if (!v.backend().isfinite())
+			{
+				return f;
+			}
+
+			const F largest = std::numeric_limits<F>::max();
+			const F infinity = std::numeric_limits<F>::infinity();
+
+			//The largest F not above v, unless v is below every F.
+			f = std::max(std::min(f, largest), -largest);
+			while (f > -largest && exactValue(f) > v)
+			{
+				f = std::nextafter(f, -infinity);
+			}
+
+			while (f < largest && exactValue(std::nextafter(f, infinity)) <= v)
+			{
+				f = std::nextafter(f, infinity);
+			}
+
+			F down = f;
+			F up = std::nextafter(f, infinity);
+			if (exactValue(f) > v)
+			{
+				down = -infinity;
+				up = f;
+			}
+
+			//Past the largest F, infinity is rounded to as if it were the next power of two.
+			const Value limit = Value(Value::backend_type::pow2(std::numeric_limits<F>::max_exponent));
+			Value under = v - (down == -infinity ? -limit : exactValue(down));
+			Value over = (up == infinity ? limit : exactValue(up)) - v;
+
+			if (under != over)
+			{
+				return under < over ? down : up;
+			}
+
+			return evenBits(down) ? down : up;
+		}
+	}
+
+	Shadow convertValue(const Value& v, Shadow *)
+	{
+		return Shadow(v, nearest<double>(v), nearest<float>(v));
+	}
+
+	template<>
+	Shadow convertAs<Shadow>(boost::string_ref digits, size_t base)
+	{
+		return Shadow(convertAs<Value>(digits, base), convertAs<double>(digits, base), convertAs<float>(digits, base));
+	}
+
+	namespace
+	{
+		//Maps the bits of a float or double to an integer that orders like the number does,
+		//so that adjacent numbers differ by one.
+		template<typename Bits, typename F>
+		Bits ordered(F f)
+		{
+			Bits bits;
+			std::memcpy(&bits, &f, sizeof(f));
+
+			const Bits sign = Bits(1) << (sizeof(Bits) * 8 - 1);
+			return (bits & sign) ? ~bits + 1 : bits | sign;
+		}
+
+		template<typename Bits, typename F>
+		boost::uint64_t distance(F a, F b)
+		{
+			bool nanA = (boost::math::isnan)(a);
+			bool nanB = (boost::math::isnan)(b);
+			if (nanA || nanB)
+			{
+				return nanA == nanB ? 0 : std::numeric_limits<boost::uint64_t>::max();
+			}
+
+			Bits x = ordered<Bits>(a);
+			Bits y = ordered<Bits>(b);
+			return x > y ? x - y : y - x;
+		}
+
+		//Approximates v to about 16 significant digits, which is plenty for an error term.
+		double approximate(const Value& v)
+		{
+			double mantissa = 0;
+			int exponent = 0;
+			v.backend().extract_parts(mantissa, exponent);
+
+			return mantissa * std::pow(10.0, exponent);
+		}
+
+		//The error of part in its own ULPs, rounded to the nearest. Below a power of two the
+		//numbers are twice as dense, so an error towards zero is counted in the smaller ULP.
+		template<typename F>
+		boost::uint64_t ulpsAway(F part, double error)
+		{
+			const double smallest = std::numeric_limits<F>::denorm_min();
+
+			int exponent = 0;
+			double fraction = std::frexp(static_cast<double>(part), &exponent);
+
+			double ulp = part == 0 ? smallest : std::max(std::ldexp(1.0, exponent - std::numeric_limits<F>::digits), smallest);
+			if (std::fabs(fraction) == 0.5 && (error < 0) != (part < 0))
+			{
+				ulp = std::max(ulp / 2, smallest);
+			}
+
+			double ulps = std::floor(std::fabs(error) / ulp + 0.5);
+			if (!(ulps < static_cast<double>(std::numeric_limits<boost::uint64_t>::max())))
+			{
+				return std::numeric_limits<boost::uint64_t>::max();
+			}
+
+			return static_cast<boost::uint64_t>(ulps);
+		}
+	}
+
+	boost::uint64_t doubleUlps(const Shadow& s)
+	{
+		if (!(boost::math::isfinite)(s.dbl) || !s.full.backend().isfinite())
+		{
+			return ulpDistance(s.dbl, s.full.convert_to<double>());
+		}
+
+		//The double has to be subtracted in full precision, since its error is below its own.
+		return ulpsAway(s.dbl, approximate(s.full - exactValue(s.dbl)));
+	}
+
+	boost::uint64_t floatUlps(const Shadow& s)
+	{
+		double full = approximate(s.full);
+		if (!(boost::math::isfinite)(s.flt) || !(boost::math::isfinite)(full))
+		{
+			return ulpDistance(s.flt, s.full.convert_to<float>());
+		}
+
+		return ulpsAway(s.flt, full - s.flt);
+	}
+
+	boost::uint64_t ulpDistance(double a, double b)
+	{
+		return distance<boost::uint64_t>(a, b);
+	}
+
+	boost::uint64_t ulpDistance(float a, float b)
+	{
+		return distance<boost::uint32_t>(a, b);
+	}
+}
@@ -2,9 +2,37 @@
 #include "parserutils.hpp"
 
 #include <cassert>
+#include <cstring>
 
 namespace Represent
 {
+	namespace
+	{
+		const OperatorEntry operators[] = {
+			{ "+" , OPERATOR_PLUS, 10, 0, false },
+			{ "-" , OPERATOR_MINUS, 10, 0, false },
+			{ "*" , OPERATOR_MULTIPLY, 20, 0, false },
+			{ "/" , OPERATOR_DIVIDE, 20, 0, false },
+			{ ".+", OPERATOR_COMPONENT_PLUS, 10, 0, false },
+			{ ".-", OPERATOR_COMPONENT_MINUS, 10, 0, false },
+			{ ".*", OPERATOR_COMPONENT_MULTIPLY, 20, 0, false },
+			{ "./", OPERATOR_COMPONENT_DIVIDE, 20, 0, false },
+			{ "<<", OPERATOR_SHIFT_LEFT, 8, 0, false },
+			{ ">>", OPERATOR_SHIFT_RIGHT, 8, 0, false },
+			{ "<<<", OPERATOR_ROTATE_LEFT, 8, 0, false },
+			{ ">>>", OPERATOR_ROTATE_RIGHT, 8, 0, false },
+			{ "s<<", OPERATOR_ARITHMETIC_SHIFT_LEFT, 8, 0, false },
+			{ "s>>", OPERATOR_ARITHMETIC_SHIFT_RIGHT, 8, 0, false },
+			{ "&" , OPERATOR_AND, 6, 0, false },
+			{ "|" , OPERATOR_OR, 4, 0, false },
+			{ "+" , OPERATOR_UNARY_PLUS, 90, 1, true },
+			{ "-" , OPERATOR_UNARY_MINUS, 90, 1, true },
+			{ "~" , OPERATOR_NOT, 90, 1, true },
+		};
+
+		const OperatorEntry * operatorsEnd = operators + sizeof(operators) / sizeof(operators[0]);
+	}
+
 	const TableEntry * lookup(const TableEntry * begin, const TableEntry * end, const char * b, const char * e, size_t * consumed)
 	{
 		assert(begin && end && b && e && consumed);
@@ -23,4 +51,41 @@ namespace Represent
 
 		return NULL;
 	}
-}
\ No newline at end of file
+
+	const OperatorEntry * operatorLookup(boost::uint32_t op)
+	{
+		for (const OperatorEntry * it = operators; it != operatorsEnd; ++it)
+		{
+			if (it->op == op)
+			{
+				return it;
+			}
+		}
+
+		return NULL;
+	}
+
+	const OperatorEntry * matchOperator(const char * b, const char * e, bool unary, size_t * consumed)
+	{
+		assert(b && e && consumed);
+		*consumed = 0;
+
+		const OperatorEntry * best = NULL;
+		for (const OperatorEntry * it = operators; it != operatorsEnd; ++it)
+		{
+			if (it->unary != unary)
+			{
+				continue;
+			}
+
+			size_t matched = begins(b, e, it->string);
+			if (matched > *consumed)
+			{
+				*consumed = matched;
+				best = it;
+			}
+		}
+
+		return best;
+	}
+}
@@ -0,0 +1,160 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+
+namespace Represent
+{
+	ThreadPool::ThreadPool(size_t count)
+		:ranges(count ? count : std::max(1u, boost::thread::hardware_concurrency()))
+		,body(NULL)
+		,generation(0)
+		,active(0)
+		,stopping(false)
+	{
+		for (size_t i = 0; i < ranges.size(); ++i)
+		{
+			ranges[i].begin = ranges[i].end = 0;
+			threads.create_thread(boost::bind(&ThreadPool::work, this, i));
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		wake.notify_all();
+		threads.join_all();
+	}
+
+	size_t ThreadPool::size() const
+	{
+		return ranges.size();
+	}
+
+	void ThreadPool::run(size_t count, const Task& task)
+	{
+		//Split the tasks evenly, in order, so that workers start far apart.
+		for (size_t i = 0; i < ranges.size(); ++i)
+		{
+			boost::lock_guard<boost::mutex> lock(ranges[i].mutex);
+			ranges[i].begin = count * i / ranges.size();
+			ranges[i].end = count * (i + 1) / ranges.size();
+		}
+
+		boost::unique_lock<boost::mutex> lock(mutex);
+		body = &task;
+		active = ranges.size();
+		error = std::exception_ptr();
+		++generation;
+
+		wake.notify_all();
+		while (active > 0)
+		{
+			finished.wait(lock);
+		}
+
+		body = NULL;
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
+	void ThreadPool::work(size_t worker)
+	{
+		size_t seen = 0;
+		while (true)
+		{
+			const Task * task;
+			{
+				boost::unique_lock<boost::mutex> lock(mutex);
+				while (generation == seen && !stopping)
+				{
+					wake.wait(lock);
+				}
+
+				if (stopping)
+				{
+					return;
+				}
+
+				seen = generation;
+				task = body;
+			}
+
+			size_t index;
+			while (pop(worker, index) || steal(worker, index))
+			{
+				try
+				{
+					(*task)(index, worker);
+				} catch (...)
+				{
+					boost::lock_guard<boost::mutex> lock(mutex);
+					if (!error)
+					{
+						error = std::current_exception();
+					}
+				}
+			}
+
+			boost::lock_guard<boost::mutex> lock(mutex);
+			if (--active == 0)
+			{
+				finished.notify_all();
+			}
+		}
+	}
+
+	bool ThreadPool::pop(size_t worker, size_t& task)
+	{
+		Range& range = ranges[worker];
+		boost::lock_guard<boost::mutex> lock(range.mutex);
+
+		if (range.begin == range.end)
+		{
+			return false;
+		}
+
+		task = range.begin++;
+		return true;
+	}
+
+	bool ThreadPool::steal(size_t worker, size_t& task)
+	{
+		for (size_t i = 1; i < ranges.size(); ++i)
+		{
+			Range& victim = ranges[(worker + i) % ranges.size()];
+
+			size_t begin, end;
+			{
+				boost::lock_guard<boost::mutex> lock(victim.mutex);
+				if (victim.begin == victim.end)
+				{
+					continue;
+				}
+
+				//The back half, or the last task.
+				begin = victim.begin + (victim.end - victim.begin) / 2;
+				end = victim.end;
+				victim.end = begin;
+			}
+
+			//Only this worker adds to its own range, and it is empty, so nothing is lost by 
+			//replacing it.
+			{
+				boost::lock_guard<boost::mutex> lock(ranges[worker].mutex);
+				ranges[worker].begin = begin + 1;
+				ranges[worker].end = end;
+			}
+
+			task = begin;
+			return true;
+		}
+
+		return false;
+	}
+}
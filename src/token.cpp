@@ -1,17 +1,21 @@
 #include "token.hpp"
 
+#include <cassert>
+
 namespace Represent
 {
 	Token::Token(TokenType type, boost::uint32_t value)
 		:type(type)
-		,value(value)
 		,extra(0)
+		,value(value)
+		,offset(0)
 	{}
 
 	Token::Token(TokenType type, boost::uint32_t value, boost::uint16_t extra)
 		:type(type)
-		,value(value)
 		,extra(extra)
+		,value(value)
+		,offset(0)
 	{}
 
 	bool Token::operator==(const Token& tk) const
@@ -34,6 +38,13 @@ namespace Represent
 		return o;
 	}
 
+	TokenStream::TokenStream()
+	{}
+
+	TokenStream::TokenStream(boost::string_ref source)
+		:source(source)
+	{}
+
 	void TokenStream::push(const Token& tk)
 	{
 		tokens.push_back(tk);
@@ -85,6 +96,43 @@ namespace Represent
 		return tokens.clear();
 	}
 
+	TokenStream::Mark TokenStream::mark() const
+	{
+		return tokens.size();
+	}
+
+	void TokenStream::rollback(Mark mark)
+	{
+		assert(mark <= tokens.size());
+		tokens.resize(mark, Token(TOKEN_PAREN, 0));
+	}
+
+	Token& TokenStream::at(size_t index)
+	{
+		return tokens.at(index);
+	}
+
+	void TokenStream::reserve(size_t count)
+	{
+		tokens.reserve(count);
+	}
+
+	boost::string_ref TokenStream::getSource() const
+	{
+		return source;
+	}
+
+	boost::uint32_t TokenStream::offsetOf(const char * position) const
+	{
+		assert(position >= source.data() && position <= source.data() + source.size());
+		return static_cast<boost::uint32_t>(position - source.data());
+	}
+
+	boost::string_ref TokenStream::lexeme(const Token& tk) const
+	{
+		return source.substr(tk.offset, tk.value);
+	}
+
 	std::string toString(TokenType tk)
 	{
 		CONVERT_TO_NARROW_STRING(Represent, tk, TOKEN_SOURCE);
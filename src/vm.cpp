@@ -0,0 +1,651 @@
+#include "vm.hpp"
+#include "tables.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <boost/unordered_map.hpp>
+
+namespace Represent
+{
+	namespace
+	{
+		const boost::uint32_t UNSAVED = std::numeric_limits<boost::uint32_t>::max();
+
+		bool isLoad(const Token& tk)
+		{
+			return tk.type == TOKEN_RAW_VALUE || tk.type == TOKEN_LITERAL_REFERENCE || tk.type == TOKEN_STORAGE_REFERENCE;
+		}
+
+		bool isScalar(const Instruction& instruction)
+		{
+			switch (instruction.type)
+			{
+				case INSTRUCTION_LOAD_RAW:
+				case INSTRUCTION_LOAD_LITERAL:
+				case INSTRUCTION_LOAD_SCALAR:
+				case INSTRUCTION_SCALAR_BINARY:
+				case INSTRUCTION_SCALAR_UNARY:
+				case INSTRUCTION_COPY_SCALAR:
+					return true;
+
+				default:
+					return false;
+			}
+		}
+
+		//The RPN hash consed into a DAG, in which identical subtrees are a single node. Calls to 
+		//functions that are not pure are never shared.
+		struct Dag
+		{
+			struct Node
+			{
+				Token token;
+				std::vector<boost::uint32_t> operands;
+
+				//The number of edges into the node, counting the root as one.
+				boost::uint32_t uses;
+			};
+
+			Dag(const TokenStream& rpn, const std::vector<SlotInfo>& slots)
+				:depth(0)
+				,deduplicated(0)
+			{
+				boost::unordered_map<std::vector<boost::uint32_t>, boost::uint32_t> ids;
+				std::vector<boost::uint32_t> stack;
+
+				for (auto it = rpn.begin(); it != rpn.end(); ++it)
+				{
+					boost::uint32_t count = operandCount(*it);
+					if (stack.size() < count)
+					{
+						throw "Not enough operands";
+					}
+
+					//A node is its token and the nodes of its operands.
+					std::vector<boost::uint32_t> key;
+					key.push_back(it->type);
+					key.push_back(it->value);
+					key.push_back(it->extra);
+					key.insert(key.end(), stack.end() - count, stack.end());
+
+					bool shared = it->type != TOKEN_FUNCTION_IDENTIFIER || (it->value < slots.size() && slots[it->value].pure);
+					auto found = shared ? ids.find(key) : ids.end();
+
+					boost::uint32_t id;
+					if (found != ids.end())
+					{
+						id = found->second;
+						++deduplicated;
+					}
+					else
+					{
+						id = static_cast<boost::uint32_t>(nodes.size());
+
+						Node node = { *it, std::vector<boost::uint32_t>(stack.end() - count, stack.end()), 0 };
+						for (auto op = node.operands.begin(); op != node.operands.end(); ++op)
+						{
+							++nodes[*op].uses;
+						}
+
+						nodes.push_back(node);
+						if (shared)
+						{
+							ids[key] = id;
+						}
+					}
+
+					stack.resize(stack.size() - count);
+					stack.push_back(id);
+					depth = std::max<boost::uint32_t>(depth, static_cast<boost::uint32_t>(stack.size()));
+				}
+
+				if (stack.size() != 1)
+				{
+					throw "An expression must leave exactly one result";
+				}
+
+				root = stack.back();
+				++nodes[root].uses;
+			}
+
+			std::vector<Node> nodes;
+			boost::uint32_t root;
+
+			//The deepest the evaluation stack of the RPN gets.
+			boost::uint32_t depth;
+			boost::uint32_t deduplicated;
+		};
+
+		//Rejects tk, whose operands are of types it does not take.
+		void invalid(const Token& tk, const CellType * operands, boost::uint32_t count)
+		{
+			const OperatorEntry * entry = tk.type == TOKEN_OPERATOR ? operatorLookup(tk.value) : NULL;
+
+			std::ostringstream message;
+			message << "Invalid arguments to ";
+			switch (tk.type)
+			{
+				case TOKEN_VECTOR: message << "vector"; break;
+				case TOKEN_QUATERNION: message << "quaternion"; break;
+				case TOKEN_MATRIX: message << "matrix"; break;
+				case TOKEN_ARRAY: message << "array"; break;
+				default: message << (entry ? entry->string : "operator"); break;
+			}
+
+			message << ": ";
+			for (boost::uint32_t i = 0; i < count; ++i)
+			{
+				message << (i == 0 ? "" : i + 1 == count ? " and " : ", ") << cellTypeName(operands[i]);
+			}
+
+			throw InvalidArguments(message.str());
+		}
+
+		//The type of the result of tk, given the types of its operands. Only a function may 
+		//take a type that is not known until it runs, or an operator on the result of one.
+		CellType resultType(const Token& tk, const CellType * operands, const std::vector<SlotInfo>& slots)
+		{
+			boost::uint32_t count = operandCount(tk);
+			auto all = [&](CellType type)
+			{
+				return std::find_if(operands, operands + count, 
+					[type](CellType operand) { return operand != type && operand != CELL_DYNAMIC; }) == operands + count;
+			};
+
+			switch (tk.type)
+			{
+				case TOKEN_RAW_VALUE:
+				case TOKEN_LITERAL_REFERENCE:
+					return CELL_SCALAR;
+
+				case TOKEN_STORAGE_REFERENCE:
+					return tk.value < slots.size() ? slots[tk.value].type : CELL_DYNAMIC;
+
+				case TOKEN_OPERATOR:
+				{
+					CellType result;
+					if (count == 1)
+					{
+						result = operands[0] == CELL_DYNAMIC ? CELL_DYNAMIC : operands[0] == CELL_SCALAR ? CELL_SCALAR : CELL_INVALID;
+					}
+					else
+					{
+						result = operands[0] == CELL_DYNAMIC || operands[1] == CELL_DYNAMIC ? CELL_DYNAMIC : 
+							binaryType(tk.value, operands[0], operands[1]);
+					}
+
+					if (result == CELL_INVALID)
+					{
+						invalid(tk, operands, count);
+					}
+
+					return result;
+				}
+
+				case TOKEN_VECTOR:
+				case TOKEN_QUATERNION:
+					if (!all(CELL_SCALAR))
+					{
+						invalid(tk, operands, count);
+					}
+
+					return tk.type == TOKEN_VECTOR ? CELL_VECTOR : CELL_QUATERNION;
+
+				case TOKEN_MATRIX:
+					if (!all(CELL_VECTOR))
+					{
+						invalid(tk, operands, count);
+					}
+
+					return CELL_MATRIX;
+
+				//The elements of an array must all be of one type.
+				case TOKEN_ARRAY:
+				{
+					const CellType * known = std::find_if(operands, operands + count, 
+						[](CellType operand) { return operand != CELL_DYNAMIC; });
+					if (known != operands + count && !all(*known))
+					{
+						invalid(tk, operands, count);
+					}
+
+					return CELL_ARRAY;
+				}
+
+				case TOKEN_FUNCTION_IDENTIFIER:
+					return CELL_DYNAMIC;
+
+				default:
+				{
+					std::cout << "Unexpected token: " << tk << "\n";
+					throw "Unexpected Token";
+				}
+			}
+		}
+
+		//Where the value of a register is kept.
+		enum RegisterFile
+		{
+			FILE_SCALAR,
+			FILE_VECTOR,
+			FILE_CELL
+		};
+
+		struct Register
+		{
+			CellType type;
+			RegisterFile file;
+		};
+
+		class Compiler
+		{
+		public:
+			Compiler(Bytecode& result, const std::vector<SlotInfo>& slots, const Dag& dag)
+				:result(result)
+				,slots(slots)
+				,dag(dag)
+				,saved(dag.nodes.size(), UNSAVED)
+				,savedRegister(dag.nodes.size())
+				,temporaries(0)
+			{}
+
+			//Pushes the result of a node of the DAG, computing it only the first time.
+			void node(boost::uint32_t id)
+			{
+				if (saved[id] != UNSAVED)
+				{
+					load(copy(savedRegister[id].file), saved[id], savedRegister[id]);
+					return;
+				}
+
+				const Dag::Node& current = dag.nodes[id];
+				for (auto it = current.operands.begin(); it != current.operands.end(); ++it)
+				{
+					node(*it);
+				}
+
+				token(current.token);
+
+				//Shared results are kept above the deepest the stack can get. Loads are as cheap 
+				//as copies, so they are repeated instead.
+				if (current.uses > 1 && !isLoad(current.token))
+				{
+					saved[id] = dag.depth + temporaries++;
+					savedRegister[id] = registers.back();
+
+					emit(copy(savedRegister[id].file), saved[id], depth() - 1);
+					result.registers = std::max<boost::uint32_t>(result.registers, saved[id] + 1);
+				}
+			}
+
+			//Pushes a register, loaded by type.
+			void load(InstructionType type, boost::uint32_t source, Register loaded)
+			{
+				emit(type, depth(), source);
+				replace(0, loaded);
+			}
+
+			void token(const Token& tk)
+			{
+				boost::uint32_t count = operandCount(tk);
+				boost::uint32_t target = operands(count);
+
+				std::vector<CellType> types(count);
+				for (boost::uint32_t i = 0; i < count; ++i)
+				{
+					types[i] = registers[target + i].type;
+				}
+
+				CellType type = resultType(tk, types.data(), slots);
+
+				switch (tk.type)
+				{
+					case TOKEN_RAW_VALUE:
+						load(INSTRUCTION_LOAD_RAW, tk.value, scalar());
+						break;
+
+					case TOKEN_LITERAL_REFERENCE:
+						load(INSTRUCTION_LOAD_LITERAL, tk.value, scalar());
+						break;
+
+					case TOKEN_STORAGE_REFERENCE:
+						if (type == CELL_SCALAR)
+						{
+							load(INSTRUCTION_LOAD_SCALAR, tk.value, scalar());
+						}
+						else if (type == CELL_VECTOR)
+						{
+							load(INSTRUCTION_LOAD_VECTOR, tk.value, vector());
+						}
+						else
+						{
+							load(INSTRUCTION_LOAD_STORAGE, tk.value, cell(type));
+						}
+						break;
+
+					case TOKEN_OPERATOR:
+						if (count == 1)
+						{
+							unary(tk.value, target, type);
+						}
+						else
+						{
+							binary(tk.value, target, type);
+						}
+						break;
+
+					//Vectors and quaternions are built from scalars, and matrices from vectors.
+					case TOKEN_VECTOR:
+						toScalars(target, 4);
+						emit(INSTRUCTION_VECTOR, target, target, 4);
+						replace(4, vector());
+						break;
+
+					case TOKEN_QUATERNION:
+						toScalars(target, 4);
+						emit(INSTRUCTION_QUATERNION, target, target, 4);
+						replace(4, cell(type));
+						break;
+
+					case TOKEN_MATRIX:
+						toVectors(target, 4);
+						emit(INSTRUCTION_MATRIX, target, target, 4);
+						replace(4, cell(type));
+						break;
+
+					case TOKEN_ARRAY:
+						toCells(target, count);
+						emit(INSTRUCTION_ARRAY, target, target, count);
+						replace(count, cell(type));
+						break;
+
+					//Functions take cells, and leave a single result.
+					case TOKEN_FUNCTION_IDENTIFIER:
+						toCells(target, count);
+						emit(INSTRUCTION_CALL, target, tk.value, count);
+						replace(count, cell(type));
+						break;
+				}
+			}
+
+			//Leaves the result where the bytecode is expected to, and returns where that is.
+			Register finish()
+			{
+				if (registers[0].file == FILE_VECTOR)
+				{
+					toCells(0, 1);
+				}
+
+				return registers[0];
+			}
+
+		private:
+			void unary(boost::uint32_t op, boost::uint32_t target, CellType type)
+			{
+				if (type == CELL_SCALAR)
+				{
+					toScalars(target, 1);
+					emit(INSTRUCTION_SCALAR_UNARY, target, target, 1, op);
+					replace(1, scalar());
+				}
+				else
+				{
+					emit(INSTRUCTION_UNARY, target, target, 1, op);
+					replace(1, cell(type));
+				}
+			}
+
+			void binary(boost::uint32_t op, boost::uint32_t target, CellType type)
+			{
+				CellType a = registers[target].type;
+				CellType b = registers[target + 1].type;
+
+				if (type == CELL_SCALAR)
+				{
+					toScalars(target, 2);
+					emit(INSTRUCTION_SCALAR_BINARY, target, target + 1, 2, op);
+					replace(2, scalar());
+				}
+				else if (type == CELL_VECTOR)
+				{
+					VectorShape shape = b == CELL_SCALAR ? SHAPE_VECTOR_SCALAR : a == CELL_SCALAR ? SHAPE_SCALAR_VECTOR : SHAPE_VECTOR_VECTOR;
+					for (boost::uint32_t i = target; i < target + 2; ++i)
+					{
+						if (registers[i].type == CELL_SCALAR)
+						{
+							toScalars(i, 1);
+						}
+						else
+						{
+							toVectors(i, 1);
+						}
+					}
+
+					emit(INSTRUCTION_VECTOR_BINARY, target, target + 1, shape, op);
+					replace(2, vector());
+				}
+				else
+				{
+					toCells(target, 2);
+					if (type == CELL_DYNAMIC)
+					{
+						emit(INSTRUCTION_BINARY, target, target + 1, 2, op);
+					}
+					else
+					{
+						emit(INSTRUCTION_TYPED_BINARY, target, target + 1, a * CELL_TYPE_COUNT + b, op);
+					}
+
+					replace(2, cell(type));
+				}
+			}
+
+			static Register scalar()
+			{
+				Register result = { CELL_SCALAR, FILE_SCALAR };
+				return result;
+			}
+
+			static Register vector()
+			{
+				Register result = { CELL_VECTOR, FILE_VECTOR };
+				return result;
+			}
+
+			static Register cell(CellType type)
+			{
+				Register result = { type, FILE_CELL };
+				return result;
+			}
+
+			static InstructionType copy(RegisterFile file)
+			{
+				return file == FILE_SCALAR ? INSTRUCTION_COPY_SCALAR : file == FILE_VECTOR ? INSTRUCTION_COPY_VECTOR : INSTRUCTION_COPY;
+			}
+
+			boost::uint32_t depth() const
+			{
+				return static_cast<boost::uint32_t>(registers.size());
+			}
+
+			//The first of the top count registers.
+			boost::uint32_t operands(boost::uint32_t count)
+			{
+				if (depth() < count)
+				{
+					throw "Not enough operands";
+				}
+
+				return depth() - count;
+			}
+
+			//Replaces the top count registers with one result.
+			void replace(boost::uint32_t count, Register replacement)
+			{
+				registers.resize(registers.size() - count);
+				registers.push_back(replacement);
+				result.registers = std::max<boost::uint32_t>(result.registers, depth());
+			}
+
+			void toCells(boost::uint32_t first, boost::uint32_t count)
+			{
+				for (boost::uint32_t i = first; i < first + count; ++i)
+				{
+					if (registers[i].file != FILE_CELL)
+					{
+						emit(registers[i].file == FILE_SCALAR ? INSTRUCTION_BOX : INSTRUCTION_BOX_VECTOR, i, i);
+						registers[i].file = FILE_CELL;
+					}
+				}
+			}
+
+			//Only a scalar, or the result of a function, which is checked, can be unboxed.
+			void toScalars(boost::uint32_t first, boost::uint32_t count)
+			{
+				for (boost::uint32_t i = first; i < first + count; ++i)
+				{
+					if (registers[i].file != FILE_SCALAR)
+					{
+						emit(INSTRUCTION_UNBOX, i, i);
+						registers[i] = scalar();
+					}
+				}
+			}
+
+			void toVectors(boost::uint32_t first, boost::uint32_t count)
+			{
+				for (boost::uint32_t i = first; i < first + count; ++i)
+				{
+					if (registers[i].file != FILE_VECTOR)
+					{
+						emit(INSTRUCTION_UNBOX_VECTOR, i, i);
+						registers[i] = vector();
+					}
+				}
+			}
+
+			void emit(InstructionType type, boost::uint32_t target, boost::uint32_t source, boost::uint32_t count = 0, boost::uint32_t op = 0)
+			{
+				Instruction instruction = { static_cast<boost::uint16_t>(type), static_cast<boost::uint16_t>(op), target, source, count };
+				result.code.push_back(instruction);
+			}
+
+			Bytecode& result;
+			const std::vector<SlotInfo>& slots;
+			const Dag& dag;
+
+			//The register each shared node was saved in, and what it holds.
+			std::vector<boost::uint32_t> saved;
+			std::vector<Register> savedRegister;
+			boost::uint32_t temporaries;
+
+			//The type of each register on the evaluation stack, and the file it is in.
+			std::vector<Register> registers;
+		};
+	}
+
+	Bytecode compile(const TokenStream& rpn, const std::vector<SlotInfo>& slots)
+	{
+		Dag dag(rpn, slots);
+
+		Bytecode result;
+		result.registers = 0;
+		result.deduplicated = dag.deduplicated;
+		result.code.reserve(rpn.end() - rpn.begin());
+
+		Compiler compiler(result, slots, dag);
+		compiler.node(dag.root);
+
+		Register root = compiler.finish();
+		result.scalarResult = root.file == FILE_SCALAR;
+		result.resultType = root.type;
+		result.scalarOnly = std::find_if(result.code.begin(), result.code.end(), 
+			[](const Instruction& instruction) { return !isScalar(instruction); }) == result.code.end();
+		return result;
+	}
+
+	CellType infer(const TokenStream& rpn, const std::vector<SlotInfo>& slots)
+	{
+		std::vector<CellType> stack;
+		for (auto it = rpn.begin(); it != rpn.end(); ++it)
+		{
+			boost::uint32_t count = operandCount(*it);
+			if (stack.size() < count)
+			{
+				throw "Not enough operands";
+			}
+
+			CellType type = resultType(*it, stack.data() + stack.size() - count, slots);
+			stack.resize(stack.size() - count);
+			stack.push_back(type);
+		}
+
+		if (stack.size() != 1)
+		{
+			throw "An expression must leave exactly one result";
+		}
+
+		return stack.back();
+	}
+
+	boost::uint32_t operandCount(const Token& tk)
+	{
+		switch (tk.type)
+		{
+			case TOKEN_OPERATOR:
+			{
+				const OperatorEntry * entry = operatorLookup(tk.value);
+				return entry && entry->unary ? 1 : 2;
+			}
+
+			case TOKEN_VECTOR:
+			case TOKEN_QUATERNION:
+			case TOKEN_MATRIX:
+				return 4;
+
+			case TOKEN_ARRAY:
+				return tk.value;
+
+			case TOKEN_FUNCTION_IDENTIFIER:
+				return tk.extra;
+
+			default:
+				return 0;
+		}
+	}
+
+	const char * cellTypeName(CellType type)
+	{
+		static const char * names[] = 
+		{
+			"number", "vector", "quaternion", "matrix", "array", "string", "function", "identifier", "null", "function result"
+		};
+
+		return type < CELL_INVALID ? names[type] : "invalid";
+	}
+
+	std::string toString(InstructionType type)
+	{
+		CONVERT_TO_NARROW_STRING(Represent, type, INSTRUCTION_TYPES);
+	}
+
+	std::ostream& operator<<(std::ostream& o, const Instruction& instruction)
+	{
+		o << toString(static_cast<InstructionType>(instruction.type)) << " r" << instruction.target << ", " << instruction.source;
+
+		bool op = instruction.type == INSTRUCTION_SCALAR_BINARY || instruction.type == INSTRUCTION_SCALAR_UNARY ||
+			instruction.type == INSTRUCTION_VECTOR_BINARY || instruction.type == INSTRUCTION_TYPED_BINARY ||
+			instruction.type == INSTRUCTION_BINARY || instruction.type == INSTRUCTION_UNARY;
+		if (op)
+		{
+			o << " (operator " << instruction.op << ")";
+		}
+		else if (instruction.count)
+		{
+			o << " [" << instruction.count << "]";
+		}
+
+		return o;
+	}
+}
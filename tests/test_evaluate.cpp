@@ -1,5 +1,9 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <cmath>
+#include <limits>
 
 #include "eval.hpp"
 #include "function.hpp"
@@ -62,6 +66,7 @@ namespace
 
 	GenericFunction<Increment> incr;
 	GenericFunction<Len> stringlength;
+	GenericFunction<PopCount> popcount;
 
 	typedef Math::Vector4<Value> Vector4V;
 	typedef Math::Quaternion<Value> QuaternionV;
@@ -178,4 +183,795 @@ BOOST_AUTO_TEST_CASE(eval_paren_expr)
 	Represent::Value a = ctx.evaluateAs<Represent::Value>();
 
 	BOOST_CHECK_EQUAL(a.convert_to<int>(), 4);
-}
\ No newline at end of file
+}
+BOOST_AUTO_TEST_CASE(literals_convert_per_precision)
+{
+	Represent::EvaluationContext ctx("0.1 + 0.2");
+
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value("0.3"));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value(0.1 + 0.2));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, float>()), Represent::Value(0.1f + 0.2f));
+}
+
+BOOST_AUTO_TEST_CASE(compiled_program_sees_defines_and_loads)
+{
+	Represent::EvaluationContext ctx("x + 1");
+	ctx.define("x", Represent::Value(1));
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(2));
+
+	ctx.define("x", Represent::Value(5));
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(6));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value(6));
+
+	ctx.load("x * 2");
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(10));
+}
+
+BOOST_AUTO_TEST_CASE(compiled_program_resolves_aliases)
+{
+	Represent::EvaluationContext ctx("y + 1");
+	ctx.define("x", Represent::Value(4));
+
+	Represent::Identifier alias;
+	alias.name = "x";
+	ctx.define("y", alias);
+
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(5));
+}
+
+BOOST_AUTO_TEST_CASE(typed_storage_follows_defines)
+{
+	Represent::EvaluationContext ctx("x * 2 + 0.5");
+	ctx.define("x", Represent::Value(1));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value("2.5"));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, float>()), Represent::Value("2.5"));
+
+	ctx.define("x", Represent::Value(3));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value("6.5"));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, float>()), Represent::Value("6.5"));
+
+	ctx.load("x + 0.25");
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value("3.25"));
+}
+
+namespace
+{
+	template<typename T>
+	void checkSameCell(const Represent::StorageCell& vm, const Represent::StorageCell& stack)
+	{
+		BOOST_REQUIRE_EQUAL(vm.which(), stack.which());
+		if (const Represent::Value * v = boost::get<Represent::Value>(&vm))
+		{
+			BOOST_CHECK_EQUAL(*v, boost::get<Represent::Value>(stack));
+		}
+		else if (const Vector4V * v = boost::get<Vector4V>(&vm))
+		{
+			BOOST_CHECK_EQUAL(*v, boost::get<Vector4V>(stack));
+		}
+	}
+
+	template<typename T>
+	void checkVmMatchesStack(const char * text)
+	{
+		Represent::EvaluationContext ctx(text);
+		ctx.define("increment", Function(incr));
+		ctx.define("strlen", Function(stringlength));
+		ctx.define("x", Represent::Value("2.5"));
+
+		checkSameCell<T>(ctx.evaluateWith<T>(), ctx.evaluateOnStackWith<T>());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(vm_matches_stack)
+{
+	const char * corpus[] = 
+	{
+		"32", "1 + 1 + 1 + 1", "-42", "+42", "x + 4 * x", "-increment(-increment(4))",
+		"increment(increment(5))", "strlen(`abc` + `123`)", "42 + -41 / 4 - 3",
+		"[1, 2, 3, 4] + [2, 3, 4, 5]", "[1 + 2, (3 + 3) / 2, 4, 4] * 0.5", "[x, x, x, x] - x",
+		"(2 + 2 * (2 + 3)) / (1 + 2)", "strlen({1, 2, 3, x})", "0.1 + 0.2 * x",
+		"(x * 2 + 1) * (x * 2 + 1) - increment(x * 2 + 1)", "[x, 1, x, 1] + [x, 1, x, 1] * (x / 3)"
+	};
+
+	for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); ++i)
+	{
+		checkVmMatchesStack<Represent::Value>(corpus[i]);
+		checkVmMatchesStack<double>(corpus[i]);
+		checkVmMatchesStack<float>(corpus[i]);
+		checkVmMatchesStack<Represent::Value50>(corpus[i]);
+		checkVmMatchesStack<Represent::Quad>(corpus[i]);
+		checkVmMatchesStack<long double>(corpus[i]);
+	}
+}
+
+namespace
+{
+	void checkClose(const Represent::StorageCell& cell, const Represent::StorageCell& expected, const Represent::Value& epsilon)
+	{
+		BOOST_REQUIRE_EQUAL(cell.which(), expected.which());
+		if (const Represent::Value * v = boost::get<Represent::Value>(&cell))
+		{
+			const Represent::Value& e = boost::get<Represent::Value>(expected);
+			BOOST_CHECK_LE(abs(*v - e), abs(e) * epsilon);
+		}
+		else if (const Vector4V * v = boost::get<Vector4V>(&cell))
+		{
+			const Vector4V& e = boost::get<Vector4V>(expected);
+			for (size_t i = 0; i < 4; ++i)
+			{
+				BOOST_CHECK_LE(abs((*v)[i] - e[i]), abs(e[i]) * epsilon);
+			}
+		}
+	}
+
+	//Results in T are within a few roundings of the full precision ones.
+	template<typename T>
+	void checkBackend(const char * text)
+	{
+		Represent::EvaluationContext ctx(text);
+		ctx.define("increment", Function(incr));
+		ctx.define("x", Represent::Value("2.5"));
+
+		Represent::Value epsilon = Represent::Value(std::numeric_limits<T>::epsilon()) * 8;
+		checkClose(ctx.evaluateWith<T>(), ctx.evaluate(), epsilon);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(backends_match_full_precision)
+{
+	const char * corpus[] = 
+	{
+		"1 / 3", "x / 7 - 0.1", "-increment(-increment(4)) / 9", "[1, 2, 3, 4] / 3 + [x, x, x, x]",
+		"(x * 2 + 1) * (x * 2 + 1) - increment(x * 2 + 1) / 11"
+	};
+
+	for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); ++i)
+	{
+		checkBackend<double>(corpus[i]);
+		checkBackend<Represent::Value50>(corpus[i]);
+		checkBackend<Represent::Quad>(corpus[i]);
+		checkBackend<long double>(corpus[i]);
+	}
+
+	//Each keeps more digits than double.
+	Represent::EvaluationContext ctx("1 / 3 * 3 - 1");
+	BOOST_CHECK_LT(abs(ctx.evaluateAsWith<Represent::Value, Represent::Value50>()), Represent::Value("1e-49"));
+	BOOST_CHECK_LT(abs(ctx.evaluateAsWith<Represent::Value, Represent::Quad>()), Represent::Value("1e-33"));
+}
+
+BOOST_AUTO_TEST_CASE(constants_fold_per_precision)
+{
+	//Folded in double, 0.1 + 0.2 is not the double nearest 0.3.
+	Represent::EvaluationContext ctx("(0.1 + 0.2) * x");
+	ctx.define("x", Represent::Value(1));
+
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value("0.3"));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value(0.1 + 0.2));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, float>()), Represent::Value(0.1f + 0.2f));
+	BOOST_CHECK_EQUAL(ctx.evaluateNativeOnStack<double>().which(), 0);
+	BOOST_CHECK_EQUAL(boost::get<double>(ctx.evaluateNativeOnStack<double>()), 0.1 + 0.2);
+}
+
+namespace
+{
+	struct Twice
+	{
+		static const bool pure = true;
+
+		template<typename T, typename Cell>
+		static void invoke(std::vector<Cell>& cell, EvaluationContext& ctx, size_t arity)
+		{
+			T scalar = Detail::popAs<T>(cell);
+			cell.push_back(scalar * 2);
+		}
+	};
+
+	GenericFunction<Twice> twice;
+}
+
+BOOST_AUTO_TEST_CASE(folding_leaves_identifiers)
+{
+	Represent::EvaluationContext ctx("x * (2 + 3) + strlen(`abc`)");
+	ctx.define("strlen", Function(stringlength));
+	ctx.define("x", Represent::Value(2));
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(13));
+
+	ctx.define("x", Represent::Value(3));
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(18));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value(18));
+}
+
+BOOST_AUTO_TEST_CASE(redefined_functions_are_refolded)
+{
+	Represent::EvaluationContext ctx("f(4) + 1");
+	ctx.define("f", Function(incr));
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(6));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value(6));
+
+	ctx.define("f", Function(twice));
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(9));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value(9));
+}
+
+namespace
+{
+	//Not pure: every call returns how many calls came before it, plus its argument.
+	struct Counter
+	{
+		static const bool pure = false;
+		static int calls;
+
+		template<typename T, typename Cell>
+		static void invoke(std::vector<Cell>& cell, EvaluationContext& ctx, size_t arity)
+		{
+			T scalar = Detail::popAs<T>(cell);
+			cell.push_back(scalar + calls++);
+		}
+	};
+
+	int Counter::calls = 0;
+	GenericFunction<Counter> counter;
+}
+
+BOOST_AUTO_TEST_CASE(common_subexpressions_are_computed_once)
+{
+	Represent::EvaluationContext ctx("(x * 2 + 1) * (x * 2 + 1)");
+	ctx.define("x", Represent::Value(3));
+
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(49));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value(49));
+	BOOST_CHECK_EQUAL(ctx.deduplicated(), 5u);
+
+	ctx.load("[x, 1, x, 1] + [x, 1, x, 1] * increment(x)");
+	ctx.define("increment", Function(incr));
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Vector4V>(), Vector4V(15, 5, 15, 5));
+	BOOST_CHECK_EQUAL(ctx.deduplicated(), 8u);
+}
+
+BOOST_AUTO_TEST_CASE(identical_constants_are_folded_once)
+{
+	Represent::EvaluationContext ctx("x * (0.5 + 1.5) + x / strlen(`ab`) - strlen(`ab`)");
+	ctx.define("strlen", Function(stringlength));
+	ctx.define("x", Represent::Value(3));
+
+	//Both strings are the same leaf, so strlen(`ab`) is folded once.
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value("5.5"));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, float>()), Represent::Value("5.5"));
+	BOOST_CHECK_EQUAL(ctx.deduplicated(), 3u);
+}
+
+BOOST_AUTO_TEST_CASE(impure_calls_are_not_shared)
+{
+	Represent::EvaluationContext ctx("count(1) + count(1)");
+	ctx.define("count", Function(counter));
+
+	Counter::calls = 0;
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(3));
+	BOOST_CHECK_EQUAL(ctx.deduplicated(), 1u);
+}
+
+namespace
+{
+	template<typename T>
+	void checkBatchMatchesRows(const char * text)
+	{
+		std::vector<T> xs, ys;
+		for (int i = 0; i < 600; ++i)
+		{
+			xs.push_back(T(i) / 7);
+			ys.push_back(T(600 - i) * 3);
+		}
+
+		Represent::EvaluationContext ctx(text);
+		ctx.define("increment", Function(incr));
+
+		Represent::Column<T> x = { "x", &xs[0] };
+		Represent::Column<T> y = { "y", &ys[0] };
+		std::vector<Represent::Column<T> > inputs;
+		inputs.push_back(x);
+		inputs.push_back(y);
+
+		std::vector<T> output(xs.size());
+		ctx.evaluateBatch(inputs, &output[0], output.size());
+
+		for (size_t i = 0; i < xs.size(); ++i)
+		{
+			ctx.define("x", Represent::Value(xs[i]));
+			ctx.define("y", Represent::Value(ys[i]));
+			BOOST_REQUIRE_EQUAL(Represent::Value(output[i]), (ctx.evaluateAsWith<Represent::Value, T>()));
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(batches_match_rows)
+{
+	const char * corpus[] = { "x * 3 + y", "-x / (x * 2 + 1) + (y - x * 2 + 1) * 0.25", "increment(x) * y - 1" };
+	for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); ++i)
+	{
+		checkBatchMatchesRows<double>(corpus[i]);
+		checkBatchMatchesRows<float>(corpus[i]);
+	}
+
+	checkBatchMatchesRows<Represent::Value>("x * 3 + y");
+}
+
+BOOST_AUTO_TEST_CASE(batches_leave_definitions)
+{
+	Represent::EvaluationContext ctx("increment(x) * y");
+	ctx.define("increment", Function(incr));
+	ctx.define("x", Represent::Value(2));
+	ctx.define("y", Represent::Value(5));
+
+	double xs[] = { 1, 2, 3 };
+	std::vector<Represent::Column<double> > inputs;
+	Represent::Column<double> x = { "x", xs };
+	inputs.push_back(x);
+
+	double output[3];
+	ctx.evaluateBatch(inputs, output, 3);
+	BOOST_CHECK_EQUAL(output[0], 10);
+	BOOST_CHECK_EQUAL(output[2], 20);
+
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value(15));
+}
+
+BOOST_AUTO_TEST_CASE(failed_batches_leave_definitions)
+{
+	Represent::EvaluationContext ctx("increment(x) * v");
+	ctx.define("increment", Function(incr));
+	ctx.define("x", Represent::Value(2));
+	ctx.define("v", Vector4V(1, 1, 1, 1));
+
+	Represent::Value xs[] = { Represent::Value(10) };
+	std::vector<Represent::Column<Represent::Value> > inputs;
+	Represent::Column<Represent::Value> x = { "x", xs };
+	inputs.push_back(x);
+
+	//A function result is only found not to be a scalar when a row runs.
+	Represent::Value output[1];
+	BOOST_CHECK_THROW(ctx.evaluateBatch(inputs, output, 1), boost::bad_get);
+	BOOST_CHECK_EQUAL(boost::get<Vector4V>(ctx.evaluate()), Vector4V(3, 3, 3, 3));
+
+	//Other results that are not scalars are rejected before any row runs.
+	ctx.load("x * v");
+	BOOST_CHECK_THROW(ctx.evaluateBatch(inputs, output, 1), const char *);
+	BOOST_CHECK_EQUAL(boost::get<Vector4V>(ctx.evaluate()), Vector4V(2, 2, 2, 2));
+}
+
+BOOST_AUTO_TEST_CASE(parallel_batches_match_serial)
+{
+	Represent::ThreadPool pool(3);
+
+	const char * corpus[] = { "x * 3 + y", "increment(x) * y - 1" };
+	for (size_t c = 0; c < sizeof(corpus) / sizeof(corpus[0]); ++c)
+	{
+		std::vector<double> xs, ys;
+		for (int i = 0; i < 5000; ++i)
+		{
+			xs.push_back(i / 7.0);
+			ys.push_back(i % 13);
+		}
+
+		Represent::EvaluationContext ctx(corpus[c]);
+		ctx.define("increment", Function(incr));
+
+		std::vector<Represent::Column<double> > inputs;
+		Represent::Column<double> x = { "x", &xs[0] };
+		Represent::Column<double> y = { "y", &ys[0] };
+		inputs.push_back(x);
+		inputs.push_back(y);
+
+		std::vector<double> serial(xs.size()), parallel(xs.size());
+		ctx.evaluateBatch(inputs, &serial[0], serial.size());
+		ctx.evaluateBatch(inputs, &parallel[0], parallel.size(), pool);
+
+		BOOST_CHECK(serial == parallel);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(evaluate_all_keeps_order)
+{
+	Represent::ThreadPool pool(2);
+
+	std::vector<std::string> texts;
+	for (int i = 0; i < 50; ++i)
+	{
+		texts.push_back(boost::lexical_cast<std::string>(i + 1) + " * 2");
+	}
+
+	std::vector<Represent::StorageCell> results = Represent::evaluateAll(texts, pool);
+	BOOST_REQUIRE_EQUAL(results.size(), texts.size());
+	for (int i = 0; i < 50; ++i)
+	{
+		BOOST_CHECK_EQUAL(boost::get<Represent::Value>(results[i]), Represent::Value(2 * (i + 1)));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(shadow_matches_each_precision)
+{
+	const char * corpus[] = 
+	{
+		"32", "-42", "x + 4 * x", "-increment(-increment(4))", "strlen(`abc` + `123`)", 
+		"42 + -41 / 4 - 3", "[1 + 2, (3 + 3) / 2, 4, 4] * 0.5", "0.1 + 0.2 * x", "x / 3 - 0.7"
+	};
+
+	for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); ++i)
+	{
+		Represent::EvaluationContext ctx(corpus[i]);
+		ctx.define("increment", Function(incr));
+		ctx.define("strlen", Function(stringlength));
+		ctx.define("x", Represent::Value("2.5"));
+
+		Represent::ShadowReport report = ctx.evaluateShadow(0);
+		checkSameCell<Represent::Value>(report.full, ctx.evaluateOnStackWith<Represent::Value>());
+		checkSameCell<double>(report.dbl, ctx.evaluateOnStackWith<double>());
+		checkSameCell<float>(report.flt, ctx.evaluateOnStackWith<float>());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(shadow_reports_divergence)
+{
+	//The subtraction exposes the rounding of 1 + 0.0000001, in both double and float.
+	std::string text = "(1 + 0.0000001) - x";
+	Represent::EvaluationContext ctx(text);
+	ctx.define("x", Represent::Value(1));
+
+	Represent::ShadowReport report = ctx.evaluateShadow(4);
+	BOOST_REQUIRE_EQUAL(report.divergences.size(), 1);
+
+	const Represent::Divergence& divergence = report.divergences[0];
+	BOOST_CHECK_EQUAL(divergence.token.offset, text.find('-'));
+	BOOST_CHECK_GT(divergence.doubleUlps, 4);
+	BOOST_CHECK_GT(divergence.floatUlps, 4);
+
+	//0.1 + 0.2 is one ULP off in double, and exact in float.
+	ctx.load("0.1 + 0.2");
+	report = ctx.evaluateShadow(0);
+	BOOST_REQUIRE_EQUAL(report.divergences.size(), 1);
+	BOOST_CHECK_EQUAL(report.divergences[0].doubleUlps, 1);
+	BOOST_CHECK_EQUAL(report.divergences[0].floatUlps, 0);
+	BOOST_CHECK(report.divergences[0].token == Represent::Token(Represent::TOKEN_OPERATOR, Represent::OPERATOR_PLUS));
+
+	BOOST_CHECK(Represent::evaluate("0.1 + 0.2").which() == report.full.which());
+	BOOST_CHECK_EQUAL(boost::get<Represent::Value>(report.full), Represent::Value("0.3"));
+	BOOST_CHECK_EQUAL(boost::get<Represent::Value>(report.dbl), Represent::Value(0.1 + 0.2));
+}
+
+BOOST_AUTO_TEST_CASE(shadow_parts_start_correctly_rounded)
+{
+	//Just past halfway between two doubles, and between two floats, which convert_to rounds down.
+	Represent::Value pastHalf("1.000000000000000111022302462515654042363166809082031250000001");
+	Represent::Shadow shadow = Represent::convertValue(pastHalf, static_cast<Represent::Shadow *>(NULL));
+	BOOST_CHECK_EQUAL(shadow.dbl, std::nextafter(1.0, 2.0));
+	BOOST_CHECK_EQUAL(shadow.flt, 1.0f);
+
+	shadow = Represent::convertValue(Represent::Value("1.000000059604644775390625000001"), static_cast<Represent::Shadow *>(NULL));
+	BOOST_CHECK_EQUAL(shadow.flt, std::nextafter(1.0f, 2.0f));
+
+	//Exactly halfway goes to the even one.
+	shadow = Represent::convertValue(Represent::Value("1.00000000000000011102230246251565404236316680908203125"), static_cast<Represent::Shadow *>(NULL));
+	BOOST_CHECK_EQUAL(shadow.dbl, 1.0);
+
+	shadow = Represent::convertValue(Represent::Value("-1e400"), static_cast<Represent::Shadow *>(NULL));
+	BOOST_CHECK_EQUAL(shadow.dbl, -std::numeric_limits<double>::infinity());
+	BOOST_CHECK_EQUAL(shadow.flt, -std::numeric_limits<float>::infinity());
+
+	//Defined inputs are narrowed the same way.
+	Represent::EvaluationContext ctx("x");
+	ctx.define("x", pastHalf);
+	BOOST_CHECK_EQUAL(boost::get<Represent::Value>(ctx.evaluateShadow(0).dbl), Represent::Value(std::nextafter(1.0, 2.0)));
+}
+
+BOOST_AUTO_TEST_CASE(ulp_distance)
+{
+	BOOST_CHECK_EQUAL(Represent::ulpDistance(1.0, 1.0), 0);
+	BOOST_CHECK_EQUAL(Represent::ulpDistance(0.0, -0.0), 0);
+	BOOST_CHECK_EQUAL(Represent::ulpDistance(1.0f, std::nextafter(1.0f, 2.0f)), 1);
+	BOOST_CHECK_EQUAL(Represent::ulpDistance(std::nextafter(0.0, -1.0), std::nextafter(0.0, 1.0)), 2);
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_stays_in_double)
+{
+	Represent::EvaluationContext ctx("1 + 2 * 3");
+	Represent::AdaptiveResult result = ctx.evaluateAdaptive(0);
+	BOOST_CHECK(result.proven);
+	BOOST_CHECK_EQUAL(result.escalated, 0);
+	BOOST_CHECK_EQUAL(boost::get<Represent::Value>(result.value), Represent::Value(7));
+
+	//One ULP is well within a loose tolerance.
+	ctx.load("0.1 + 0.2");
+	result = ctx.evaluateAdaptive(Represent::Value("1e-15"));
+	BOOST_CHECK(result.proven);
+	BOOST_CHECK_EQUAL(result.escalated, 0);
+	BOOST_CHECK_LE(result.bound, Represent::Value("1e-15"));
+	BOOST_CHECK_LE(abs(boost::get<Represent::Value>(result.value) - Represent::Value("0.3")), result.bound);
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_escalates_wide_subexpressions)
+{
+	//x * 3 is exact in double and is reused, only the addition of 0.1 is not.
+	Represent::EvaluationContext ctx("x * 3 + 0.1");
+	ctx.define("x", Represent::Value(2));
+
+	Represent::AdaptiveResult result = ctx.evaluateAdaptive(Represent::Value("1e-30"));
+	BOOST_CHECK(result.proven);
+	BOOST_CHECK_EQUAL(result.escalated, 1);
+	BOOST_CHECK_LE(result.bound, Represent::Value("1e-30"));
+	BOOST_CHECK_LE(abs(boost::get<Represent::Value>(result.value) - Represent::Value("6.1")), result.bound);
+
+	//The literals are as they were, for the precisions that share them.
+	checkSameCell<Represent::Value>(ctx.evaluateOnStackWith<Represent::Value>(), Represent::StorageCell(Represent::Value("6.1")));
+
+	//Vectors settle per component.
+	ctx.load("[x / 3, 1, 0.5, x] * 3");
+	result = ctx.evaluateAdaptive(Represent::Value("1e-40"));
+	BOOST_CHECK(result.proven);
+	const Vector4V& v = boost::get<Vector4V>(result.value);
+	BOOST_CHECK_LE(abs(v[0] - 2), result.bound);
+	BOOST_CHECK_EQUAL(v[3], Represent::Value(6));
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_reports_unproven)
+{
+	//Division by zero has no finite bound at any precision.
+	Represent::EvaluationContext ctx("1 / x");
+	ctx.define("x", Represent::Value(0));
+
+	Represent::AdaptiveResult result = ctx.evaluateAdaptive(Represent::Value("1e-10"));
+	BOOST_CHECK(!result.proven);
+}
+
+namespace
+{
+	//The bit operators agree in every precision that holds their result.
+	void checkBits(const char * text, const Represent::Value& expected)
+	{
+		Represent::EvaluationContext ctx(text);
+		ctx.define("popcount", Function(popcount));
+		ctx.define("x", Represent::Value(-16));
+
+		BOOST_CHECK_EQUAL(boost::get<Represent::Value>(ctx.evaluateInteger()), expected);
+		BOOST_CHECK_EQUAL(boost::get<Represent::Value>(ctx.evaluate()), expected);
+
+		//The stack and the bytecode agree on integers too.
+		Represent::Integer stack = boost::get<Represent::Integer>(ctx.evaluateNativeOnStack<Represent::Integer>());
+		BOOST_CHECK(stack.valid);
+		BOOST_CHECK_EQUAL(Represent::Value(stack.value), expected);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(bit_operators)
+{
+	checkBits("0xF0 >> 4", 15);
+	checkBits("1 << 63", Represent::Value("-9223372036854775808"));
+	checkBits("1 << 64", 0);
+	checkBits("x s>> 2", -4);
+	checkBits("x >> 60", 15);
+	checkBits("1 <<< 65", 2);
+	checkBits("1 >>> 1", Represent::Value("-9223372036854775808"));
+	checkBits("0xFF & ~0x0F | 0x100", 496);
+	checkBits("3 + 4 & 6", 6);
+	checkBits("popcount(0xFF00FF) + popcount(x)", 76);
+	checkBits("(x << 3 | 5) & ~x s>> 2 >>> 7", Represent::Value("432345564227567616"));
+}
+
+BOOST_AUTO_TEST_CASE(integer_falls_back_to_full_precision)
+{
+	//None of these fit in a signed 64 bit integer, so all are evaluated in Value.
+	Represent::EvaluationContext ctx("7 / 2 + 1");
+	BOOST_CHECK_EQUAL(boost::get<Represent::Value>(ctx.evaluateInteger()), Represent::Value("4.5"));
+
+	ctx.load("0x7FFFFFFFFFFFFFFF + 1");
+	BOOST_CHECK_EQUAL(boost::get<Represent::Value>(ctx.evaluateInteger()), Represent::Value("9223372036854775808"));
+
+	ctx.load("0xFFFFFFFFFFFFFFFF & 5");
+	BOOST_CHECK_EQUAL(boost::get<Represent::Value>(ctx.evaluateInteger()), Represent::Value(5));
+
+	ctx.load("1 s<< 70");
+	BOOST_CHECK_EQUAL(boost::get<Represent::Value>(ctx.evaluateInteger()), Represent::Value("1180591620717411303424"));
+
+	//Past the largest double exponent.
+	ctx.load("3 s<< 1100");
+	Represent::Value scale = boost::multiprecision::pow(Represent::Value(2), 1100);
+	BOOST_CHECK_LT(boost::multiprecision::abs(boost::get<Represent::Value>(ctx.evaluateInteger()) / scale - 3), Represent::Value("1e-90"));
+	BOOST_CHECK_LT(boost::multiprecision::abs(boost::get<Represent::Value>(ctx.evaluate()) / scale - 3), Represent::Value("1e-90"));
+
+	//Up to the limit, and no further.
+	ctx.load("1 s<< 65536");
+	scale = boost::multiprecision::pow(Represent::Value(2), 65536);
+	BOOST_CHECK_LT(boost::multiprecision::abs(boost::get<Represent::Value>(ctx.evaluate()) / scale - 1), Represent::Value("1e-90"));
+
+	ctx.load("1 s<< 70000");
+	Represent::Value past = boost::get<Represent::Value>(ctx.evaluate());
+	Represent::Value pastInteger = boost::get<Represent::Value>(ctx.evaluateInteger());
+	BOOST_CHECK(past != past);
+	BOOST_CHECK(pastInteger != pastInteger);
+
+	//Bits of anything but an integer are not a number.
+	ctx.load("0.5 & 1");
+	Represent::Value full = boost::get<Represent::Value>(ctx.evaluate());
+	Represent::Value integer = boost::get<Represent::Value>(ctx.evaluateInteger());
+	BOOST_CHECK(full != full);
+	BOOST_CHECK(integer != integer);
+}
+
+BOOST_AUTO_TEST_CASE(integer_falls_back_beside_full_precision)
+{
+	//Once prepared, Integer falls back to Value without touching the registers of an 
+	//evaluation in Value on another thread.
+	Represent::EvaluationContext ctx("(x + 0.5) * (x - 0.5) + x");
+	ctx.define("x", Represent::Value(3));
+	ctx.prepare();
+
+	bool full = true;
+	boost::thread thread([&]()
+	{
+		for (int i = 0; i < 2000; ++i)
+		{
+			full = full && boost::get<Represent::Value>(ctx.evaluate()) == Represent::Value("11.75");
+		}
+	});
+
+	bool integer = true;
+	for (int i = 0; i < 2000; ++i)
+	{
+		integer = integer && boost::get<Represent::Value>(ctx.evaluateInteger()) == Represent::Value("11.75");
+	}
+
+	thread.join();
+	BOOST_CHECK(full);
+	BOOST_CHECK(integer);
+}
+
+BOOST_AUTO_TEST_CASE(large_cells_are_boxed)
+{
+	//A cell is as large as the vector it may hold inline, not the matrix.
+	BOOST_CHECK_LT(sizeof(Represent::StorageCell), sizeof(Vector4V) + 2 * sizeof(void *));
+	BOOST_CHECK_LT(sizeof(Represent::StorageCelld), sizeof(Math::Vector4<double>) + 2 * sizeof(void *) + sizeof(std::string));
+
+	//Copies share the boxed value until one of them is changed.
+	Represent::Boxed<std::string> a(std::string("abc"));
+	Represent::Boxed<std::string> b = a;
+	BOOST_CHECK_EQUAL(&*a, &*b);
+
+	b.mutate() += "d";
+	BOOST_CHECK_EQUAL(*a, "abc");
+	BOOST_CHECK_EQUAL(*b, "abcd");
+
+	std::string * unshared = &b.mutate();
+	BOOST_CHECK_EQUAL(unshared, &b.mutate());
+}
+
+BOOST_AUTO_TEST_CASE(boxed_cells_survive_the_stack)
+{
+	Represent::EvaluationContext ctx("strlen({1, 2, x}) + strlen(`ab` + `cd`)");
+	ctx.define("strlen", Function(stringlength));
+	ctx.define("x", Represent::Value(3));
+
+	BOOST_CHECK_EQUAL(boost::get<Represent::Value>(ctx.evaluate()), Represent::Value(7));
+	BOOST_CHECK_EQUAL(boost::get<Represent::Value>(ctx.evaluateOnStackWith<Represent::Value>()), Represent::Value(7));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value(7));
+}
+
+BOOST_AUTO_TEST_CASE(operators_dispatch_on_cell_types)
+{
+	typedef Represent::Detail::BinaryTable<Represent::Value, Represent::StorageCell> Table;
+	const int number = 0, vector = 1, string = 5;
+
+	BOOST_CHECK(Table::table[Represent::OPERATOR_PLUS][number][number]);
+	BOOST_CHECK(Table::table[Represent::OPERATOR_PLUS][string][string]);
+	BOOST_CHECK(Table::table[Represent::OPERATOR_MULTIPLY][number][vector]);
+	BOOST_CHECK(Table::table[Represent::OPERATOR_AND][number][number]);
+
+	BOOST_CHECK(!Table::table[Represent::OPERATOR_PLUS][string][number]);
+	BOOST_CHECK(!Table::table[Represent::OPERATOR_DIVIDE][number][vector]);
+	BOOST_CHECK(!Table::table[Represent::OPERATOR_AND][vector][number]);
+	BOOST_CHECK(!Table::table[Represent::OPERATOR_UNARY_MINUS][number][number]);
+
+	//A miss is rejected, naming the operator and the types.
+	Represent::StorageCell a = Represent::Boxed<std::string>(std::string("ab"));
+	try
+	{
+		Represent::evaluateBinary<Represent::Value>(Represent::OPERATOR_MINUS, a, Represent::StorageCell(Represent::Value(1)));
+		BOOST_ERROR("string - number was not rejected");
+	}
+	catch (const Represent::InvalidArguments& e)
+	{
+		BOOST_CHECK_EQUAL(std::string(e.what()), "Invalid arguments to -: string and number");
+	}
+
+	Represent::StorageCell v = Vector4V(1, 2, 3, 4);
+	Represent::evaluateBinary<Represent::Value>(Represent::OPERATOR_MINUS, v, Represent::StorageCell(Vector4V(1, 1, 1, 1)));
+	BOOST_CHECK_EQUAL(boost::get<Vector4V>(v), Vector4V(0, 1, 2, 3));
+}
+
+BOOST_AUTO_TEST_CASE(operators_are_typed_before_evaluation)
+{
+	BOOST_CHECK_EQUAL(Represent::binaryType(Represent::OPERATOR_PLUS, Represent::CELL_VECTOR, Represent::CELL_SCALAR), Represent::CELL_VECTOR);
+	BOOST_CHECK_EQUAL(Represent::binaryType(Represent::OPERATOR_MULTIPLY, Represent::CELL_SCALAR, Represent::CELL_VECTOR), Represent::CELL_VECTOR);
+	BOOST_CHECK_EQUAL(Represent::binaryType(Represent::OPERATOR_PLUS, Represent::CELL_STRING, Represent::CELL_STRING), Represent::CELL_STRING);
+	BOOST_CHECK_EQUAL(Represent::binaryType(Represent::OPERATOR_DIVIDE, Represent::CELL_SCALAR, Represent::CELL_VECTOR), Represent::CELL_INVALID);
+
+	//Vector arithmetic, on typed registers, and after a function whose result is only known when it runs.
+	Represent::EvaluationContext ctx("[x, x, x, x] * x + [x, 1, x, 1] - 2 * v + strlen(s + `cd`) * v");
+	ctx.define("strlen", Function(stringlength));
+	ctx.define("x", Represent::Value(3));
+	ctx.define("v", Vector4V(1, 2, 3, 4));
+	ctx.define("s", Represent::Boxed<std::string>(std::string("ab")));
+
+	Vector4V expected(14, 14, 18, 18);
+	BOOST_CHECK_EQUAL(boost::get<Vector4V>(ctx.evaluate()), expected);
+	BOOST_CHECK_EQUAL(boost::get<Vector4V>(ctx.evaluateOnStackWith<Represent::Value>()), expected);
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Vector4V, double>()), expected);
+
+	//Ill typed programs are rejected before anything is evaluated, even if they are constant.
+	const char * rejected[] = { "s + x", "-v", "[v, x, x, x]", "{x, s}", "`ab` - 1" };
+	for (size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); ++i)
+	{
+		ctx.load(rejected[i]);
+		BOOST_CHECK_THROW(ctx.evaluate(), Represent::InvalidArguments);
+	}
+}
+
+#ifdef REPRESENT_COUNT_COPIES
+BOOST_AUTO_TEST_CASE(evaluation_moves_cells)
+{
+	Represent::StorageCell a = Represent::Value(1);
+	size_t before = Represent::cellCopies;
+	Represent::StorageCell b = a;
+	BOOST_CHECK_EQUAL(Represent::cellCopies - before, 1);
+
+	//Only loads from storage copy, and they are not counted.
+	const char * expressions[] = 
+	{
+		"x * 2 + 1 - x / 3", 
+		"[x, 1, 2, x] * x - [1, x, x, 1] + 2 * v", 
+		"strlen(s + `cd`) + strlen({m, m, m}) * x",
+		"incr(popcount(x)) + incr(x) * incr(x)",
+		"(x * 2 + 1) * (x * 2 + 1)",
+		"{s, s + s, `ab`}"
+	};
+
+	for (size_t i = 0; i < sizeof(expressions) / sizeof(expressions[0]); ++i)
+	{
+		Represent::EvaluationContext ctx(expressions[i]);
+		ctx.define("strlen", Function(stringlength));
+		ctx.define("incr", Function(incr));
+		ctx.define("popcount", Function(popcount));
+		ctx.define("x", Represent::Value(3));
+		ctx.define("v", Vector4V(1, 2, 3, 4));
+		ctx.define("s", Represent::Boxed<std::string>(std::string("ab")));
+		ctx.define("m", Represent::Boxed<Matrix4V>(Matrix4V()));
+		ctx.prepare();
+		ctx.evaluate();
+		ctx.evaluateOnStackWith<Represent::Value>();
+
+		before = Represent::cellCopies;
+		ctx.evaluateNative<Represent::Value>();
+		ctx.evaluateNative<double>();
+		ctx.evaluateNativeOnStack<Represent::Value>();
+		ctx.evaluateNativeOnStack<double>();
+		BOOST_CHECK_MESSAGE(Represent::cellCopies == before, expressions[i] << " copied " << Represent::cellCopies - before << " cells");
+	}
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(aliases_are_relinked_when_defined)
+{
+	Represent::EvaluationContext ctx("y + 1");
+
+	Represent::Identifier alias;
+	alias.name = "z";
+	ctx.define("y", alias);
+	BOOST_CHECK_THROW(ctx.evaluate(), int);
+
+	//z is a new name, which links y.
+	ctx.define("z", Represent::Value(2));
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(3));
+
+	ctx.define("w", Represent::Value(10));
+	alias.name = "w";
+	ctx.define("y", alias);
+	BOOST_CHECK_EQUAL(ctx.evaluateAs<Represent::Value>(), Represent::Value(11));
+	BOOST_CHECK_EQUAL((ctx.evaluateAsWith<Represent::Value, double>()), Represent::Value(11));
+}
@@ -0,0 +1,82 @@
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "interval.hpp"
+
+namespace
+{
+	typedef Represent::Interval<double> Interval;
+
+	bool holds(const Interval& i, const Represent::Value& exact)
+	{
+		return Represent::exactValue(i.lo) <= exact && exact <= Represent::exactValue(i.hi);
+	}
+
+	//One ULP wide around an inexact result, and a point around an exact one.
+	void checkTight(const Interval& i, bool exact)
+	{
+		if (exact)
+		{
+			BOOST_CHECK_EQUAL(i.lo, i.hi);
+		}
+		else
+		{
+			BOOST_CHECK_EQUAL(std::nextafter(i.lo, i.hi), i.hi);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(intervals_hold_exact_results)
+{
+	std::srand(7);
+	for (int n = 0; n < 1000; ++n)
+	{
+		double a = (std::rand() - RAND_MAX / 2) / 7.0;
+		double b = (std::rand() % 1000 + 1) / 3.0;
+
+		Represent::Value x = Represent::exactValue(a);
+		Represent::Value y = Represent::exactValue(b);
+
+		Interval sum = Interval(a) + Interval(b);
+		Interval difference = Interval(a) - Interval(b);
+		Interval product = Interval(a) * Interval(b);
+		Interval quotient = Interval(a) / Interval(b);
+
+		BOOST_CHECK(holds(sum, x + y));
+		BOOST_CHECK(holds(difference, x - y));
+		BOOST_CHECK(holds(product, x * y));
+
+		//Value division is not exact, but the products of the bounds with b are, and b > 0.
+		BOOST_CHECK(Represent::exactValue(quotient.lo) * y <= x && x <= Represent::exactValue(quotient.hi) * y);
+
+		checkTight(sum, Represent::exactValue(a + b) == x + y);
+		checkTight(product, Represent::exactValue(a * b) == x * y);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(intervals_stay_points_when_exact)
+{
+	Interval i = (Interval(3) * Interval(4) - Interval(2)) / Interval(5);
+	BOOST_CHECK_EQUAL(i.lo, 2);
+	BOOST_CHECK_EQUAL(i.hi, 2);
+}
+
+BOOST_AUTO_TEST_CASE(interval_division_by_zero)
+{
+	Interval i = Interval(1) / Interval(-1, 1);
+	BOOST_CHECK_EQUAL(i.lo, -std::numeric_limits<double>::infinity());
+	BOOST_CHECK_EQUAL(i.hi, std::numeric_limits<double>::infinity());
+}
+
+BOOST_AUTO_TEST_CASE(intervals_bracket_values)
+{
+	Represent::Value tenth("0.1");
+	BOOST_CHECK(Represent::exactValue(Represent::below(tenth)) < tenth);
+	BOOST_CHECK(Represent::exactValue(Represent::above(tenth)) > tenth);
+	BOOST_CHECK_EQUAL(std::nextafter(Represent::below(tenth), 1.0), Represent::above(tenth));
+
+	BOOST_CHECK_EQUAL(Represent::below(Represent::Value("0.5")), 0.5);
+	BOOST_CHECK_EQUAL(Represent::above(Represent::Value("0.5")), 0.5);
+}
@@ -0,0 +1,92 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+#include "kernels.hpp"
+
+namespace
+{
+	template<typename T>
+	void checkKernelsMatchScalar(Represent::KernelType type)
+	{
+		//Odd lengths leave a tail for the scalar loop.
+		const size_t counts[] = { 0, 1, 3, 7, 8, 17, 255, 256 };
+
+		for (boost::uint32_t op = Represent::OPERATOR_PLUS; op <= Represent::OPERATOR_DIVIDE; ++op)
+		{
+			for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+			{
+				std::vector<T> a, b;
+				for (size_t i = 0; i < counts[c]; ++i)
+				{
+					a.push_back(T(std::rand()) / T(7) - T(1000));
+					b.push_back(T(std::rand() % 1000 + 1) / T(3));
+				}
+
+				std::vector<T> expected(a);
+				Represent::selectKernels(Represent::KERNEL_SCALAR);
+				Represent::binaryKernel(op, expected.data(), b.data(), counts[c]);
+
+				std::vector<T> actual(a);
+				Represent::selectKernels(type);
+				Represent::binaryKernel(op, actual.data(), b.data(), counts[c]);
+
+				BOOST_CHECK(expected == actual);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(kernels_match_scalar)
+{
+	Represent::KernelType previous = Represent::selectedKernels();
+	Represent::KernelType supported = Represent::supportedKernels();
+	for (int type = Represent::KERNEL_SCALAR; type <= supported; ++type)
+	{
+		checkKernelsMatchScalar<double>(static_cast<Represent::KernelType>(type));
+		checkKernelsMatchScalar<float>(static_cast<Represent::KernelType>(type));
+	}
+
+	BOOST_CHECK_EQUAL(Represent::selectKernels(Represent::KERNEL_AVX2), supported);
+	BOOST_CHECK_EQUAL(Represent::selectKernels(previous), previous);
+}
+
+BOOST_AUTO_TEST_CASE(kernels_can_be_selected_while_running)
+{
+	Represent::KernelType previous = Represent::selectedKernels();
+	Represent::KernelType supported = Represent::supportedKernels();
+
+	//Every kernel gives the same results, so a row run across a change of kernels must too.
+	std::vector<double> a(257, 3.5), b(257, 0.25), expected(a);
+	Represent::selectKernels(Represent::KERNEL_SCALAR);
+	Represent::binaryKernel(Represent::OPERATOR_MULTIPLY, expected.data(), b.data(), a.size());
+
+	std::atomic<bool> done(false);
+	std::atomic<size_t> mismatches(0);
+	boost::thread_group threads;
+	for (int i = 0; i < 4; ++i)
+	{
+		threads.create_thread([&]()
+		{
+			while (!done)
+			{
+				std::vector<double> actual(a);
+				Represent::binaryKernel(Represent::OPERATOR_MULTIPLY, actual.data(), b.data(), actual.size());
+				mismatches += actual != expected;
+			}
+		});
+	}
+
+	for (int i = 0; i < 10000; ++i)
+	{
+		Represent::selectKernels(static_cast<Represent::KernelType>(i % (supported + 1)));
+	}
+
+	done = true;
+	threads.join_all();
+
+	BOOST_CHECK_EQUAL(mismatches.load(), 0u);
+	BOOST_CHECK_EQUAL(Represent::selectKernels(previous), previous);
+}
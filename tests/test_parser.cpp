@@ -1,23 +1,26 @@
 #define BOOST_TEST_MODULE parser test
 #include <boost/test/unit_test.hpp>
 #include <boost/cstdint.hpp>
+#include <cmath>
+#include <cstdlib>
 
 #include "parser.hpp"
 #include "conversion.hpp"
 
 using namespace Represent;
 
+//The buffer holds (type, value, extra) triples.
 void compare(const TokenStream& ts, boost::uint32_t * buffer, size_t len)
 {
 	const std::vector<Token>& tokens = ts.getTokens();
 
-	BOOST_CHECK_EQUAL(len % 2, 0);
-	BOOST_CHECK_EQUAL(tokens.size(), len / 2);
+	BOOST_CHECK_EQUAL(len % 3, 0);
+	BOOST_CHECK_EQUAL(tokens.size(), len / 3);
 
 	std::vector<Token> comp;
-	for (size_t i = 0; i < len / 2; ++i)
+	for (size_t i = 0; i < len / 3; ++i)
 	{
-		comp.push_back(Token(static_cast<TokenType>(buffer[i * 2 + 0]), buffer[i * 2 + 1]));
+		comp.push_back(Token(static_cast<TokenType>(buffer[i * 3 + 0]), buffer[i * 3 + 1], buffer[i * 3 + 2]));
 	}
 
 	BOOST_CHECK_EQUAL_COLLECTIONS(tokens.begin(), tokens.end(), comp.begin(), comp.end());
@@ -28,58 +31,71 @@ void compare(const TokenStream& ts, boost::uint32_t * buffer, size_t len)
 BOOST_AUTO_TEST_CASE(parse_number)
 {
 	TokenStream tokens = Represent::parse("1");
-	boost::uint32_t expected[] = { TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 1 };
+	boost::uint32_t expected[] = { TOKEN_NUMBER, 1, 10 };
 
-	compare(tokens, expected, 4);
+	compare(tokens, expected, 3);
+	BOOST_CHECK_EQUAL(tokens.lexeme(*tokens.begin()), "1");
 }
 
 BOOST_AUTO_TEST_CASE(parse_binary)
 {
 	TokenStream tokens = Represent::parse("0b00001111");
-	boost::uint32_t expected[] = {TOKEN_BASE_FLAG, 2, TOKEN_NUMBER, 0, TOKEN_NUMBER, 0, TOKEN_NUMBER, 0, TOKEN_NUMBER, 0, TOKEN_NUMBER, 1, 
-		TOKEN_NUMBER, 1, TOKEN_NUMBER, 1, TOKEN_NUMBER, 1};
+	boost::uint32_t expected[] = {TOKEN_NUMBER, 8, 2};
 
 	AUTO_COMPARE(tokens, expected);
+	BOOST_CHECK_EQUAL(tokens.lexeme(*tokens.begin()), "00001111");
 }
 
 BOOST_AUTO_TEST_CASE(parse_octal)
 {
 	TokenStream tokens = Represent::parse("0777");
-	boost::uint32_t expected[] = {TOKEN_BASE_FLAG, 8, TOKEN_NUMBER, 7, TOKEN_NUMBER, 7, TOKEN_NUMBER, 7}; 
+	boost::uint32_t expected[] = {TOKEN_NUMBER, 3, 8}; 
 
 	AUTO_COMPARE(tokens, expected);
+	BOOST_CHECK_EQUAL(tokens.lexeme(*tokens.begin()), "777");
 }
 
 BOOST_AUTO_TEST_CASE(parse_hex)
 {
-	boost::uint32_t expected[] = {TOKEN_BASE_FLAG, 16, TOKEN_NUMBER, 15, TOKEN_NUMBER, 0, TOKEN_NUMBER, 5};
+	boost::uint32_t expected[] = {TOKEN_NUMBER, 3, 16};
 	AUTO_COMPARE(Represent::parse("0xF05"), expected);
 }
 
 BOOST_AUTO_TEST_CASE(parse_decimal) 
 {
-	boost::uint32_t expected[] = {TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 0, TOKEN_DECIMAL_POINT, 0, TOKEN_NUMBER, 1};
+	boost::uint32_t expected[] = {TOKEN_NUMBER, 3, 10};
 	compare(Represent::parse("0.1"), expected, sizeof(expected) / sizeof(expected[0]));
 }
 
 BOOST_AUTO_TEST_CASE(parse_hex_decimal) 
 {
-	boost::uint32_t expected[] = {TOKEN_BASE_FLAG, 16, TOKEN_NUMBER, 10, TOKEN_NUMBER, 5, TOKEN_NUMBER, 14, TOKEN_DECIMAL_POINT, 0, TOKEN_NUMBER, 14};
-	compare(Represent::parse("0xA5E.E"), expected, sizeof(expected) / sizeof(expected[0]));
+	TokenStream tokens = Represent::parse("0xA5E.E");
+	boost::uint32_t expected[] = {TOKEN_NUMBER, 5, 16};
+
+	compare(tokens, expected, sizeof(expected) / sizeof(expected[0]));
+	BOOST_CHECK_EQUAL(tokens.lexeme(*tokens.begin()), "A5E.E");
 }
 
 BOOST_AUTO_TEST_CASE(octal_zero)
 {
-	boost::uint32_t expected[] = {TOKEN_BASE_FLAG, 8, TOKEN_NUMBER, 0};
+	boost::uint32_t expected[] = {TOKEN_NUMBER, 1, 8};
 	compare(Represent::parse("00"), expected, sizeof(expected) / sizeof(expected[0]));
 }
 
 BOOST_AUTO_TEST_CASE(octal_decimal) 
 {
-	boost::uint32_t expected[] = {TOKEN_BASE_FLAG, 8, TOKEN_NUMBER, 0, TOKEN_DECIMAL_POINT, 0, TOKEN_NUMBER, 0};
+	boost::uint32_t expected[] = {TOKEN_NUMBER, 3, 8};
 	compare(Represent::parse("00.0"), expected, sizeof(expected) / sizeof(expected[0]));
 }
 
+BOOST_AUTO_TEST_CASE(long_literal_is_one_token)
+{
+	TokenStream tokens = Represent::parse("0x0123456789ABCDEF0123456789ABCDEF01234567 + 1");
+	boost::uint32_t expected[] = {TOKEN_NUMBER, 40, 16, TOKEN_OPERATOR, OPERATOR_PLUS, 0, TOKEN_NUMBER, 1, 10};
+
+	AUTO_COMPARE(tokens, expected);
+}
+
 BOOST_AUTO_TEST_CASE(parse_empty)
 {
 	TokenStream tokens = Represent::parse("");
@@ -104,10 +120,101 @@ BOOST_AUTO_TEST_CASE(convert_small)
 	BOOST_CHECK_EQUAL(v, Value("0.000000001"));
 }
 
+BOOST_AUTO_TEST_CASE(convert_bases)
+{
+	BOOST_CHECK_EQUAL(Represent::convert(Represent::parse("0xA5E.E")), Value("2654.875"));
+	BOOST_CHECK_EQUAL(Represent::convert(Represent::parse("0b1011.1")), Value("11.5"));
+	BOOST_CHECK_EQUAL(Represent::convert(Represent::parse("0777")), Value("511"));
+	BOOST_CHECK_EQUAL(Represent::convert(Represent::parse("0")), Value("0"));
+}
+
+BOOST_AUTO_TEST_CASE(convert_integer)
+{
+	boost::uint64_t v = 0;
+	BOOST_CHECK(Represent::convertInteger("DEADBEEF", 16, v));
+	BOOST_CHECK_EQUAL(v, 0xDEADBEEFull);
+	BOOST_CHECK(Represent::convertInteger("18446744073709551615", 10, v));
+	BOOST_CHECK_EQUAL(v, 18446744073709551615ull);
+
+	BOOST_CHECK(!Represent::convertInteger("18446744073709551616", 10, v));
+	BOOST_CHECK(!Represent::convertInteger("1.5", 10, v));
+}
+
+//Long integers are converted in 64 bit chunks.
+BOOST_AUTO_TEST_CASE(convert_long_integers)
+{
+	BOOST_CHECK_EQUAL(Represent::convert("123456789012345678901234567890123456789012345678901234567890", 10), 
+		Value("123456789012345678901234567890123456789012345678901234567890"));
+	BOOST_CHECK_EQUAL(Represent::convert("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF", 16), Value("340282366920938463463374607431768211455"));
+	BOOST_CHECK_EQUAL(Represent::convert(std::string(70, '1'), 2), Value("1180591620717411303423"));
+}
+
+//Fractions are scaled once by an exact power of the base, so they must match the decimal
+//expansion exactly.
+BOOST_AUTO_TEST_CASE(convert_fractions_exact)
+{
+	BOOST_CHECK_EQUAL(Represent::convert("3.14159265358979323846264338327950288419716939937510", 10),
+		Value("3.14159265358979323846264338327950288419716939937510"));
+	BOOST_CHECK_EQUAL(Represent::convert("0.000000000000000000000000000001", 10), Value("1e-30"));
+	BOOST_CHECK_EQUAL(Represent::convert("0.1011011101111011111011111101111111", 2), Value("0.7167348786606453359127044677734375"));
+	BOOST_CHECK_EQUAL(Represent::convert("0.DEADBEEFCAFEBABE", 16),
+		Value("0.869838651221466568094591031989892826459254138171672821044921875"));
+	BOOST_CHECK_EQUAL(Represent::convert("0.7654321076543210", 8), Value("0.979591904854288486603763885796070098876953125"));
+	BOOST_CHECK_EQUAL(Represent::convert("0." + std::string(51, '0') + "1", 2), Value("2.220446049250313080847263336181640625e-16"));
+
+	std::string digits = "12345678901234567890123456789012345678901234567890";
+	for (size_t point = 1; point < digits.size(); point += 7)
+	{
+		std::string literal = digits.substr(0, point) + "." + digits.substr(point);
+		BOOST_CHECK_EQUAL(Represent::convert(literal, 10), Value(literal));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(convert_as_double_is_correctly_rounded)
+{
+	BOOST_CHECK_EQUAL(Represent::convertAs<double>("0.1", 10), 0.1);
+	BOOST_CHECK_EQUAL(Represent::convertAs<double>("0.30000000000000004", 10), 0.30000000000000004);
+	BOOST_CHECK_EQUAL(Represent::convertAs<double>("9007199254740993", 10), 9007199254740992.0);
+	BOOST_CHECK_EQUAL(Represent::convertAs<double>("3.14159265358979323846264338327950288", 10), 3.14159265358979323846);
+	BOOST_CHECK_EQUAL(Represent::convertAs<float>("16777217", 10), 16777216.0f);
+	BOOST_CHECK_EQUAL(Represent::convertAs<float>("0.1", 10), 0.1f);
+
+	//Power of two bases round to nearest, ties to even.
+	BOOST_CHECK_EQUAL(Represent::convertAs<double>("0.1", 2), 0.5);
+	BOOST_CHECK_EQUAL(Represent::convertAs<double>("1" + std::string(53, '0') + "1", 2), std::ldexp(1.0, 54));
+	BOOST_CHECK_EQUAL(Represent::convertAs<double>("1" + std::string(52, '0') + "11", 2), std::ldexp(1.0, 54) + 4);
+	BOOST_CHECK_EQUAL(Represent::convertAs<double>("FFFFFFFFFFFFFFFFF", 16), std::ldexp(1.0, 68));
+	BOOST_CHECK_EQUAL(Represent::convertAs<double>("0.DEADBEEF", 16), 0xDEADBEEF / std::ldexp(1.0, 32));
+	BOOST_CHECK_EQUAL(Represent::convertAs<float>("0.77777776", 8), 1.0f - std::ldexp(1.0f, -23));
+	BOOST_CHECK_EQUAL(Represent::convertAs<float>("0.777777774", 8), 1.0f);
+	BOOST_CHECK_EQUAL(Represent::convertAs<double>("0." + std::string(1073, '0') + "1", 2), std::ldexp(1.0, -1074));
+}
+
+BOOST_AUTO_TEST_CASE(convert_as_matches_strtod)
+{
+	boost::uint32_t seed = 12345;
+	for (size_t i = 0; i < 2000; ++i)
+	{
+		std::string digits;
+		size_t length = 1 + i % 25;
+		for (size_t d = 0; d < length; ++d)
+		{
+			seed = seed * 1103515245 + 12345;
+			digits.push_back('0' + (seed >> 16) % 10);
+		}
+
+		digits.insert(digits.begin() + (seed >> 8) % (length + 1), '.');
+
+		std::string text = "0" + digits;
+		BOOST_CHECK_EQUAL(Represent::convertAs<double>(digits, 10), std::strtod(text.c_str(), NULL));
+		BOOST_CHECK_EQUAL(Represent::convertAs<float>(digits, 10), std::strtof(text.c_str(), NULL));
+	}
+}
+
 BOOST_AUTO_TEST_CASE(parse_simple_expression)
 {
 	TokenStream tokens = Represent::parse("42 + 5");
-	boost::uint32_t expected[] = {TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 4, TOKEN_NUMBER, 2, TOKEN_OPERATOR, OPERATOR_PLUS, TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 5};
+	boost::uint32_t expected[] = {TOKEN_NUMBER, 2, 10, TOKEN_OPERATOR, OPERATOR_PLUS, 0, TOKEN_NUMBER, 1, 10};
 
 	compare(tokens, expected, sizeof(expected) / sizeof(expected[0]));
 	AUTO_COMPARE(tokens, expected);
@@ -121,26 +228,40 @@ BOOST_AUTO_TEST_CASE(fail_parse_expression)
 
 BOOST_AUTO_TEST_CASE(parse_unary_plus)
 {
-	boost::uint32_t expected[] = {TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 4};
+	boost::uint32_t expected[] = {TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, 0, TOKEN_NUMBER, 1, 10};
 	AUTO_COMPARE(Represent::parse("+4"), expected);
 }
 
 BOOST_AUTO_TEST_CASE(parse_unary_minus)
 {
-	boost::uint32_t expected[] = {TOKEN_OPERATOR, OPERATOR_UNARY_MINUS, TOKEN_BASE_FLAG, 2, TOKEN_NUMBER, 1};
+	boost::uint32_t expected[] = {TOKEN_OPERATOR, OPERATOR_UNARY_MINUS, 0, TOKEN_NUMBER, 1, 2};
 	AUTO_COMPARE(Represent::parse("-0b1"), expected);
 }
 
+BOOST_AUTO_TEST_CASE(parse_bit_operators)
+{
+	//The longest spelling wins, so >>> is a rotate and not a shift followed by >.
+	boost::uint32_t expected[] = {
+		TOKEN_OPERATOR, OPERATOR_NOT, 0, TOKEN_NUMBER, 1, 10,
+		TOKEN_OPERATOR, OPERATOR_ROTATE_RIGHT, 0, TOKEN_NUMBER, 1, 10,
+		TOKEN_OPERATOR, OPERATOR_ARITHMETIC_SHIFT_LEFT, 0, TOKEN_NUMBER, 1, 10,
+		TOKEN_OPERATOR, OPERATOR_AND, 0, TOKEN_NUMBER, 1, 10,
+		TOKEN_OPERATOR, OPERATOR_SHIFT_RIGHT, 0, TOKEN_NUMBER, 1, 10
+	};
+
+	AUTO_COMPARE(Represent::parse("~1 >>> 2 s<< 3 & 4 >> 5"), expected);
+}
+
 BOOST_AUTO_TEST_CASE(parse_multiple_unary_op)
 {
 	TokenStream tokens = Represent::parse("+++++4");
 	boost::uint32_t expected[] = {
-		TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, 
-		TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, 
-		TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, 
-		TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, 
-		TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, 
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 4
+		TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, 0,
+		TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, 0,
+		TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, 0,
+		TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, 0,
+		TOKEN_OPERATOR, OPERATOR_UNARY_PLUS, 0,
+		TOKEN_NUMBER, 1, 10
 	};
 
 	AUTO_COMPARE(tokens, expected);
@@ -150,22 +271,24 @@ BOOST_AUTO_TEST_CASE(parse_function)
 {
 	TokenStream tokens = Represent::parse("fun(1, 2, 3)");
 	boost::uint32_t expected[] = {
-		TOKEN_FUNCTION_IDENTIFIER, 3, 
-		TOKEN_IDENTIFIER_RAW, 0, TOKEN_RAW, 'f', TOKEN_RAW, 'u', TOKEN_RAW, 'n', TOKEN_PAREN, 0, 
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 1, TOKEN_ARG_DELIMIT, 0, TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 2, TOKEN_ARG_DELIMIT, 0, 
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 3, TOKEN_PAREN, 1};
+		TOKEN_FUNCTION_IDENTIFIER, 3, 0,
+		TOKEN_IDENTIFIER_RAW, 3, 0, TOKEN_PAREN, 0, 0,
+		TOKEN_NUMBER, 1, 10, TOKEN_ARG_DELIMIT, 0, 0, TOKEN_NUMBER, 1, 10, TOKEN_ARG_DELIMIT, 0, 0,
+		TOKEN_NUMBER, 1, 10, TOKEN_PAREN, 1, 0};
 
 	AUTO_COMPARE(tokens, expected);
+	BOOST_CHECK_EQUAL(tokens.lexeme(*(tokens.begin() + 1)), "fun");
 }
 
 BOOST_AUTO_TEST_CASE(parse_identifier_only)
 {
 	TokenStream tokens = Represent::parse("id");
 	boost::uint32_t expected[] = {
-		TOKEN_IDENTIFIER_RAW, 0, TOKEN_RAW, 'i', TOKEN_RAW, 'd'
+		TOKEN_IDENTIFIER_RAW, 2, 0
 	};
 
 	AUTO_COMPARE(tokens, expected);
+	BOOST_CHECK_EQUAL(tokens.lexeme(*tokens.begin()), "id");
 }
 
 BOOST_AUTO_TEST_CASE(function_names_cannot_end_with_dash)
@@ -178,9 +301,9 @@ BOOST_AUTO_TEST_CASE(parse_identifier)
 {
 	TokenStream tokens = Represent::parse("pi + 4");
 	boost::uint32_t expected[] = {
-		TOKEN_IDENTIFIER_RAW, 0, TOKEN_RAW, 'p', TOKEN_RAW, 'i', 
-		TOKEN_OPERATOR, OPERATOR_PLUS, 
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 4
+		TOKEN_IDENTIFIER_RAW, 2, 0,
+		TOKEN_OPERATOR, OPERATOR_PLUS, 0,
+		TOKEN_NUMBER, 1, 10
 	};
 
 	AUTO_COMPARE(tokens, expected);
@@ -190,30 +313,31 @@ BOOST_AUTO_TEST_CASE(parse_identifier_2)
 {
 	TokenStream tokens = Represent::parse("4 + pi");
 	boost::uint32_t expected[] = {
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 4,
-		TOKEN_OPERATOR, OPERATOR_PLUS, 
-		TOKEN_IDENTIFIER_RAW, 0, TOKEN_RAW, 'p', TOKEN_RAW, 'i', 
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_OPERATOR, OPERATOR_PLUS, 0,
+		TOKEN_IDENTIFIER_RAW, 2, 0
 	};
 
 	AUTO_COMPARE(tokens, expected);
+	BOOST_CHECK_EQUAL(tokens.lexeme(*(tokens.begin() + 2)), "pi");
 }
 
 BOOST_AUTO_TEST_CASE(parse_string)
 {
 	TokenStream tokens = Represent::parse("`4 + 4`"); 
 	boost::uint32_t expected[] = {
-		TOKEN_STRING_START, 0, 
-		TOKEN_RAW, '4', TOKEN_RAW, ' ', TOKEN_RAW, '+', TOKEN_RAW, ' ', TOKEN_RAW, '4'
+		TOKEN_STRING, 5, 0
 	};
 
 	AUTO_COMPARE(tokens, expected);
+	BOOST_CHECK_EQUAL(convertString(tokens.lexeme(*tokens.begin())), "4 + 4");
 }
 
 BOOST_AUTO_TEST_CASE(parse_empty_string)
 {
 	TokenStream tokens = Represent::parse("``");
 	boost::uint32_t expected[] = {
-		TOKEN_STRING_START, 0
+		TOKEN_STRING, 0, 0
 	};
 
 	AUTO_COMPARE(tokens, expected);
@@ -223,40 +347,38 @@ BOOST_AUTO_TEST_CASE(parse_escaped_string)
 {
 	TokenStream tokens = Represent::parse("`\\``");
 	boost::uint32_t expected[] = {
-		TOKEN_STRING_START, 0, 
-		TOKEN_RAW, '`'
+		TOKEN_STRING, 2, 0
 	};
 	
 	AUTO_COMPARE(tokens, expected);
+	BOOST_CHECK_EQUAL(convertString(tokens.lexeme(*tokens.begin())), "`");
 }
 
 BOOST_AUTO_TEST_CASE(parse_escaped_string_2)
 {
 	TokenStream tokens = Represent::parse("`\\\\ \\``");
 	boost::uint32_t expected[] = {
-		TOKEN_STRING_START, 0, 
-		TOKEN_RAW, '\\',
-		TOKEN_RAW, ' ',
-		TOKEN_RAW, '`'
+		TOKEN_STRING, 5, 0
 	};
 
 	AUTO_COMPARE(tokens, expected);
+	BOOST_CHECK_EQUAL(convertString(tokens.lexeme(*tokens.begin())), "\\ `");
 }
 
 BOOST_AUTO_TEST_CASE(parse_vector)
 {
 	TokenStream tokens = Represent::parse("[1, 2, 3, 4]");
 	boost::uint32_t expected[] = {
-		TOKEN_VECTOR, 0, 
-		TOKEN_PAREN, 0,
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 1, 
-		TOKEN_ARG_DELIMIT, 0, 
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 2, 
-		TOKEN_ARG_DELIMIT, 0, 
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 3, 
-		TOKEN_ARG_DELIMIT, 0, 
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 4, 
-		TOKEN_PAREN, 1
+		TOKEN_VECTOR, 0, 0,
+		TOKEN_PAREN, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_ARG_DELIMIT, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_ARG_DELIMIT, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_ARG_DELIMIT, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_PAREN, 1, 0
 	};
 
 	AUTO_COMPARE(tokens, expected);
@@ -266,16 +388,16 @@ BOOST_AUTO_TEST_CASE(parse_quaternion)
 {
 	TokenStream tokens = Represent::parse("q[1, 2, 3, 4]");
 	boost::uint32_t expected[] = {
-		TOKEN_QUATERNION, 0, 
-		TOKEN_PAREN, 0, 
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 1, 
-		TOKEN_ARG_DELIMIT, 0, 
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 2, 
-		TOKEN_ARG_DELIMIT, 0, 
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 3, 
-		TOKEN_ARG_DELIMIT, 0, 
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 4, 
-		TOKEN_PAREN, 1
+		TOKEN_QUATERNION, 0, 0,
+		TOKEN_PAREN, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_ARG_DELIMIT, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_ARG_DELIMIT, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_ARG_DELIMIT, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_PAREN, 1, 0
 	};
 
 	AUTO_COMPARE(tokens, expected);
@@ -285,10 +407,10 @@ BOOST_AUTO_TEST_CASE(parse_array_simple)
 {
 	TokenStream tokens = Represent::parse("{1}");
 	boost::uint32_t expected[] = {
-		TOKEN_ARRAY, 1, 
-		TOKEN_PAREN, 0,
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 1, 
-		TOKEN_PAREN, 1
+		TOKEN_ARRAY, 1, 0,
+		TOKEN_PAREN, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_PAREN, 1, 0
 	};
 
 	AUTO_COMPARE(tokens, expected);
@@ -298,19 +420,134 @@ BOOST_AUTO_TEST_CASE(parse_array_simple_2)
 {
 	TokenStream tokens = Represent::parse("{1, 2, 3, 4, 5}");
 	boost::uint32_t expected[] = {		
-		TOKEN_ARRAY, 5,
-		TOKEN_PAREN, 0,
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 1,  
-		TOKEN_ARG_DELIMIT, 0,
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 2, 
-		TOKEN_ARG_DELIMIT, 0,
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 3, 
-		TOKEN_ARG_DELIMIT, 0,
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 4, 
-		TOKEN_ARG_DELIMIT, 0,
-		TOKEN_BASE_FLAG, 10, TOKEN_NUMBER, 5, 
-		TOKEN_PAREN, 1
+		TOKEN_ARRAY, 5, 0,
+		TOKEN_PAREN, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_ARG_DELIMIT, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_ARG_DELIMIT, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_ARG_DELIMIT, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_ARG_DELIMIT, 0, 0,
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_PAREN, 1, 0
 	};
 
 	AUTO_COMPARE(tokens, expected);
-}
\ No newline at end of file
+}
+
+namespace
+{
+	const char * differentialCorpus[] = {
+		"1", "0", "00.0", "0+1", "0xA5E.E", "0b1011.1", "1.+2", "42 + 5", "+++++4", "-0b1",
+		"1 + 2 * 3 - 4 / 5", "a .+ b .* c", "1 .+ 2", "(1 + 2) * 3", "((1))", "(1 + (2 + (3 + 4))) / 5",
+		"pi + 4", "a-b", "fun(1, 2, 3)", "f(g(1), (2 + 3) * 4, -h(5))", "q", "qx + q[1, 2, 3, 4]",
+		"`4 + 4`", "`\\\\ \\``", "strlen(`abc` + `123`)", "[1, 2, 3, 4]", "[1 + 2, (3 + 3) / 2, 4, 4] * 0.5",
+		"[[1, 2, 3, 4] + 1, 2, 3, 4]", "[[1, 2, 3, 4]; [5, 6, 7, 8]; [9, 10, 11, 12]; [13, 14, 15, 16]]",
+		"{1}", "{1, 2, 3, 4, 5} + 2", "{[1, 2, 3, 4], {1}}", "-increment(-increment(4))",
+		"  f ( 1 ,2 )  ", "q [1, 2, 3, 4]", " { 1 } ", "\t1\n+\n2", "0x+1", "``", "`abc",
+		"42 + ", "fun-(1, 2, 3)", "1 2", "fo o", "-(1)", "f()", "[1, 2, 3]", "[[1, 2, 3, 4]; [5, 6, 7, 8]]", "(1", "1)", "{}", "+", ".5"
+	};
+}
+
+BOOST_AUTO_TEST_CASE(pratt_matches_backtracking)
+{
+	size_t count = sizeof(differentialCorpus) / sizeof(differentialCorpus[0]);
+	for (size_t i = 0; i < count; ++i)
+	{
+		TokenStream pratt = Represent::parse(differentialCorpus[i], PARSER_PRATT);
+		TokenStream backtracking = Represent::parse(differentialCorpus[i], PARSER_BACKTRACKING);
+
+		BOOST_TEST_CONTEXT(differentialCorpus[i])
+		{
+			BOOST_CHECK_EQUAL_COLLECTIONS(pratt.begin(), pratt.end(), backtracking.begin(), backtracking.end());
+
+			std::vector<boost::uint32_t> prattOffsets, backtrackingOffsets;
+			for (auto it = pratt.begin(); it != pratt.end(); ++it)
+			{
+				prattOffsets.push_back(it->offset);
+			}
+
+			for (auto it = backtracking.begin(); it != backtracking.end(); ++it)
+			{
+				backtrackingOffsets.push_back(it->offset);
+			}
+
+			BOOST_CHECK_EQUAL_COLLECTIONS(prattOffsets.begin(), prattOffsets.end(), backtrackingOffsets.begin(), backtrackingOffsets.end());
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(pratt_deep_nesting)
+{
+	std::string text;
+	for (size_t i = 0; i < 2000; ++i)
+	{
+		text += "(a+";
+	}
+
+	text += "b";
+	text += std::string(2000, ')');
+
+	TokenStream tokens = Represent::parse(text);
+	BOOST_CHECK_EQUAL(tokens.end() - tokens.begin(), 2000 * 4 + 1);
+}
+
+
+BOOST_AUTO_TEST_CASE(parse_records_offsets)
+{
+	const char * text = "  42 +\tpi";
+	TokenStream tokens = Represent::parse(text);
+	boost::uint32_t expected[] = {
+		TOKEN_NUMBER, 2, 10,
+		TOKEN_OPERATOR, OPERATOR_PLUS, 0,
+		TOKEN_IDENTIFIER_RAW, 2, 0
+	};
+
+	AUTO_COMPARE(tokens, expected);
+
+	boost::uint32_t offsets[] = { 2, 5, 7 };
+	std::vector<boost::uint32_t> actual;
+	for (auto it = tokens.begin(); it != tokens.end(); ++it)
+	{
+		actual.push_back(it->offset);
+	}
+
+	BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), offsets, offsets + 3);
+	BOOST_CHECK(tokens.getSource().data() == text);
+}
+
+BOOST_AUTO_TEST_CASE(whitespace_separates_lexemes)
+{
+	BOOST_CHECK(Represent::parse("1 2").begin() == Represent::parse("1 2").end());
+	BOOST_CHECK(Represent::parse(" ` a b ` ").begin() != Represent::parse(" ` a b ` ").end());
+}
+
+BOOST_AUTO_TEST_CASE(rollback_discards_tokens_after_mark)
+{
+	TokenStream tokens = Represent::parse("1 + 2");
+	TokenStream::Mark mark = tokens.mark();
+	tokens.push(Token(TOKEN_OPERATOR, OPERATOR_MULTIPLY));
+	tokens.push(Token(TOKEN_NUMBER, 1, 10));
+	tokens.rollback(mark);
+
+	boost::uint32_t expected[] = {
+		TOKEN_NUMBER, 1, 10,
+		TOKEN_OPERATOR, OPERATOR_PLUS, 0,
+		TOKEN_NUMBER, 1, 10
+	};
+
+	AUTO_COMPARE(tokens, expected);
+}
+
+//Matrices are first tried as vectors, so the failed attempt must not leave tokens behind.
+BOOST_AUTO_TEST_CASE(backtracking_leaves_no_partial_tokens)
+{
+	const char * text = "[[1, 2, 3, 4]; [1, 2, 3, 4]; [1, 2, 3, 4]; [1, 2, 3, 4]]";
+	TokenStream backtracking = Represent::parse(text, PARSER_BACKTRACKING);
+	TokenStream pratt = Represent::parse(text, PARSER_PRATT);
+
+	BOOST_CHECK_EQUAL(backtracking.begin()->type, TOKEN_MATRIX);
+	BOOST_CHECK_EQUAL_COLLECTIONS(backtracking.begin(), backtracking.end(), pratt.begin(), pratt.end());
+}
@@ -0,0 +1,63 @@
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "threadpool.hpp"
+
+BOOST_AUTO_TEST_CASE(pool_runs_every_task_once)
+{
+	Represent::ThreadPool pool(4);
+	BOOST_CHECK_EQUAL(pool.size(), 4u);
+
+	const size_t counts[] = { 0, 1, 3, 4, 5, 1000 };
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+	{
+		std::vector<int> runs(counts[c]);
+		pool.run(counts[c], [&](size_t task, size_t worker)
+		{
+			++runs[task];
+		});
+
+		BOOST_CHECK(std::count(runs.begin(), runs.end(), 1) == static_cast<int>(counts[c]));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(pool_steals_uneven_work)
+{
+	Represent::ThreadPool pool(4);
+
+	//The first worker's range is far slower than the others, so it has to be stolen from.
+	std::vector<size_t> workers(400);
+	pool.run(workers.size(), [&](size_t task, size_t worker)
+	{
+		if (task < 100)
+		{
+			boost::this_thread::sleep(boost::posix_time::microseconds(200));
+		}
+
+		workers[task] = worker;
+	});
+
+	BOOST_CHECK(std::count(workers.begin(), workers.begin() + 100, 0u) < 100);
+}
+
+BOOST_AUTO_TEST_CASE(pool_rethrows_task_errors)
+{
+	Represent::ThreadPool pool(2);
+
+	std::vector<int> runs(10);
+	BOOST_CHECK_THROW(pool.run(runs.size(), [&](size_t task, size_t)
+	{
+		++runs[task];
+		if (task == 3)
+		{
+			throw "Failed";
+		}
+	}), const char *);
+
+	BOOST_CHECK(std::count(runs.begin(), runs.end(), 1) == 10);
+
+	//The pool is still usable.
+	pool.run(runs.size(), [&](size_t task, size_t) { ++runs[task]; });
+	BOOST_CHECK(std::count(runs.begin(), runs.end(), 2) == 10);
+}